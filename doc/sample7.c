@@ -0,0 +1,112 @@
+/*
+ * sample7.c
+ * Copyright (C) 2003      Regis Duchesne <hpreg@zoy.org>
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * This program reads a MPEG-2 stream, and saves each of its frames as
+ * an image file using the PPM format (color).
+ *
+ * It demonstrates how to use the following features of libmpeg2:
+ * - Input is handed to mpeg2_decode_batch() in batches of buffers,
+ *   which passes each decoded frame to a callback.
+ * - Output buffers use the RGB 24-bit chunky format.
+ * - Output buffers are allocated and managed by the library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "mpeg2.h"
+#include "mpeg2convert.h"
+
+static int save_ppm (void * arg, const mpeg2_info_t * info)
+{
+    int * framenum = (int *) arg;
+    char filename[100];
+    FILE * ppmfile;
+
+    sprintf (filename, "%d.ppm", (*framenum)++);
+    ppmfile = fopen (filename, "wb");
+    if (!ppmfile) {
+	fprintf (stderr, "Could not open file \"%s\".\n", filename);
+	return 1;
+    }
+    fprintf (ppmfile, "P6\n%d %d\n255\n",
+	     info->sequence->width, info->sequence->height);
+    fwrite (info->display_fbuf->buf[0], 3 * info->sequence->width,
+	    info->sequence->height, ppmfile);
+    fclose (ppmfile);
+    return 0;
+}
+
+static void sample7 (FILE * mpgfile)
+{
+#define BUFFER_SIZE 4096
+#define MAX_BUFFERS 256
+    static uint8_t buffer[MAX_BUFFERS][BUFFER_SIZE];
+    mpeg2_batch_buf_t batch[MAX_BUFFERS];
+    mpeg2dec_t * decoder;
+    size_t size;
+    int nb_buf;
+    int framenum = 0;
+
+    decoder = mpeg2_init ();
+    if (decoder == NULL) {
+	fprintf (stderr, "Could not allocate a decoder object.\n");
+	exit (1);
+    }
+
+    do {
+	for (nb_buf = 0; nb_buf < MAX_BUFFERS; nb_buf++) {
+	    size = fread (buffer[nb_buf], 1, BUFFER_SIZE, mpgfile);
+	    if (!size)
+		break;
+	    batch[nb_buf].start = buffer[nb_buf];
+	    batch[nb_buf].end = buffer[nb_buf] + size;
+	    batch[nb_buf].tagged = 0;
+	}
+	if (mpeg2_decode_batch (decoder, batch, nb_buf,
+				mpeg2convert_rgb24, NULL,
+				save_ppm, &framenum))
+	    break;
+    } while (nb_buf == MAX_BUFFERS);
+
+    mpeg2_close (decoder);
+}
+
+int main (int argc, char ** argv)
+{
+    FILE * mpgfile;
+
+    if (argc > 1) {
+	mpgfile = fopen (argv[1], "rb");
+	if (!mpgfile) {
+	    fprintf (stderr, "Could not open file \"%s\".\n", argv[1]);
+	    exit (1);
+	}
+    } else
+	mpgfile = stdin;
+
+    sample7 (mpgfile);
+
+    return 0;
+}
@@ -83,6 +83,8 @@ typedef struct mpeg2_gop_s {
 #define PIC_FLAG_SKIP 64
 #define PIC_FLAG_TAGS 128
 #define PIC_FLAG_REPEAT_FIRST_FIELD 256
+#define PIC_FLAG_INTRA_ONLY 512
+#define PIC_FLAG_DEGRADED 1024
 #define PIC_MASK_COMPOSITE_DISPLAY 0xfffff000
 
 typedef struct mpeg2_picture_s {
@@ -95,6 +97,28 @@ typedef struct mpeg2_picture_s {
     } display_offset[3];
 } mpeg2_picture_t;
 
+#define MB_FLAG_INTRA 1
+#define MB_FLAG_PATTERN 2
+#define MB_FLAG_MOTION_BACKWARD 4
+#define MB_FLAG_MOTION_FORWARD 8
+#define MB_FLAG_QUANT 16
+#define MB_FLAG_DCT_INTERLACED 32
+#define MB_FLAG_SKIPPED 64
+
+#define MB_MOTION_FIELD 1
+#define MB_MOTION_FRAME 2
+#define MB_MOTION_16X8 2
+#define MB_MOTION_DMV 3
+
+typedef struct mpeg2_macroblock_s {
+    uint8_t flags;
+    uint8_t motion_type;
+    uint8_t quantizer_scale;
+    uint8_t dc;
+    uint16_t coded_block_pattern;
+    int16_t mv[2][2][2];
+} mpeg2_macroblock_t;
+
 typedef struct mpeg2_fbuf_s {
     uint8_t * buf[3];
     void * id;
@@ -112,10 +136,12 @@ typedef struct mpeg2_info_s {
     const mpeg2_fbuf_t * discard_fbuf;
     const uint8_t * user_data;
     unsigned int user_data_len;
+    const mpeg2_macroblock_t * macroblocks;
 } mpeg2_info_t;
 
 typedef struct mpeg2dec_s mpeg2dec_t;
 typedef struct mpeg2_decoder_s mpeg2_decoder_t;
+typedef struct mpeg2_transrate_s mpeg2_transrate_t;
 
 typedef enum {
     STATE_BUFFER = 0,
@@ -178,9 +204,64 @@ mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec);
 void mpeg2_reset (mpeg2dec_t * mpeg2dec, int full_reset);
 void mpeg2_skip (mpeg2dec_t * mpeg2dec, int skip);
 void mpeg2_slice_region (mpeg2dec_t * mpeg2dec, int start, int end);
+int mpeg2_two_pass (mpeg2dec_t * mpeg2dec, int enable);
+void mpeg2_macroblock_info (mpeg2dec_t * mpeg2dec, int enable);
+void mpeg2_low_latency (mpeg2dec_t * mpeg2dec, int enable);
+void mpeg2_compact (mpeg2dec_t * mpeg2dec, int enable);
+void mpeg2_intra_fbufs (mpeg2dec_t * mpeg2dec, int enable);
 
 void mpeg2_tag_picture (mpeg2dec_t * mpeg2dec, uint32_t tag, uint32_t tag2);
 
+typedef void mpeg2_frame_ready_t (void * arg, const mpeg2_fbuf_t * fbuf,
+				  const mpeg2_picture_t * picture,
+				  const mpeg2_picture_t * picture_2nd);
+void mpeg2_frame_callback (mpeg2dec_t * mpeg2dec,
+			   mpeg2_frame_ready_t * callback, void * arg);
+
+typedef void mpeg2_field_ready_t (void * arg, const mpeg2_fbuf_t * fbuf,
+				  const mpeg2_picture_t * picture,
+				  int bottom_field);
+void mpeg2_field_callback (mpeg2dec_t * mpeg2dec,
+			   mpeg2_field_ready_t * callback, void * arg);
+
+typedef void mpeg2_row_ready_t (void * arg, const mpeg2_fbuf_t * fbuf,
+				unsigned int lines);
+void mpeg2_row_callback (mpeg2dec_t * mpeg2dec,
+			 mpeg2_row_ready_t * callback, void * arg);
+
+typedef int mpeg2_late_t (void * arg, const mpeg2_picture_t * picture);
+void mpeg2_deadline (mpeg2dec_t * mpeg2dec, mpeg2_late_t * late, void * arg);
+
+typedef struct mpeg2_batch_buf_s {
+    uint8_t * start;
+    uint8_t * end;
+    int tagged;
+    uint32_t tag, tag2;
+} mpeg2_batch_buf_t;
+typedef int mpeg2_frame_t (void * arg, const mpeg2_info_t * info);
+int mpeg2_decode_batch (mpeg2dec_t * mpeg2dec,
+			const mpeg2_batch_buf_t * buf, int nb_buf,
+			mpeg2_convert_t convert, void * convert_arg,
+			mpeg2_frame_t frame, void * frame_arg);
+typedef int mpeg2_user_data_t (void * arg, const mpeg2_picture_t * picture,
+			       const uint8_t * data, unsigned int len);
+int mpeg2_extract_user_data (mpeg2dec_t * mpeg2dec,
+			     const mpeg2_batch_buf_t * buf, int nb_buf,
+			     mpeg2_user_data_t user_data, void * arg);
+
+typedef struct mpeg2_range_s {
+    uint8_t * sequence;
+    uint8_t * sequence_end;
+    uint8_t * preroll;
+    uint8_t * start;
+    uint8_t * end;
+} mpeg2_range_t;
+int mpeg2_find_ranges (uint8_t * start, uint8_t * end, unsigned int gops,
+		       mpeg2_range_t * ranges, int nb_ranges);
+int mpeg2_decode_range (mpeg2dec_t * mpeg2dec, const mpeg2_range_t * range,
+			mpeg2_convert_t convert, void * convert_arg,
+			mpeg2_frame_t frame, void * frame_arg);
+
 void mpeg2_init_fbuf (mpeg2_decoder_t * decoder, uint8_t * current_fbuf[3],
 		      uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3]);
 void mpeg2_slice (mpeg2_decoder_t * decoder, int code, const uint8_t * buffer);
@@ -188,6 +269,14 @@ int mpeg2_guess_aspect (const mpeg2_sequence_t * sequence,
 			unsigned int * pixel_width,
 			unsigned int * pixel_height);
 
+typedef int mpeg2_write_t (void * arg, const uint8_t * data, unsigned int len);
+mpeg2_transrate_t * mpeg2_transrate_init (unsigned int bitrate);
+int mpeg2_transrate (mpeg2_transrate_t * transrate, const uint8_t * start,
+		     const uint8_t * end, mpeg2_write_t * callback, void * arg);
+int mpeg2_transrate_flush (mpeg2_transrate_t * transrate,
+			   mpeg2_write_t * callback, void * arg);
+void mpeg2_transrate_close (mpeg2_transrate_t * transrate);
+
 typedef enum {
     MPEG2_ALLOC_MPEG2DEC = 0,
     MPEG2_ALLOC_CHUNK = 1,
@@ -201,4 +290,14 @@ void mpeg2_free (void * buf);
 void mpeg2_malloc_hooks (void * malloc (unsigned, mpeg2_alloc_t),
 			 int free (void *));
 
+typedef struct mpeg2_alloc_stats_s {
+    unsigned int bytes;
+    unsigned int peak_bytes;
+    unsigned int buffers;
+    unsigned int peak_buffers;
+} mpeg2_alloc_stats_t;
+
+void mpeg2_alloc_stats (mpeg2dec_t * mpeg2dec, mpeg2_alloc_stats_t * total,
+			mpeg2_alloc_stats_t * by_reason);
+
 #endif /* LIBMPEG2_MPEG2_H */
@@ -0,0 +1,71 @@
+/*
+ * mpeg2demux.h
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef LIBMPEG2_MPEG2DEMUX_H
+#define LIBMPEG2_MPEG2DEMUX_H
+
+typedef struct mpeg2demux_s mpeg2demux_t;
+
+typedef enum {
+    MPEG2DEMUX_PS = 0,
+    MPEG2DEMUX_TS = 1,
+    MPEG2DEMUX_PVA = 2
+} mpeg2demux_format_t;
+
+typedef enum {
+    MPEG2DEMUX_BUFFER = 0,
+    MPEG2DEMUX_PAYLOAD = 1,
+    MPEG2DEMUX_END = 2,
+    MPEG2DEMUX_ERROR = 3
+} mpeg2demux_state_t;
+
+typedef enum {
+    MPEG2DEMUX_ERROR_NONE = 0,
+    MPEG2DEMUX_ERROR_SYNC = 1,
+    MPEG2DEMUX_ERROR_PACK = 2,
+    MPEG2DEMUX_ERROR_STUFFING = 3,
+    MPEG2DEMUX_ERROR_ES = 4,
+    MPEG2DEMUX_ERROR_STREAM_ID = 5
+} mpeg2demux_error_t;
+
+typedef struct mpeg2demux_info_s {
+    uint8_t * buf;
+    uint8_t * end;
+    int tagged;
+    uint32_t pts, dts;
+    int stream;
+    int program;
+    mpeg2demux_error_t error;
+} mpeg2demux_info_t;
+
+mpeg2demux_t * mpeg2demux_init (mpeg2demux_format_t format, int stream);
+const mpeg2demux_info_t * mpeg2demux_info (mpeg2demux_t * demux);
+void mpeg2demux_close (mpeg2demux_t * demux);
+/* describes the error just returned, until the next mpeg2demux_parse () */
+const char * mpeg2demux_error_string (mpeg2demux_t * demux);
+
+void mpeg2demux_buffer (mpeg2demux_t * demux, uint8_t * start, uint8_t * end);
+mpeg2demux_state_t mpeg2demux_parse (mpeg2demux_t * demux);
+
+#endif /* LIBMPEG2_MPEG2DEMUX_H */
@@ -60,4 +60,7 @@ void vo_accel (uint32_t accel);
 /* return NULL terminated array of all drivers */
 vo_driver_t const * vo_drivers (void);
 
+/* prefix the frame names of the pgm and md5 outputs */
+void vo_name_frames (vo_instance_t * instance, const char * prefix);
+
 #endif /* LIBMPEG2_VIDEO_OUT_H */
@@ -21,45 +21,147 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include "config.h"
+
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include "mpeg2.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
 
 static void * (* malloc_hook) (unsigned size, mpeg2_alloc_t reason) = NULL;
 static int (* free_hook) (void * buf) = NULL;
 
-void * mpeg2_malloc (unsigned size, mpeg2_alloc_t reason)
+/*
+ * Every buffer counts in the global statistics for its reason, and in
+ * the ones of the decoder it was allocated for. A decoder's own
+ * counters are plain integers, so a decoder must only be used by one
+ * thread at a time; the global ones are shared and updated atomically.
+ */
+static mpeg2_alloc_stats_t global_stats[MPEG2_ALLOC_TOTAL + 1];
+
+/* stored just before each buffer mpeg2_malloc gets from malloc () */
+typedef struct {
+    void * buf;				/* as returned by malloc () */
+    mpeg2_alloc_stats_t * stats;	/* of its decoder, or NULL */
+    unsigned int size;
+    int reason;
+} alloc_header_t;
+
+#if defined (__GNUC__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+static void add_peak (unsigned int * count, unsigned int * peak, int delta)
+{
+    unsigned int current, old;
+
+    current = __sync_add_and_fetch (count, delta);
+    while ((old = *peak) < current &&
+	   !__sync_bool_compare_and_swap (peak, old, current));
+}
+#else
+/* no atomic operations, the global counts are only right with one thread */
+static void add_peak (unsigned int * count, unsigned int * peak, int delta)
+{
+    *count += delta;
+    if (*peak < *count)
+	*peak = *count;
+}
+#endif
+
+static void account (mpeg2_alloc_stats_t * stats, int bytes, int buffers)
+{
+    stats->bytes += bytes;
+    if (stats->peak_bytes < stats->bytes)
+	stats->peak_bytes = stats->bytes;
+    stats->buffers += buffers;
+    if (stats->peak_buffers < stats->buffers)
+	stats->peak_buffers = stats->buffers;
+}
+
+static void global_account (mpeg2_alloc_stats_t * stats,
+			    int bytes, int buffers)
+{
+    add_peak (&(stats->bytes), &(stats->peak_bytes), bytes);
+    add_peak (&(stats->buffers), &(stats->peak_buffers), buffers);
+}
+
+/* buffers allocated with an out of range reason are not counted */
+static void header_account (alloc_header_t * header, int sign)
+{
+    int bytes = sign * (int) header->size;
+
+    if (header->reason < 0 || header->reason >= MPEG2_ALLOC_TOTAL)
+	return;
+    if (header->stats != NULL) {
+	account (header->stats + header->reason, bytes, sign);
+	account (header->stats + MPEG2_ALLOC_TOTAL, bytes, sign);
+    }
+    global_account (global_stats + header->reason, bytes, sign);
+    global_account (global_stats + MPEG2_ALLOC_TOTAL, bytes, sign);
+}
+
+void * mpeg2_malloc_dec (mpeg2dec_t * mpeg2dec, unsigned size,
+			 mpeg2_alloc_t reason)
 {
     char * buf;
+    alloc_header_t * header;
 
     if (malloc_hook) {
 	buf = (char *) malloc_hook (size, reason);
-	if (buf)
+	if (buf == NULL)
+	    ;
+	else if (free_hook)
+	    /* the application keeps track of it */
+	    return buf;
+	else {
+	    /* mpeg2_free will free it as ours, so it came from us */
+	    header = ((alloc_header_t *) buf) - 1;
+	    header_account (header, -1);
+	    header->stats = mpeg2dec ? mpeg2dec->alloc_stats : NULL;
+	    header->reason = reason;
+	    header_account (header, 1);
 	    return buf;
+	}
     }
 
     if (size) {
-	buf = (char *) malloc (size + 63 + sizeof (void **));
+	buf = (char *) malloc (size + 63 + sizeof (alloc_header_t));
 	if (buf) {
 	    char * align_buf;
 
-	    align_buf = buf + 63 + sizeof (void **);
+	    align_buf = buf + 63 + sizeof (alloc_header_t);
 	    align_buf -= (long)align_buf & 63;
-	    *(((void **)align_buf) - 1) = buf;
+	    header = ((alloc_header_t *) align_buf) - 1;
+	    header->buf = buf;
+	    header->stats = mpeg2dec ? mpeg2dec->alloc_stats : NULL;
+	    header->size = size;
+	    header->reason = reason;
+	    header_account (header, 1);
 	    return align_buf;
 	}
     }
     return NULL;
 }
 
+void * mpeg2_malloc (unsigned size, mpeg2_alloc_t reason)
+{
+    return mpeg2_malloc_dec (NULL, size, reason);
+}
+
 void mpeg2_free (void * buf)
 {
+    alloc_header_t * header;
+
     if (free_hook && free_hook (buf))
 	return;
 
-    if (buf)
-	free (*(((void **)buf) - 1));
+    if (buf) {
+	header = ((alloc_header_t *) buf) - 1;
+	header_account (header, -1);
+	free (header->buf);
+    }
 }
 
 void mpeg2_malloc_hooks (void * alloc_func (unsigned, mpeg2_alloc_t),
@@ -68,3 +170,31 @@ void mpeg2_malloc_hooks (void * alloc_func (unsigned, mpeg2_alloc_t),
     malloc_hook = alloc_func;
     free_hook = free_func;
 }
+
+/* the decoder itself was allocated before its counters, and lives on */
+static void add_decoder (mpeg2_alloc_stats_t * stats)
+{
+    stats->bytes += sizeof (mpeg2dec_t);
+    stats->peak_bytes += sizeof (mpeg2dec_t);
+    stats->buffers++;
+    stats->peak_buffers++;
+}
+
+void mpeg2_alloc_stats (mpeg2dec_t * mpeg2dec, mpeg2_alloc_stats_t * total,
+			mpeg2_alloc_stats_t * by_reason)
+{
+    mpeg2_alloc_stats_t stats[MPEG2_ALLOC_TOTAL + 1];
+    int i;
+
+    if (mpeg2dec != NULL) {
+	memcpy (stats, mpeg2dec->alloc_stats, sizeof (stats));
+	add_decoder (stats + MPEG2_ALLOC_MPEG2DEC);
+	add_decoder (stats + MPEG2_ALLOC_TOTAL);
+    } else
+	memcpy (stats, global_stats, sizeof (stats));
+    if (total != NULL)
+	*total = stats[MPEG2_ALLOC_TOTAL];
+    if (by_reason != NULL)
+	for (i = 0; i < MPEG2_ALLOC_TOTAL; i++)
+	    by_reason[i] = stats[i];
+}
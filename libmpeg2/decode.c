@@ -34,6 +34,7 @@
 static int mpeg2_accels = 0;
 
 #define BUFFER_SIZE (1194 * 1024)
+#define COMPACT_BUFFER_SIZE (16 * 1024)
 
 const mpeg2_info_t * mpeg2_info (mpeg2dec_t * mpeg2dec)
 {
@@ -54,22 +55,40 @@ static inline int skip_chunk (mpeg2dec_t * mpeg2dec, int bytes)
     shift = mpeg2dec->shift;
     limit = current + bytes;
 
+    /* the first bytes may complete a start code from the last buffer */
     do {
 	byte = *current++;
-	if (shift == 0x00000100) {
-	    int skipped;
-
-	    mpeg2dec->shift = 0xffffff00;
-	    skipped = current - mpeg2dec->buf_start;
-	    mpeg2dec->buf_start = current;
-	    return skipped;
-	}
+	if (shift == 0x00000100)
+	    goto found;
 	shift = (shift | byte) << 8;
-    } while (current < limit);
+    } while (current < limit && current < mpeg2dec->buf_start + 3);
+
+    /* then look for the 0x01 of 00 00 01, stepping 3 bytes at a time */
+    current--;
+    while (current < limit - 1)
+	if (current[0] > 1)
+	    current += 3;
+	else if (current[0] == 0)
+	    current++;
+	else if (current[-1] | current[-2])
+	    current += 3;
+	else {
+	    current += 2;
+	    goto found;
+	}
+    if (limit - mpeg2dec->buf_start >= 3)
+	shift = (((uint32_t) limit[-3] << 24) | (limit[-2] << 16) |
+		 (limit[-1] << 8));
 
     mpeg2dec->shift = shift;
-    mpeg2dec->buf_start = current;
+    mpeg2dec->buf_start = limit;
     return 0;
+
+ found:
+    mpeg2dec->shift = 0xffffff00;
+    bytes = current - mpeg2dec->buf_start;
+    mpeg2dec->buf_start = current;
+    return bytes;
 }
 
 static inline int copy_chunk (mpeg2dec_t * mpeg2dec, int bytes)
@@ -108,6 +127,59 @@ static inline int copy_chunk (mpeg2dec_t * mpeg2dec, int bytes)
     return 0;
 }
 
+static int resize_chunk (mpeg2dec_t * mpeg2dec, unsigned int size)
+{
+    uint8_t * buffer;
+
+    buffer = (uint8_t *) mpeg2_malloc_dec (mpeg2dec, size + 4,
+					   MPEG2_ALLOC_CHUNK);
+    if (buffer == NULL)
+	return -1;
+    if (mpeg2dec->chunk_buffer == NULL) {
+	mpeg2dec->chunk_start = mpeg2dec->chunk_ptr = buffer;
+    } else {
+	memcpy (buffer, mpeg2dec->chunk_buffer,
+		mpeg2dec->chunk_ptr - mpeg2dec->chunk_buffer);
+	mpeg2dec->chunk_start =
+	    buffer + (mpeg2dec->chunk_start - mpeg2dec->chunk_buffer);
+	mpeg2dec->chunk_ptr =
+	    buffer + (mpeg2dec->chunk_ptr - mpeg2dec->chunk_buffer);
+	mpeg2_free (mpeg2dec->chunk_buffer);
+    }
+    mpeg2dec->chunk_buffer = buffer;
+    mpeg2dec->chunk_size = size;
+    return 0;
+}
+
+/*
+ * The chunk buffer is allocated when the first chunk arrives. In
+ * compact mode it starts small and doubles each time a chunk fills
+ * it, up to the vbv buffer size of the sequence: no slice of a
+ * conforming stream can be larger than that.
+ */
+static int grow_chunk (mpeg2dec_t * mpeg2dec)
+{
+    uint8_t * chunk_ptr = mpeg2dec->chunk_ptr;
+    unsigned int size, limit;
+
+    if (mpeg2dec->chunk_buffer == NULL)
+	return !resize_chunk (mpeg2dec, (mpeg2dec->compact ?
+					 COMPACT_BUFFER_SIZE : BUFFER_SIZE));
+    limit = mpeg2dec->sequence.vbv_buffer_size;
+    if (!mpeg2dec->compact || mpeg2dec->sequence.width == (unsigned)-1 ||
+	!limit || limit > BUFFER_SIZE)
+	limit = BUFFER_SIZE;
+    size = 2 * mpeg2dec->chunk_size;
+    if (size > limit)
+	size = limit;
+    /* the chunk fills the whole buffer */
+    mpeg2dec->chunk_ptr = mpeg2dec->chunk_buffer + mpeg2dec->chunk_size;
+    if (size > mpeg2dec->chunk_size && !resize_chunk (mpeg2dec, size))
+	return 1;
+    mpeg2dec->chunk_ptr = chunk_ptr;
+    return 0;
+}
+
 void mpeg2_buffer (mpeg2dec_t * mpeg2dec, uint8_t * start, uint8_t * end)
 {
     mpeg2dec->buf_start = start;
@@ -147,6 +219,76 @@ mpeg2_state_t mpeg2_seek_header (mpeg2dec_t * mpeg2dec)
 	    mpeg2_header_end (mpeg2dec) : mpeg2_parse_header (mpeg2dec));
 }
 
+/*
+ * In low latency mode, a slice of the last macroblock row is decoded
+ * each time the input runs out, without waiting for the start code
+ * that terminates it. The attempt counts only if the slice completed
+ * the picture using data that has actually been received; anything it
+ * wrote otherwise is written again once the whole slice is there.
+ */
+static int picture_complete (mpeg2dec_t * mpeg2dec)
+{
+    mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
+    uint8_t * end = mpeg2dec->chunk_ptr;
+    mpeg2_row_ready_t * row_ready = decoder->row_ready;
+
+    if ((mpeg2dec->state != STATE_SLICE &&
+	 mpeg2dec->state != STATE_SLICE_1ST) ||
+	decoder->vertical_position_extension ||
+	(unsigned) (mpeg2dec->code - 1) * 16 != decoder->limit_y)
+	return 0;
+    end[0] = end[1] = end[2] = end[3] = 0;
+    decoder->picture_end = NULL;
+    decoder->row_ready = NULL;
+    mpeg2_slice (decoder, mpeg2dec->code, mpeg2dec->chunk_start);
+    decoder->row_ready = row_ready;
+    if (decoder->picture_end == NULL || decoder->picture_end > end)
+	return 0;
+    /* the last row is only reported once it is known to be right */
+    if (row_ready)
+	row_ready (decoder->row_ready_arg, decoder->row_fbuf,
+		   decoder->v_offset <<
+		   (decoder->picture_structure != FRAME_PICTURE));
+    return 1;
+}
+
+/* the frame being displayed is complete, or only its first field */
+static void slices_done (mpeg2dec_t * mpeg2dec)
+{
+    if (!mpeg2dec->frame_pending)
+	return;
+    if (mpeg2dec->state == STATE_SLICE)
+	mpeg2_display_ready (mpeg2dec);
+    else
+	mpeg2_first_field_ready (mpeg2dec);
+}
+
+/*
+ * A B picture found late is not decoded further: its remaining rows in
+ * the slice region are concealed, and the rest of its slices skipped.
+ */
+static int picture_late (mpeg2dec_t * mpeg2dec)
+{
+    if (mpeg2dec->decoder.coding_type != B_TYPE ||
+	!mpeg2dec->late (mpeg2dec->late_arg, mpeg2dec->picture))
+	return 0;
+    mpeg2dec->picture->flags |= PIC_FLAG_DEGRADED;
+    mpeg2_conceal (&(mpeg2dec->decoder), mpeg2dec->code,
+		   mpeg2dec->first_decode_slice + mpeg2dec->nb_decode_slices);
+    mpeg2dec->late_decode_slices = mpeg2dec->nb_decode_slices;
+    mpeg2dec->nb_decode_slices = 0;
+    return 1;
+}
+
+static mpeg2_state_t seek_picture_end (mpeg2dec_t * mpeg2dec)
+{
+    /* the picture was already reported, drop the rest of its last slice */
+    if (seek_chunk (mpeg2dec) == STATE_BUFFER)
+	return STATE_BUFFER;
+    mpeg2dec->action = mpeg2_seek_header;
+    return mpeg2_seek_header (mpeg2dec);
+}
+
 #define RECEIVED(code,state) (((state) << 8) + (code))
 
 mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec)
@@ -165,13 +307,19 @@ mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec)
 	while ((unsigned) (mpeg2dec->code - mpeg2dec->first_decode_slice) <
 	       mpeg2dec->nb_decode_slices) {
 	    size_buffer = mpeg2dec->buf_end - mpeg2dec->buf_start;
-	    size_chunk = (mpeg2dec->chunk_buffer + BUFFER_SIZE -
+	    size_chunk = (mpeg2dec->chunk_buffer + mpeg2dec->chunk_size -
 			  mpeg2dec->chunk_ptr);
 	    if (size_buffer <= size_chunk) {
 		copied = copy_chunk (mpeg2dec, size_buffer);
 		if (!copied) {
 		    mpeg2dec->bytes_since_tag += size_buffer;
 		    mpeg2dec->chunk_ptr += size_buffer;
+		    if (mpeg2dec->low_latency && picture_complete (mpeg2dec)) {
+			mpeg2dec->chunk_ptr = mpeg2dec->chunk_start;
+			mpeg2dec->action = seek_picture_end;
+			slices_done (mpeg2dec);
+			return mpeg2dec->state;
+		    }
 		    return STATE_BUFFER;
 		}
 	    } else {
@@ -179,14 +327,17 @@ mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec)
 		if (!copied) {
 		    /* filled the chunk buffer without finding a start code */
 		    mpeg2dec->bytes_since_tag += size_chunk;
+		    if (grow_chunk (mpeg2dec))
+			continue;
 		    mpeg2dec->action = seek_chunk;
 		    return STATE_INVALID;
 		}
 	    }
 	    mpeg2dec->bytes_since_tag += copied;
 
-	    mpeg2_slice (&(mpeg2dec->decoder), mpeg2dec->code,
-			 mpeg2dec->chunk_start);
+	    if (mpeg2dec->late == NULL || !picture_late (mpeg2dec))
+		mpeg2_slice (&(mpeg2dec->decoder), mpeg2dec->code,
+			     mpeg2dec->chunk_start);
 	    mpeg2dec->code = mpeg2dec->buf_start[-1];
 	    mpeg2dec->chunk_ptr = mpeg2dec->chunk_start;
 	}
@@ -196,14 +347,23 @@ mpeg2_state_t mpeg2_parse (mpeg2dec_t * mpeg2dec)
 	    return STATE_BUFFER;
     }
 
+    if (mpeg2dec->late_decode_slices) {
+	mpeg2dec->nb_decode_slices = mpeg2dec->late_decode_slices;
+	mpeg2dec->late_decode_slices = 0;
+    }
     mpeg2dec->action = mpeg2_seek_header;
     switch (mpeg2dec->code) {
     case 0x00:
+	slices_done (mpeg2dec);
 	return mpeg2dec->state;
     case 0xb3:
     case 0xb7:
     case 0xb8:
-	return (mpeg2dec->state == STATE_SLICE) ? STATE_SLICE : STATE_INVALID;
+	if (mpeg2dec->state != STATE_SLICE)
+	    return STATE_INVALID;
+	if (mpeg2dec->frame_pending)
+	    mpeg2_display_ready (mpeg2dec);
+	return STATE_SLICE;
     default:
 	mpeg2dec->action = seek_chunk;
 	return STATE_INVALID;
@@ -222,7 +382,7 @@ mpeg2_state_t mpeg2_parse_header (mpeg2dec_t * mpeg2dec)
     mpeg2dec->info.user_data = NULL;	mpeg2dec->info.user_data_len = 0;
     while (1) {
 	size_buffer = mpeg2dec->buf_end - mpeg2dec->buf_start;
-	size_chunk = (mpeg2dec->chunk_buffer + BUFFER_SIZE -
+	size_chunk = (mpeg2dec->chunk_buffer + mpeg2dec->chunk_size -
 		      mpeg2dec->chunk_ptr);
 	if (size_buffer <= size_chunk) {
 	    copied = copy_chunk (mpeg2dec, size_buffer);
@@ -236,6 +396,8 @@ mpeg2_state_t mpeg2_parse_header (mpeg2dec_t * mpeg2dec)
 	    if (!copied) {
 		/* filled the chunk buffer without finding a start code */
 		mpeg2dec->bytes_since_tag += size_chunk;
+		if (grow_chunk (mpeg2dec))
+		    continue;
 		mpeg2dec->code = 0xb4;
 		mpeg2dec->action = mpeg2_seek_header;
 		return STATE_INVALID;
@@ -354,6 +516,7 @@ void mpeg2_custom_fbuf (mpeg2dec_t * mpeg2dec, int custom_fbuf)
 
 void mpeg2_skip (mpeg2dec_t * mpeg2dec, int skip)
 {
+    mpeg2dec->late_decode_slices = 0;
     mpeg2dec->first_decode_slice = 1;
     mpeg2dec->nb_decode_slices = skip ? 0 : (0xb0 - 1);
 }
@@ -362,10 +525,67 @@ void mpeg2_slice_region (mpeg2dec_t * mpeg2dec, int start, int end)
 {
     start = (start < 1) ? 1 : (start > 0xb0) ? 0xb0 : start;
     end = (end < start) ? start : (end > 0xb0) ? 0xb0 : end;
+    mpeg2dec->late_decode_slices = 0;
     mpeg2dec->first_decode_slice = start;
     mpeg2dec->nb_decode_slices = end - start;
 }
 
+int mpeg2_two_pass (mpeg2dec_t * mpeg2dec, int enable)
+{
+    mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
+
+    /* takes effect at the next picture, the queue is kept until close */
+    if (enable && decoder->recon == NULL) {
+	decoder->recon = (recon_t *)
+	    mpeg2_malloc_dec (mpeg2dec, sizeof (recon_t), MPEG2_ALLOC_MPEG2DEC);
+	if (decoder->recon == NULL)
+	    return -1;
+	decoder->recon->ops = decoder->recon->coefs = 0;
+    }
+    decoder->two_pass = enable;
+    return 0;
+}
+
+void mpeg2_macroblock_info (mpeg2dec_t * mpeg2dec, int enable)
+{
+    /* takes effect at the next picture, the buffer is kept until close */
+    mpeg2dec->macroblock_info = enable;
+}
+
+void mpeg2_low_latency (mpeg2dec_t * mpeg2dec, int enable)
+{
+    /* 2 also drops reordering, it only changes when nothing is pending */
+    mpeg2dec->low_latency = enable;
+}
+
+void mpeg2_frame_callback (mpeg2dec_t * mpeg2dec,
+			   mpeg2_frame_ready_t * callback, void * arg)
+{
+    mpeg2dec->frame_ready = callback;
+    mpeg2dec->frame_ready_arg = arg;
+}
+
+void mpeg2_field_callback (mpeg2dec_t * mpeg2dec,
+			   mpeg2_field_ready_t * callback, void * arg)
+{
+    mpeg2dec->field_ready = callback;
+    mpeg2dec->field_ready_arg = arg;
+}
+
+void mpeg2_row_callback (mpeg2dec_t * mpeg2dec,
+			 mpeg2_row_ready_t * callback, void * arg)
+{
+    /* takes effect at the next picture */
+    mpeg2dec->row_ready = callback;
+    mpeg2dec->row_ready_arg = arg;
+}
+
+void mpeg2_deadline (mpeg2dec_t * mpeg2dec, mpeg2_late_t * late, void * arg)
+{
+    mpeg2dec->late = late;
+    mpeg2dec->late_arg = arg;
+}
+
 void mpeg2_tag_picture (mpeg2dec_t * mpeg2dec, uint32_t tag, uint32_t tag2)
 {
     mpeg2dec->tag_previous = mpeg2dec->tag_current;
@@ -376,6 +596,300 @@ void mpeg2_tag_picture (mpeg2dec_t * mpeg2dec, uint32_t tag, uint32_t tag2)
     mpeg2dec->bytes_since_tag = 0;
 }
 
+int mpeg2_decode_batch (mpeg2dec_t * mpeg2dec,
+			const mpeg2_batch_buf_t * buf, int nb_buf,
+			mpeg2_convert_t convert, void * convert_arg,
+			mpeg2_frame_t frame, void * frame_arg)
+{
+    const mpeg2_info_t * info;
+    mpeg2_state_t state;
+    int result;
+
+    info = &(mpeg2dec->info);
+    for (; nb_buf > 0; buf++, nb_buf--) {
+	if (buf->tagged)
+	    mpeg2_tag_picture (mpeg2dec, buf->tag, buf->tag2);
+	mpeg2_buffer (mpeg2dec, buf->start, buf->end);
+	while ((state = mpeg2_parse (mpeg2dec)) != STATE_BUFFER)
+	    switch (state) {
+	    case STATE_SEQUENCE:
+		if (convert != NULL &&
+		    mpeg2_convert (mpeg2dec, convert, convert_arg))
+		    return -1;
+		mpeg2_skip (mpeg2dec, frame == NULL);
+		break;
+	    case STATE_SLICE:
+	    case STATE_END:
+	    case STATE_INVALID_END:
+		if (frame != NULL && info->display_fbuf) {
+		    result = frame (frame_arg, info);
+		    if (result)
+			return result;
+		}
+		break;
+	    default:
+		break;
+	    }
+    }
+    return 0;
+}
+
+static int keep_user_data (mpeg2dec_t * mpeg2dec, int i,
+			   const uint8_t * data, unsigned int len)
+{
+    unsigned int size;
+    uint8_t * buf;
+
+    if (!len)
+	return 0;
+    size = mpeg2dec->picture_user_data_len[i] + len;
+    if (size > mpeg2dec->picture_user_data_size[i]) {
+	buf = (uint8_t *) mpeg2_malloc_dec (mpeg2dec, size,
+					    MPEG2_ALLOC_MPEG2DEC);
+	if (buf == NULL)
+	    return -1;
+	if (mpeg2dec->picture_user_data_len[i])
+	    memcpy (buf, mpeg2dec->picture_user_data[i],
+		    mpeg2dec->picture_user_data_len[i]);
+	mpeg2_free (mpeg2dec->picture_user_data[i]);
+	mpeg2dec->picture_user_data[i] = buf;
+	mpeg2dec->picture_user_data_size[i] = size;
+    }
+    memcpy (mpeg2dec->picture_user_data[i] +
+	    mpeg2dec->picture_user_data_len[i], data, len);
+    mpeg2dec->picture_user_data_len[i] = size;
+    return 0;
+}
+
+int mpeg2_extract_user_data (mpeg2dec_t * mpeg2dec,
+			     const mpeg2_batch_buf_t * buf, int nb_buf,
+			     mpeg2_user_data_t user_data, void * arg)
+{
+    const mpeg2_info_t * info;
+    static const uint8_t start_code[] = {0, 0, 1};
+    mpeg2_state_t state;
+    int i, j, result;
+
+    info = &(mpeg2dec->info);
+    mpeg2_skip (mpeg2dec, 1);
+    for (; nb_buf > 0; buf++, nb_buf--) {
+	if (buf->tagged)
+	    mpeg2_tag_picture (mpeg2dec, buf->tag, buf->tag2);
+	mpeg2_buffer (mpeg2dec, buf->start, buf->end);
+	while ((state = mpeg2_parse (mpeg2dec)) != STATE_BUFFER)
+	    switch (state) {
+	    case STATE_SEQUENCE:
+		mpeg2_skip (mpeg2dec, 1);
+		break;
+	    case STATE_PICTURE:
+	    case STATE_PICTURE_2ND:
+		i = ((state == STATE_PICTURE) ? info->current_picture :
+		     info->current_picture_2nd) - mpeg2dec->pictures;
+		mpeg2dec->picture_user_data_len[i] = 0;
+		if (keep_user_data (mpeg2dec, i, info->user_data,
+				    info->user_data_len))
+		    return -1;
+		break;
+	    case STATE_SLICE:
+	    case STATE_END:
+	    case STATE_INVALID_END:
+		if (info->display_picture == NULL)
+		    break;
+		/* a field pair is reported once, with both user data */
+		i = info->display_picture - mpeg2dec->pictures;
+		if (info->display_picture_2nd != NULL) {
+		    j = info->display_picture_2nd - mpeg2dec->pictures;
+		    if (mpeg2dec->picture_user_data_len[i] &&
+			mpeg2dec->picture_user_data_len[j] &&
+			keep_user_data (mpeg2dec, i, start_code, 3))
+			return -1;
+		    if (keep_user_data (mpeg2dec, i,
+					mpeg2dec->picture_user_data[j],
+					mpeg2dec->picture_user_data_len[j]))
+			return -1;
+		    mpeg2dec->picture_user_data_len[j] = 0;
+		}
+		result = user_data (arg, info->display_picture,
+				    mpeg2dec->picture_user_data[i],
+				    mpeg2dec->picture_user_data_len[i]);
+		mpeg2dec->picture_user_data_len[i] = 0;
+		if (result)
+		    return result;
+		break;
+	    default:
+		break;
+	    }
+    }
+    return 0;
+}
+
+/*
+ * A range starts at an I frame picture or a pair of I field pictures,
+ * or at the sequence and gop headers right in front of it (the second
+ * field of an I and P pair may be predicted from the previous frame).
+ * Unless its gop is closed, the B pictures that follow it in the stream
+ * may be predicted from the previous range, which then has to be
+ * decoded again (the preroll) before the range itself.
+ */
+int mpeg2_find_ranges (uint8_t * start, uint8_t * end, unsigned int gops,
+		       mpeg2_range_t * ranges, int nb_ranges)
+{
+    uint8_t * p;
+    uint8_t * head;
+    uint8_t * sequence, * sequence_end;
+    mpeg2_range_t next, last;
+    mpeg2_range_t * range;
+    unsigned int boundaries;
+    int closed, gop_closed, second, fields, pair, count;
+
+    if (start >= end)
+	return 0;
+    if (!gops)
+	gops = 1;
+    head = sequence = sequence_end = NULL;
+    next.sequence = next.sequence_end = next.preroll = NULL;
+    next.start = next.end = NULL;
+    last = next;
+    closed = gop_closed = second = fields = pair = 0;
+    boundaries = 0;
+    count = 1;
+    range = ranges;
+    if (nb_ranges > 0) {
+	range->sequence = range->sequence_end = start;
+	range->preroll = range->start = start;
+	range->end = end;
+    }
+    for (p = start; p + 8 <= end; p++) {
+	if (p[2] > 1) {
+	    p += 2;
+	    continue;
+	} else if (p[0] || p[1] || p[2] != 1)
+	    continue;
+	if (sequence_end == NULL && p[3] != 0xb2 && p[3] != 0xb5)
+	    sequence_end = p;
+	/* the headers of the boundary picture are complete */
+	if (next.start != NULL && !pair && p[3] != 0xb2 && p[3] != 0xb5) {
+	    if (boundaries && !(boundaries % gops)) {
+		if (count <= nb_ranges)
+		    range->end = next.start;
+		if (++count <= nb_ranges) {
+		    *++range = next;
+		    if (!closed) {
+			range->sequence = last.sequence;
+			range->sequence_end = last.sequence_end;
+			range->preroll = last.start;
+		    }
+		    range->end = end;
+		}
+	    }
+	    boundaries++;
+	    last = next;
+	    next.start = NULL;
+	}
+	switch (p[3]) {
+	case 0xb3:
+	    sequence = p;
+	    sequence_end = NULL;
+	    if (head == NULL)
+		head = p;
+	    break;
+	case 0xb8:
+	    gop_closed = p[7] & 0x40;
+	    if (head == NULL)
+		head = p;
+	    break;
+	case 0xb5:
+	    /* picture coding extension */
+	    if ((p[4] >> 4) == 8 && (p[6] & 3) != 3) {
+		fields = !second;
+		pair = (next.start != NULL && !second);
+	    }
+	    break;
+	case 0x00:
+	    second = fields;
+	    fields = 0;
+	    if (pair) {
+		/* wait for the second field to be an I picture too */
+		pair = 0;
+		if (((p[5] >> 3) & 7) != I_TYPE)
+		    next.start = NULL;
+	    } else if (((p[5] >> 3) & 7) == I_TYPE && !second &&
+		       sequence != NULL) {
+		next.sequence = sequence;
+		next.sequence_end = sequence_end;
+		next.preroll = next.start = (head == NULL) ? p : head;
+		closed = gop_closed;
+	    }
+	    head = NULL;
+	    gop_closed = 0;
+	    break;
+	}
+	p += 3;
+    }
+    return count;
+}
+
+int mpeg2_decode_range (mpeg2dec_t * mpeg2dec, const mpeg2_range_t * range,
+			mpeg2_convert_t convert, void * convert_arg,
+			mpeg2_frame_t frame, void * frame_arg)
+{
+    static uint8_t end_code[] = {0x00, 0x00, 0x01, 0xb7};
+    const mpeg2_info_t * info;
+    mpeg2_state_t state;
+    uint8_t * buf[4][2];
+    int i, picture, show, result;
+
+    /* the sequence header in effect, the preroll, the range, then flush */
+    buf[0][0] = buf[0][1] = range->sequence;
+    if (range->sequence_end <= range->preroll)
+	buf[0][1] = range->sequence_end;
+    buf[1][0] = range->preroll;
+    buf[1][1] = buf[2][0] = range->start;
+    buf[2][1] = range->end;
+    buf[3][0] = end_code;
+    buf[3][1] = end_code + 4;
+
+    info = &(mpeg2dec->info);
+    mpeg2_reset (mpeg2dec, 1);
+    picture = 0;
+    show = (range->preroll == range->start);
+    for (i = 0; i < 4; i++) {
+	mpeg2_buffer (mpeg2dec, buf[i][0], buf[i][1]);
+	while ((state = mpeg2_parse (mpeg2dec)) != STATE_BUFFER)
+	    switch (state) {
+	    case STATE_SEQUENCE:
+		if (convert != NULL &&
+		    mpeg2_convert (mpeg2dec, convert, convert_arg))
+		    return -1;
+		mpeg2_skip (mpeg2dec, frame == NULL);
+		break;
+	    case STATE_PICTURE:
+		picture |= (i >= 2);
+		break;
+	    case STATE_SLICE:
+	    case STATE_END:
+	    case STATE_INVALID_END:
+		/*
+		 * the frames of the preroll are all displayed by the time
+		 * the first picture of the range is decoded, but the last
+		 * of them may be displayed right then.
+		 */
+		if (picture && info->display_picture == info->current_picture)
+		    show = 1;
+		if (frame != NULL && info->display_fbuf && show) {
+		    result = frame (frame_arg, info);
+		    if (result)
+			return result;
+		}
+		show |= picture;
+		break;
+	    default:
+		break;
+	    }
+    }
+    return 0;
+}
+
 uint32_t mpeg2_accel (uint32_t accel)
 {
     if (!mpeg2_accels) {
@@ -387,6 +901,27 @@ uint32_t mpeg2_accel (uint32_t accel)
     return mpeg2_accels & ~MPEG2_ACCEL_DETECT;
 }
 
+void mpeg2_compact (mpeg2dec_t * mpeg2dec, int enable)
+{
+    unsigned int size;
+
+    /* keep whatever part of a chunk was already received */
+    size = enable ? COMPACT_BUFFER_SIZE : BUFFER_SIZE;
+    while (size < (unsigned) (mpeg2dec->chunk_ptr - mpeg2dec->chunk_buffer))
+	size <<= 1;
+    if (size > BUFFER_SIZE)
+	size = BUFFER_SIZE;
+    if (mpeg2dec->chunk_buffer != NULL && size != mpeg2dec->chunk_size)
+	resize_chunk (mpeg2dec, size);
+    mpeg2dec->compact = enable;
+}
+
+void mpeg2_intra_fbufs (mpeg2dec_t * mpeg2dec, int enable)
+{
+    /* buffers already allocated are kept until the next sequence */
+    mpeg2dec->intra_fbufs = enable;
+}
+
 void mpeg2_reset (mpeg2dec_t * mpeg2dec, int full_reset)
 {
     mpeg2dec->buf_start = mpeg2dec->buf_end = NULL;
@@ -396,6 +931,13 @@ void mpeg2_reset (mpeg2dec_t * mpeg2dec, int full_reset)
     mpeg2dec->action = mpeg2_seek_header;
     mpeg2dec->state = STATE_INVALID;
     mpeg2dec->first = 1;
+    mpeg2dec->b_pictures = mpeg2dec->inter_pictures = 0;
+    mpeg2dec->frame_pending = 0;
+    mpeg2dec->fields_sent = 0;
+    if (mpeg2dec->late_decode_slices) {
+	mpeg2dec->nb_decode_slices = mpeg2dec->late_decode_slices;
+	mpeg2dec->late_decode_slices = 0;
+    }
 
     mpeg2_reset_info(&(mpeg2dec->info));
     mpeg2dec->info.gop = NULL;
@@ -421,11 +963,43 @@ mpeg2dec_t * mpeg2_init (void)
 
     memset (mpeg2dec->decoder.DCTblock, 0, 64 * sizeof (int16_t));
     memset (mpeg2dec->quantizer_matrix, 0, 4 * 64 * sizeof (uint8_t));
-
-    mpeg2dec->chunk_buffer = (uint8_t *) mpeg2_malloc (BUFFER_SIZE + 4,
-						       MPEG2_ALLOC_CHUNK);
+    memset (mpeg2dec->alloc_stats, 0, sizeof (mpeg2dec->alloc_stats));
+
+    /* allocated with the first chunk, once the mode is known */
+    mpeg2dec->chunk_buffer = NULL;
+    mpeg2dec->chunk_start = mpeg2dec->chunk_ptr = NULL;
+    mpeg2dec->chunk_size = 0;
+    mpeg2dec->compact = 0;
+    mpeg2dec->intra_fbufs = 0;
+
+    /* the chroma tables are only allocated for a chroma matrix */
+    mpeg2dec->decoder.quantizer_prescale[0] = (uint16_t (*)[64])
+	mpeg2_malloc_dec (mpeg2dec, 2 * 32 * 64 * sizeof (uint16_t),
+			  MPEG2_ALLOC_MPEG2DEC);
+    mpeg2dec->decoder.quantizer_prescale[1] =
+	mpeg2dec->decoder.quantizer_prescale[0] + 32;
+    mpeg2dec->decoder.quantizer_prescale[2] = NULL;
+    mpeg2dec->decoder.quantizer_prescale[3] = NULL;
 
     mpeg2dec->sequence.width = (unsigned)-1;
+    mpeg2dec->frame_ready = NULL;
+    mpeg2dec->field_ready = NULL;
+    mpeg2dec->row_ready = mpeg2dec->decoder.row_ready = NULL;
+    mpeg2dec->late = NULL;
+    mpeg2dec->late_decode_slices = 0;
+    mpeg2dec->low_latency = mpeg2dec->low_delay = 0;
+    memset (mpeg2dec->picture_user_data, 0,
+	    sizeof (mpeg2dec->picture_user_data));
+    memset (mpeg2dec->picture_user_data_len, 0,
+	    sizeof (mpeg2dec->picture_user_data_len));
+    memset (mpeg2dec->picture_user_data_size, 0,
+	    sizeof (mpeg2dec->picture_user_data_size));
+    mpeg2dec->decoder.recon = NULL;
+    mpeg2dec->decoder.two_pass = mpeg2dec->decoder.deferred = 0;
+    mpeg2dec->decoder.record = mpeg2dec->decoder.parse_only = 0;
+    mpeg2dec->macroblock_info = 0;
+    mpeg2dec->macroblocks = NULL;
+    mpeg2dec->macroblocks_size = 0;
     mpeg2_reset (mpeg2dec, 1);
 
     return mpeg2dec;
@@ -433,7 +1007,15 @@ mpeg2dec_t * mpeg2_init (void)
 
 void mpeg2_close (mpeg2dec_t * mpeg2dec)
 {
+    int i;
+
     mpeg2_header_state_init (mpeg2dec);
     mpeg2_free (mpeg2dec->chunk_buffer);
+    mpeg2_free (mpeg2dec->decoder.quantizer_prescale[0]);
+    mpeg2_free (mpeg2dec->decoder.quantizer_prescale[2]);
+    mpeg2_free (mpeg2dec->decoder.recon);
+    mpeg2_free (mpeg2dec->macroblocks);
+    for (i = 0; i < 4; i++)
+	mpeg2_free (mpeg2dec->picture_user_data[i]);
     mpeg2_free (mpeg2dec);
 }
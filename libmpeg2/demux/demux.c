@@ -0,0 +1,893 @@
+/*
+ * demux.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "mpeg2demux.h"
+
+/*
+ * the demuxer keeps some state between calls, for each stream:
+ * if "state" == DEMUX_HEADER, then "head_buf" contains the first
+ *     "state_bytes" bytes from some header.
+ * if "state" == DEMUX_DATA, then we need to pass "state_bytes" bytes
+ *     of ES data before the next header.
+ * if "state" == DEMUX_SKIP, then we need to skip "state_bytes" bytes
+ *     of data before the next header.
+ *
+ * Payloads are returned as pointers into the caller's buffer, and stay
+ * valid until the next call to mpeg2demux_buffer(). The only
+ * exceptions are the PVA prebytes of a header that straddled two
+ * buffers, and TS packets that straddled two buffers: these are
+ * returned from the demuxer's own copy.
+ *
+ * A TS demuxer created with a zero pid follows the PAT and the PMTs,
+ * and returns the payloads of every MPEG-1 or MPEG-2 video stream they
+ * list, each tagged with its pid and program number.
+ *
+ * Whole TS packets are not parsed one at a time: ts_scan() walks the
+ * buffer 188 bytes at a time and only collects the packets whose pid
+ * is wanted. Packets following a PSI packet are left for the next
+ * scan, as that packet can change the set of wanted pids.
+ */
+
+#define DEMUX_HEADER 0
+#define DEMUX_DATA 1
+#define DEMUX_SKIP 2
+
+#define PSI_SECTION_SIZE 1024
+#define TS_BATCH 32
+
+typedef struct {
+    int id;
+    int program;
+    int state;
+    int state_bytes;
+    int payload_start;
+    uint8_t head_buf[264];
+} demux_stream_t;
+
+typedef struct {
+    int pid;
+    int active;
+    int bytes;
+    uint8_t section[PSI_SECTION_SIZE];
+} demux_psi_t;
+
+struct mpeg2demux_s {
+    mpeg2demux_info_t info;
+    mpeg2demux_format_t format;
+
+    /* input buffer, as given to mpeg2demux_buffer */
+    uint8_t * buf;
+    uint8_t * end;
+
+    int num_streams;
+    demux_stream_t ** streams;
+
+    /* a payload held back while an error is being reported */
+    int queued;
+    mpeg2demux_info_t next;
+    mpeg2demux_error_t error;
+    char error_string[32];
+
+    /* TS payload of the current packet */
+    demux_stream_t * payload_stream;
+    uint8_t * payload;
+    uint8_t * payload_end;
+    int packet_bytes;
+    int packet_index;
+    uint8_t packet[2][188];
+
+    /* wanted TS packets found by the last ts_scan () */
+    int scan_index;
+    int scan_count;
+    uint8_t * scan[TS_BATCH];
+
+    /* TS program tables, when following the PAT and PMTs */
+    int num_psi;
+    demux_psi_t ** psi;
+    uint8_t pid_map[8192];
+};
+
+/* pid_map holds a stream index + 1, or one of these */
+#define PID_NONE 0
+#define PID_PSI 255
+#define MAX_STREAMS 254
+
+static mpeg2demux_state_t demux_error (mpeg2demux_t * demux,
+				       mpeg2demux_error_t error,
+				       uint8_t * buf, uint8_t * end)
+{
+    demux->info.buf = buf;
+    demux->info.end = end;
+    demux->info.error = error;
+    return MPEG2DEMUX_ERROR;
+}
+
+static mpeg2demux_state_t demux_payload (mpeg2demux_t * demux,
+					 demux_stream_t * stream,
+					 uint8_t * buf, uint8_t * end)
+{
+    demux->info.buf = buf;
+    demux->info.end = end;
+    demux->info.stream = stream->id;
+    demux->info.program = stream->program;
+    if (demux->error) {
+	/* report the error first, the payload goes out on the next call */
+	demux->next = demux->info;
+	demux->queued = 1;
+	demux->info.error = demux->error;
+	demux->error = MPEG2DEMUX_ERROR_NONE;
+	return MPEG2DEMUX_ERROR;
+    }
+    return MPEG2DEMUX_PAYLOAD;
+}
+
+/*
+ * NEEDBYTES makes sure we have the requested number of bytes for a
+ * header. If we dont, it copies what we have into head_buf and returns,
+ * so that when we come back with more data we finish decoding this header.
+ *
+ * DONEBYTES updates "buf" to point after the header we just parsed.
+ */
+
+#define NEEDBYTES(x)						\
+    do {							\
+	int missing;						\
+								\
+	missing = (x) - bytes;					\
+	if (missing > 0) {					\
+	    if (header == stream->head_buf) {			\
+		if (missing <= end - buf) {			\
+		    memcpy (header + bytes, buf, missing);	\
+		    buf += missing;				\
+		    bytes = (x);				\
+		} else {					\
+		    memcpy (header + bytes, buf, end - buf);	\
+		    stream->state_bytes = bytes + end - buf;	\
+		    *bufp = end;				\
+		    return MPEG2DEMUX_BUFFER;			\
+		}						\
+	    } else {						\
+		memcpy (stream->head_buf, header, bytes);	\
+		stream->state = DEMUX_HEADER;			\
+		stream->state_bytes = bytes;			\
+		*bufp = end;					\
+		return MPEG2DEMUX_BUFFER;			\
+	    }							\
+	}							\
+    } while (0)
+
+#define DONEBYTES(x)			\
+    do {				\
+	if (header != stream->head_buf)	\
+	    buf = header + (x);		\
+    } while (0)
+
+static mpeg2demux_state_t demux_pes (mpeg2demux_t * demux,
+				     demux_stream_t * stream,
+				     uint8_t ** bufp, uint8_t * end)
+{
+    static const int mpeg1_skip_table[16] = {
+	0, 0, 4, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+
+    uint8_t * buf;
+    uint8_t * header;
+    int bytes;
+    int len;
+    int ts;
+
+    buf = *bufp;
+    ts = (demux->format == MPEG2DEMUX_TS);
+    if (stream->payload_start) {
+	stream->payload_start = 0;
+	goto payload_start;
+    }
+    if (buf == end)
+	return MPEG2DEMUX_BUFFER;
+    switch (stream->state) {
+    case DEMUX_HEADER:
+	if (stream->state_bytes > 0) {
+	    header = stream->head_buf;
+	    bytes = stream->state_bytes;
+	    goto continue_header;
+	}
+	break;
+    case DEMUX_DATA:
+	if (ts || (stream->state_bytes > end - buf)) {
+	    stream->state_bytes -= end - buf;
+	    *bufp = end;
+	    return demux_payload (demux, stream, buf, end);
+	}
+	stream->state = DEMUX_HEADER;
+	if (stream->state_bytes > 0) {
+	    *bufp = buf + stream->state_bytes;
+	    stream->state_bytes = 0;
+	    return demux_payload (demux, stream, buf, *bufp);
+	}
+	break;
+    case DEMUX_SKIP:
+	if (ts || (stream->state_bytes > end - buf)) {
+	    stream->state_bytes -= end - buf;
+	    *bufp = end;
+	    return MPEG2DEMUX_BUFFER;
+	}
+	buf += stream->state_bytes;
+	break;
+    }
+
+    while (1) {
+	if (ts) {
+	    stream->state = DEMUX_SKIP;
+	    *bufp = end;
+	    return MPEG2DEMUX_BUFFER;
+	}
+    payload_start:
+	header = buf;
+	bytes = end - buf;
+    continue_header:
+	NEEDBYTES (4);
+	if (header[0] || header[1] || (header[2] != 1)) {
+	    if (ts) {
+		stream->state = DEMUX_SKIP;
+		*bufp = end;
+		return MPEG2DEMUX_BUFFER;
+	    } else if (header != stream->head_buf) {
+		buf++;
+		goto payload_start;
+	    } else {
+		header[0] = header[1];
+		header[1] = header[2];
+		header[2] = header[3];
+		bytes = 3;
+		goto continue_header;
+	    }
+	}
+	stream->state = DEMUX_HEADER;
+	stream->state_bytes = 0;
+	if (ts) {
+	    if ((header[3] >= 0xe0) && (header[3] <= 0xef))
+		goto pes;
+	    stream->state = DEMUX_SKIP;
+	    *bufp = end;
+	    return demux_error (demux, MPEG2DEMUX_ERROR_STREAM_ID,
+				header, header + 4);
+	}
+	switch (header[3]) {
+	case 0xb9:	/* program end code */
+	    DONEBYTES (4);
+	    *bufp = buf;
+	    return MPEG2DEMUX_END;
+	case 0xba:	/* pack header */
+	    NEEDBYTES (5);
+	    if ((header[4] & 0xc0) == 0x40) {	/* mpeg2 */
+		NEEDBYTES (14);
+		len = 14 + (header[13] & 7);
+		NEEDBYTES (len);
+		DONEBYTES (len);
+		/* header points to the mpeg2 pack header */
+	    } else if ((header[4] & 0xf0) == 0x20) {	/* mpeg1 */
+		NEEDBYTES (12);
+		DONEBYTES (12);
+		/* header points to the mpeg1 pack header */
+	    } else {
+		DONEBYTES (5);
+		*bufp = buf;
+		return demux_error (demux, MPEG2DEMUX_ERROR_PACK,
+				    header, header + 5);
+	    }
+	    break;
+	default:
+	    if (header[3] == stream->id) {
+	    pes:
+		NEEDBYTES (7);
+		if ((header[6] & 0xc0) == 0x80) {	/* mpeg2 */
+		    NEEDBYTES (9);
+		    len = 9 + header[8];
+		    NEEDBYTES (len);
+		    /* header points to the mpeg2 pes header */
+		    if (header[7] & 0x80) {
+			demux->info.tagged = 1;
+			demux->info.pts =
+			    (((header[9] >> 1) << 30) |
+			     (header[10] << 22) | ((header[11] >> 1) << 15) |
+			     (header[12] << 7) | (header[13] >> 1));
+			demux->info.dts =
+			    (!(header[7] & 0x40) ? demux->info.pts :
+			     (uint32_t)(((header[14] >> 1) << 30) |
+			      (header[15] << 22) |
+			      ((header[16] >> 1) << 15) |
+			      (header[17] << 7) | (header[18] >> 1)));
+		    }
+		} else {	/* mpeg1 */
+		    int len_skip;
+		    uint8_t * ptsbuf;
+
+		    len = 7;
+		    while (header[len - 1] == 0xff) {
+			len++;
+			NEEDBYTES (len);
+			if (len > 23) {
+			    demux->error = MPEG2DEMUX_ERROR_STUFFING;
+			    break;
+			}
+		    }
+		    if ((header[len - 1] & 0xc0) == 0x40) {
+			len += 2;
+			NEEDBYTES (len);
+		    }
+		    len_skip = len;
+		    len += mpeg1_skip_table[header[len - 1] >> 4];
+		    NEEDBYTES (len);
+		    /* header points to the mpeg1 pes header */
+		    ptsbuf = header + len_skip;
+		    if ((ptsbuf[-1] & 0xe0) == 0x20) {
+			demux->info.tagged = 1;
+			demux->info.pts =
+			    (((ptsbuf[-1] >> 1) << 30) |
+			     (ptsbuf[0] << 22) | ((ptsbuf[1] >> 1) << 15) |
+			     (ptsbuf[2] << 7) | (ptsbuf[3] >> 1));
+			demux->info.dts =
+			    (((ptsbuf[-1] & 0xf0) != 0x30) ? demux->info.pts :
+			     (uint32_t)(((ptsbuf[4] >> 1) << 30) |
+			      (ptsbuf[5] << 22) | ((ptsbuf[6] >> 1) << 15) |
+			      (ptsbuf[7] << 7) | (ptsbuf[8] >> 1)));
+		    }
+		}
+		DONEBYTES (len);
+		bytes = 6 + (header[4] << 8) + header[5] - len;
+		if (ts || (bytes > end - buf)) {
+		    stream->state = DEMUX_DATA;
+		    stream->state_bytes = bytes - (end - buf);
+		    *bufp = end;
+		    return demux_payload (demux, stream, buf, end);
+		} else if (bytes > 0) {
+		    *bufp = buf + bytes;
+		    return demux_payload (demux, stream, buf, buf + bytes);
+		} else if (demux->info.tagged) {
+		    *bufp = buf;
+		    return demux_payload (demux, stream, buf, buf);
+		}
+	    } else if (header[3] < 0xb9) {
+		DONEBYTES (4);
+		*bufp = buf;
+		return demux_error (demux, MPEG2DEMUX_ERROR_ES,
+				    header, header + 4);
+	    } else {
+		NEEDBYTES (6);
+		DONEBYTES (6);
+		bytes = (header[4] << 8) + header[5];
+		if (bytes > end - buf) {
+		    stream->state = DEMUX_SKIP;
+		    stream->state_bytes = bytes - (end - buf);
+		    *bufp = end;
+		    return MPEG2DEMUX_BUFFER;
+		}
+		buf += bytes;
+	    }
+	}
+    }
+}
+
+static mpeg2demux_state_t demux_pva (mpeg2demux_t * demux)
+{
+    demux_stream_t * stream;
+    uint8_t ** bufp;
+    uint8_t * buf;
+    uint8_t * end;
+    uint8_t * header;
+    int bytes;
+    int len;
+
+    stream = demux->streams[0];
+    bufp = &demux->buf;
+    buf = demux->buf;
+    end = demux->end;
+    if (buf == end)
+	return MPEG2DEMUX_BUFFER;
+    switch (stream->state) {
+    case DEMUX_HEADER:
+	if (stream->state_bytes > 0) {
+	    header = stream->head_buf;
+	    bytes = stream->state_bytes;
+	    goto continue_header;
+	}
+	break;
+    case DEMUX_DATA:
+	if (stream->state_bytes > end - buf) {
+	    stream->state_bytes -= end - buf;
+	    *bufp = end;
+	    return demux_payload (demux, stream, buf, end);
+	}
+	stream->state = DEMUX_HEADER;
+	if (stream->state_bytes > 0) {
+	    *bufp = buf + stream->state_bytes;
+	    stream->state_bytes = 0;
+	    return demux_payload (demux, stream, buf, *bufp);
+	}
+	break;
+    case DEMUX_SKIP:
+	if (stream->state_bytes > end - buf) {
+	    stream->state_bytes -= end - buf;
+	    *bufp = end;
+	    return MPEG2DEMUX_BUFFER;
+	}
+	buf += stream->state_bytes;
+	break;
+    }
+
+    while (1) {
+    payload_start:
+	header = buf;
+	bytes = end - buf;
+    continue_header:
+	NEEDBYTES (2);
+	if (header[0] != 0x41 || header[1] != 0x56) {
+	    if (header != stream->head_buf) {
+		buf++;
+		goto payload_start;
+	    } else {
+		header[0] = header[1];
+		bytes = 1;
+		goto continue_header;
+	    }
+	}
+	NEEDBYTES (8);
+	stream->state = DEMUX_HEADER;
+	stream->state_bytes = 0;
+	if (header[2] != 1) {
+	    DONEBYTES (8);
+	    bytes = (header[6] << 8) + header[7];
+	    if (bytes > end - buf) {
+		stream->state = DEMUX_SKIP;
+		stream->state_bytes = bytes - (end - buf);
+		*bufp = end;
+		return MPEG2DEMUX_BUFFER;
+	    }
+	    buf += bytes;
+	} else {
+	    len = 8;
+	    if (header[5] & 0x10) {
+		len = 12 + (header[5] & 3);
+		NEEDBYTES (len);
+		demux->info.tagged = 1;
+		demux->info.pts = ((header[8] << 24) | (header[9] << 16) |
+				   (header[10] << 8) | header[11]);
+		demux->info.dts = 0;
+	    }
+	    DONEBYTES (len);
+	    bytes = (header[6] << 8) + header[7] + 8 - len;
+	    if (bytes > end - buf) {
+		stream->state = DEMUX_DATA;
+		stream->state_bytes = bytes - (end - buf);
+		*bufp = end;
+	    } else
+		*bufp = buf + ((bytes > 0) ? bytes : 0);
+	    if (demux->info.tagged && len > 12) {
+		/* the prebytes belong before the tagged data */
+		demux->next = demux->info;
+		demux->next.buf = buf;
+		demux->next.end = *bufp;
+		demux->queued = 1;
+		demux->info.tagged = 0;
+		demux->info.buf = header + 12;
+		demux->info.end = header + len;
+		return MPEG2DEMUX_PAYLOAD;
+	    } else if (demux->info.tagged || *bufp != buf)
+		return demux_payload (demux, stream, buf, *bufp);
+	}
+    }
+}
+
+static uint32_t psi_crc32 (const uint8_t * buf, int len)
+{
+    uint32_t crc;
+    int i;
+
+    crc = 0xffffffff;
+    while (len--) {
+	crc ^= *buf++ << 24;
+	for (i = 0; i < 8; i++)
+	    crc = (crc << 1) ^ ((crc & 0x80000000) ? 0x04c11db7 : 0);
+    }
+    return crc;
+}
+
+static demux_stream_t * add_stream (mpeg2demux_t * demux, int id)
+{
+    demux_stream_t ** streams;
+    demux_stream_t * stream;
+
+    streams = (demux_stream_t **) realloc (demux->streams,
+					   (demux->num_streams + 1) *
+					   sizeof (demux_stream_t *));
+    if (streams == NULL)
+	return NULL;
+    demux->streams = streams;
+    stream = (demux_stream_t *) malloc (sizeof (demux_stream_t));
+    if (stream == NULL)
+	return NULL;
+    memset (stream, 0, sizeof (demux_stream_t));
+    stream->id = id;
+    stream->state = DEMUX_SKIP;
+    streams[demux->num_streams++] = stream;
+    return stream;
+}
+
+static void add_psi (mpeg2demux_t * demux, int pid)
+{
+    demux_psi_t ** table;
+    demux_psi_t * psi;
+
+    if (demux->pid_map[pid] != PID_NONE)
+	return;
+    table = (demux_psi_t **) realloc (demux->psi, (demux->num_psi + 1) *
+				      sizeof (demux_psi_t *));
+    if (table == NULL)
+	return;
+    demux->psi = table;
+    psi = (demux_psi_t *) malloc (sizeof (demux_psi_t));
+    if (psi == NULL)
+	return;
+    psi->pid = pid;
+    psi->active = 0;
+    psi->bytes = 0;
+    table[demux->num_psi++] = psi;
+    demux->pid_map[pid] = PID_PSI;
+}
+
+static void psi_section (mpeg2demux_t * demux, uint8_t * section, int len)
+{
+    demux_stream_t * stream;
+    int program;
+    int type;
+    int pid;
+    int i;
+
+    if (len < 12 || !(section[1] & 0x80) || !(section[5] & 1) ||
+	psi_crc32 (section, len))
+	return;
+    len -= 4;
+    switch (section[0]) {
+    case 0x00:	/* program association table */
+	for (i = 8; i + 4 <= len; i += 4) {
+	    program = (section[i] << 8) | section[i + 1];
+	    pid = ((section[i + 2] << 8) | section[i + 3]) & 0x1fff;
+	    if (program)
+		add_psi (demux, pid);
+	}
+	break;
+    case 0x02:	/* program map table */
+	program = (section[3] << 8) | section[4];
+	i = 12 + (((section[10] << 8) | section[11]) & 0xfff);
+	for (; i + 5 <= len; i += 5 + (((section[i + 3] << 8) |
+					 section[i + 4]) & 0xfff)) {
+	    type = section[i];
+	    pid = ((section[i + 1] << 8) | section[i + 2]) & 0x1fff;
+	    if ((type != 0x01 && type != 0x02) ||
+		demux->pid_map[pid] != PID_NONE ||
+		demux->num_streams >= MAX_STREAMS)
+		continue;
+	    stream = add_stream (demux, pid);
+	    if (stream == NULL)
+		return;
+	    stream->program = program;
+	    demux->pid_map[pid] = demux->num_streams;
+	}
+	break;
+    }
+}
+
+static void psi_append (mpeg2demux_t * demux, demux_psi_t * psi,
+			uint8_t * buf, uint8_t * end)
+{
+    int bytes;
+    int len;
+
+    while (psi->active && buf < end) {
+	if (!psi->bytes && *buf == 0xff) {	/* stuffing */
+	    psi->active = 0;
+	    break;
+	}
+	len = 3;
+	if (psi->bytes >= 3) {
+	    len += ((psi->section[1] << 8) | psi->section[2]) & 0xfff;
+	    if (len == 3 || len > PSI_SECTION_SIZE) {
+		psi->active = 0;
+		break;
+	    }
+	}
+	bytes = len - psi->bytes;
+	if (bytes > end - buf)
+	    bytes = end - buf;
+	memcpy (psi->section + psi->bytes, buf, bytes);
+	buf += bytes;
+	psi->bytes += bytes;
+	if (psi->bytes == len && len > 3) {
+	    psi_section (demux, psi->section, len);
+	    psi->bytes = 0;
+	}
+    }
+}
+
+static void demux_psi (mpeg2demux_t * demux, demux_psi_t * psi,
+		       uint8_t * buf, uint8_t * end, int payload_start)
+{
+    uint8_t * section;
+
+    if (buf == end)
+	return;
+    if (payload_start) {
+	/* the pointer field covers the end of the previous section */
+	section = buf + 1 + buf[0];
+	if (section > end) {
+	    psi->active = 0;
+	    return;
+	}
+	psi_append (demux, psi, buf + 1, section);
+	psi->active = 1;
+	psi->bytes = 0;
+	buf = section;
+    }
+    psi_append (demux, psi, buf, end);
+}
+
+static void ts_scan (mpeg2demux_t * demux)
+{
+    uint8_t * buf;
+    uint8_t * end;
+    uint8_t * pid_map;
+    int count;
+    int wanted;
+    int i;
+
+#define TS_WANTED(p) (pid_map[(((p)[1] << 8) + (p)[2]) & 0x1fff])
+
+    buf = demux->buf;
+    end = demux->end;
+    pid_map = demux->pid_map;
+    count = 0;
+    while (end - buf >= 4 * 188 && count <= TS_BATCH - 4 &&
+	   buf[0] == 0x47 && buf[188] == 0x47 &&
+	   buf[2 * 188] == 0x47 && buf[3 * 188] == 0x47) {
+	if (!(TS_WANTED (buf) | TS_WANTED (buf + 188) |
+	      TS_WANTED (buf + 2 * 188) | TS_WANTED (buf + 3 * 188))) {
+	    buf += 4 * 188;
+	    continue;
+	}
+	for (i = 0; i < 4; i++) {
+	    wanted = TS_WANTED (buf);
+	    buf += 188;
+	    if (wanted != PID_NONE) {
+		demux->scan[count++] = buf - 188;
+		if (wanted == PID_PSI)
+		    goto done;
+	    }
+	}
+    }
+    while (end - buf >= 188 && count < TS_BATCH && buf[0] == 0x47) {
+	wanted = TS_WANTED (buf);
+	buf += 188;
+	if (wanted != PID_NONE) {
+	    demux->scan[count++] = buf - 188;
+	    if (wanted == PID_PSI)
+		break;
+	}
+    }
+    done:
+    demux->buf = buf;
+    demux->scan_index = 0;
+    demux->scan_count = count;
+
+#undef TS_WANTED
+}
+
+static uint8_t * ts_resync (uint8_t * buf, uint8_t * end)
+{
+    /* look for a sync byte that repeats every 188 bytes */
+    while ((buf = (uint8_t *) memchr (buf, 0x47, end - buf)) != NULL) {
+	if ((end - buf <= 188 || buf[188] == 0x47) &&
+	    (end - buf <= 2 * 188 || buf[2 * 188] == 0x47))
+	    return buf;
+	buf++;
+    }
+    return end;
+}
+
+static mpeg2demux_state_t demux_ts (mpeg2demux_t * demux)
+{
+    mpeg2demux_state_t state;
+    demux_stream_t * stream;
+    uint8_t * packet;
+    uint8_t * data;
+    int bytes;
+    int pid;
+    int i;
+
+    while (1) {
+	stream = demux->payload_stream;
+	if (stream != NULL &&
+	    (stream->payload_start || demux->payload != demux->payload_end)) {
+	    state = demux_pes (demux, stream,
+			       &demux->payload, demux->payload_end);
+	    if (state != MPEG2DEMUX_BUFFER)
+		return state;
+	    demux->payload = demux->payload_end;
+	}
+
+	packet = demux->packet[demux->packet_index];
+	if (demux->packet_bytes) {
+	    /* finish the packet that straddled two buffers */
+	    bytes = 188 - demux->packet_bytes;
+	    if (bytes > demux->end - demux->buf)
+		bytes = demux->end - demux->buf;
+	    memcpy (packet + demux->packet_bytes, demux->buf, bytes);
+	    demux->buf += bytes;
+	    demux->packet_bytes += bytes;
+	    if (demux->packet_bytes < 188)
+		return MPEG2DEMUX_BUFFER;
+	    if (*packet != 0x47) {
+		memmove (packet, packet + 1, 187);
+		demux->packet_bytes = 187;
+		return demux_error (demux, MPEG2DEMUX_ERROR_SYNC,
+				    packet, packet + 1);
+	    }
+	    demux->packet_bytes = 0;
+	} else if (demux->scan_index < demux->scan_count)
+	    packet = demux->scan[demux->scan_index++];
+	else {
+	    ts_scan (demux);
+	    if (demux->scan_count)
+		continue;
+	    if (demux->end - demux->buf >= 188) {
+		packet = demux->buf;
+		demux->buf = ts_resync (packet + 1, demux->end);
+		return demux_error (demux, MPEG2DEMUX_ERROR_SYNC,
+				    packet, demux->buf);
+	    }
+	    /*
+	     * keep the partial packet in the copy that the current
+	     * buffer's payloads do not point into
+	     */
+	    demux->packet_index ^= 1;
+	    packet = demux->packet[demux->packet_index];
+	    demux->packet_bytes = demux->end - demux->buf;
+	    memcpy (packet, demux->buf, demux->packet_bytes);
+	    demux->buf = demux->end;
+	    return MPEG2DEMUX_BUFFER;
+	}
+
+	pid = ((packet[1] << 8) + packet[2]) & 0x1fff;
+	i = demux->pid_map[pid];
+	if (i == PID_NONE)
+	    continue;
+	data = packet + 4;
+	if (packet[3] & 0x20) {	/* packet contains an adaptation field */
+	    data = packet + 5 + packet[4];
+	    if (data > packet + 188)
+		continue;
+	}
+	if (!(packet[3] & 0x10))
+	    continue;
+	if (i == PID_PSI) {
+	    for (i = 0; demux->psi[i]->pid != pid; i++);
+	    demux_psi (demux, demux->psi[i], data, packet + 188,
+		       packet[1] & 0x40);
+	} else {
+	    demux->payload_stream = demux->streams[i - 1];
+	    demux->payload = data;
+	    demux->payload_end = packet + 188;
+	    demux->payload_stream->payload_start = packet[1] & 0x40;
+	}
+    }
+}
+
+mpeg2demux_t * mpeg2demux_init (mpeg2demux_format_t format, int stream)
+{
+    mpeg2demux_t * demux;
+
+    demux = (mpeg2demux_t *) malloc (sizeof (mpeg2demux_t));
+    if (demux == NULL)
+	return NULL;
+    memset (demux, 0, sizeof (mpeg2demux_t));
+    demux->format = format;
+    if (format == MPEG2DEMUX_TS && !stream)
+	add_psi (demux, 0);
+    else if (add_stream (demux, stream) != NULL && format == MPEG2DEMUX_TS)
+	demux->pid_map[stream & 0x1fff] = 1;
+    if (!(demux->num_streams + demux->num_psi)) {
+	mpeg2demux_close (demux);
+	return NULL;
+    }
+    return demux;
+}
+
+const mpeg2demux_info_t * mpeg2demux_info (mpeg2demux_t * demux)
+{
+    return &(demux->info);
+}
+
+void mpeg2demux_close (mpeg2demux_t * demux)
+{
+    int i;
+
+    for (i = 0; i < demux->num_streams; i++)
+	free (demux->streams[i]);
+    for (i = 0; i < demux->num_psi; i++)
+	free (demux->psi[i]);
+    free (demux->streams);
+    free (demux->psi);
+    free (demux);
+}
+
+const char * mpeg2demux_error_string (mpeg2demux_t * demux)
+{
+    switch (demux->info.error) {
+    case MPEG2DEMUX_ERROR_SYNC:
+	return "bad sync byte";
+    case MPEG2DEMUX_ERROR_PACK:
+	return "weird pack header";
+    case MPEG2DEMUX_ERROR_STUFFING:
+	return "too much stuffing";
+    case MPEG2DEMUX_ERROR_ES:
+	return "looks like a video stream, not system stream";
+    case MPEG2DEMUX_ERROR_STREAM_ID:
+	sprintf (demux->error_string, "bad stream id %x", demux->info.buf[3]);
+	return demux->error_string;
+    default:
+	return "no error";
+    }
+}
+
+void mpeg2demux_buffer (mpeg2demux_t * demux, uint8_t * start, uint8_t * end)
+{
+    demux->buf = start;
+    demux->end = end;
+    demux->scan_index = demux->scan_count = 0;
+}
+
+mpeg2demux_state_t mpeg2demux_parse (mpeg2demux_t * demux)
+{
+    if (demux->queued) {
+	demux->queued = 0;
+	demux->info = demux->next;
+	return MPEG2DEMUX_PAYLOAD;
+    }
+    demux->info.tagged = 0;
+    demux->info.error = MPEG2DEMUX_ERROR_NONE;
+    switch (demux->format) {
+    case MPEG2DEMUX_TS:
+	return demux_ts (demux);
+    case MPEG2DEMUX_PVA:
+	return demux_pva (demux);
+    default:
+	return demux_pes (demux, demux->streams[0], &demux->buf, demux->end);
+    }
+}
@@ -104,6 +104,7 @@ void mpeg2_header_state_init (mpeg2dec_t * mpeg2dec)
     mpeg2dec->fbuf[1] = &mpeg2dec->fbuf_alloc[1].fbuf;
     mpeg2dec->fbuf[2] = &mpeg2dec->fbuf_alloc[2].fbuf;
     mpeg2dec->first = 1;
+    mpeg2dec->b_pictures = mpeg2dec->inter_pictures = 0;
     mpeg2dec->alloc_index = 0;
     mpeg2dec->alloc_index_user = 0;
     mpeg2dec->first_decode_slice = 1;
@@ -119,6 +120,7 @@ void mpeg2_reset_info (mpeg2_info_t * info)
     info->current_picture = info->current_picture_2nd = NULL;
     info->display_picture = info->display_picture_2nd = NULL;
     info->current_fbuf = info->display_fbuf = info->discard_fbuf = NULL;
+    info->macroblocks = NULL;
 }
 
 static void info_user_data (mpeg2dec_t * mpeg2dec)
@@ -418,6 +420,21 @@ static void copy_matrix (mpeg2dec_t * mpeg2dec, int idx)
     }
 }
 
+static int chroma_prescale (mpeg2dec_t * mpeg2dec)
+{
+    mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
+
+    if (decoder->quantizer_prescale[2] == NULL) {
+	decoder->quantizer_prescale[2] = (uint16_t (*)[64])
+	    mpeg2_malloc_dec (mpeg2dec, 2 * 32 * 64 * sizeof (uint16_t),
+			      MPEG2_ALLOC_MPEG2DEC);
+	if (decoder->quantizer_prescale[2] == NULL)
+	    return 0;
+	decoder->quantizer_prescale[3] = decoder->quantizer_prescale[2] + 32;
+    }
+    return 1;
+}
+
 static void finalize_matrix (mpeg2dec_t * mpeg2dec)
 {
     mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
@@ -428,7 +445,8 @@ static void finalize_matrix (mpeg2dec_t * mpeg2dec)
 	    copy_matrix (mpeg2dec, i);
 	if ((mpeg2dec->copy_matrix & (4 << i)) &&
 	    memcmp (mpeg2dec->quantizer_matrix[i],
-		    mpeg2dec->new_quantizer_matrix[i+2], 64)) {
+		    mpeg2dec->new_quantizer_matrix[i+2], 64) &&
+	    chroma_prescale (mpeg2dec)) {
 	    copy_matrix (mpeg2dec, i + 2);
 	    decoder->chroma_quantizer[i] = decoder->quantizer_prescale[i+2];
 	} else if (mpeg2dec->copy_matrix & (5 << i))
@@ -523,22 +541,77 @@ void mpeg2_header_gop_finalize (mpeg2dec_t * mpeg2dec)
 
 void mpeg2_set_fbuf (mpeg2dec_t * mpeg2dec, int b_type)
 {
-    int i;
+    int i, refs;
 
+    /* see mpeg2_intra_fbufs: with fewer buffers, fewer pictures are kept */
+    refs = 2;
+    if (mpeg2dec->intra_fbufs && !mpeg2dec->custom_fbuf)
+	refs = mpeg2dec->alloc_index - 1;
     for (i = 0; i < 3; i++)
-	if (mpeg2dec->fbuf[1] != &mpeg2dec->fbuf_alloc[i].fbuf &&
-	    mpeg2dec->fbuf[2] != &mpeg2dec->fbuf_alloc[i].fbuf) {
+	if ((refs < 1 ||
+	     mpeg2dec->fbuf[1] != &mpeg2dec->fbuf_alloc[i].fbuf) &&
+	    (refs < 2 ||
+	     mpeg2dec->fbuf[2] != &mpeg2dec->fbuf_alloc[i].fbuf)) {
 	    mpeg2dec->fbuf[0] = &mpeg2dec->fbuf_alloc[i].fbuf;
 	    mpeg2dec->info.current_fbuf = mpeg2dec->fbuf[0];
-	    if (b_type || (mpeg2dec->sequence.flags & SEQ_FLAG_LOW_DELAY)) {
-		if (b_type || mpeg2dec->convert)
+	    if (b_type || mpeg2dec->low_delay) {
+		if (b_type || mpeg2dec->convert || refs < 2)
 		    mpeg2dec->info.discard_fbuf = mpeg2dec->fbuf[0];
 		mpeg2dec->info.display_fbuf = mpeg2dec->fbuf[0];
-	    }
+	    } else if (refs < 2)
+		/* the buffer is reused once its picture is shown */
+		mpeg2dec->info.discard_fbuf = mpeg2dec->info.display_fbuf;
 	    break;
 	}
 }
 
+static void send_fields (mpeg2dec_t * mpeg2dec, unsigned int count)
+{
+    mpeg2_info_t * info = &(mpeg2dec->info);
+    const mpeg2_picture_t * picture;
+    unsigned int i;
+    int bottom;
+
+    for (i = mpeg2dec->fields_sent; i < count; i++) {
+	picture = info->display_picture;
+	if (i && info->display_picture_2nd != NULL)
+	    picture = info->display_picture_2nd;
+	if (picture->nb_fields == 1)
+	    bottom = !(picture->flags & PIC_FLAG_TOP_FIELD_FIRST);
+	else if (mpeg2dec->sequence.flags & SEQ_FLAG_PROGRESSIVE_SEQUENCE)
+	    bottom = i & 1;
+	else
+	    bottom = (i + !(picture->flags & PIC_FLAG_TOP_FIELD_FIRST)) & 1;
+	mpeg2dec->field_ready (mpeg2dec->field_ready_arg, info->display_fbuf,
+			       picture, bottom);
+    }
+    mpeg2dec->fields_sent = count;
+}
+
+void mpeg2_display_ready (mpeg2dec_t * mpeg2dec)
+{
+    mpeg2_info_t * info = &(mpeg2dec->info);
+
+    mpeg2dec->frame_pending = 0;
+    if (mpeg2dec->frame_ready && info->display_fbuf)
+	mpeg2dec->frame_ready (mpeg2dec->frame_ready_arg, info->display_fbuf,
+			       info->display_picture,
+			       info->display_picture_2nd);
+    if (mpeg2dec->field_ready && info->display_fbuf && info->display_picture)
+	send_fields (mpeg2dec, (info->display_picture_2nd != NULL) ? 2 :
+		     info->display_picture->nb_fields);
+    mpeg2dec->fields_sent = 0;
+}
+
+/* the first field of a pair that is displayed as soon as decoded */
+void mpeg2_first_field_ready (mpeg2dec_t * mpeg2dec)
+{
+    mpeg2_info_t * info = &(mpeg2dec->info);
+
+    if (mpeg2dec->field_ready && info->display_fbuf && info->display_picture)
+	send_fields (mpeg2dec, 1);
+}
+
 int mpeg2_header_picture (mpeg2dec_t * mpeg2dec)
 {
     uint8_t * buffer = mpeg2dec->chunk_start;
@@ -681,10 +754,36 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
     mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
     int old_type_b = (decoder->coding_type == B_TYPE);
     int low_delay = mpeg2dec->sequence.flags & SEQ_FLAG_LOW_DELAY;
+    int nb_fbufs = 3;
 
     finalize_matrix (mpeg2dec);
     decoder->coding_type = mpeg2dec->new_picture.flags & PIC_MASK_CODING_TYPE;
 
+    /* low latency: references are shown as decoded until a B picture */
+    if (decoder->coding_type == B_TYPE)
+	mpeg2dec->b_pictures = 1;
+    else if (mpeg2dec->low_latency > 1 && mpeg2dec->first &&
+	     !mpeg2dec->b_pictures)
+	low_delay = 1;
+    mpeg2dec->low_delay = low_delay;
+
+    /*
+     * intra only: no picture was predicted since the last restart, so
+     * each picture can be decoded on its own. Field pictures are left
+     * out, the second field of a pair may still be predicted from the
+     * previous frame. With mpeg2_intra_fbufs, the library then only
+     * allocates the buffers needed for display: one when the sequence
+     * has no B pictures, two otherwise.
+     */
+    if (decoder->coding_type == P_TYPE || decoder->coding_type == B_TYPE)
+	mpeg2dec->inter_pictures = 1;
+    else if (!mpeg2dec->inter_pictures &&
+	     decoder->picture_structure == FRAME_PICTURE) {
+	mpeg2dec->new_picture.flags |= PIC_FLAG_INTRA_ONLY;
+	if (mpeg2dec->intra_fbufs && !mpeg2dec->alloc_index_user)
+	    nb_fbufs = (mpeg2dec->sequence.flags & SEQ_FLAG_LOW_DELAY) ? 1 : 2;
+    }
+
     if (mpeg2dec->state == STATE_PICTURE) {
 	mpeg2_picture_t * picture;
 	mpeg2_picture_t * other;
@@ -722,6 +821,12 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
 	    if (!low_delay + !mpeg2dec->convert)
 		mpeg2dec->info.discard_fbuf =
 		    mpeg2dec->fbuf[!low_delay + !mpeg2dec->convert];
+	    if ((mpeg2dec->low_latency > 1 &&
+		 !mpeg2dec->info.display_picture) ||
+		(mpeg2dec->intra_fbufs && !mpeg2dec->custom_fbuf &&
+		 mpeg2dec->alloc_index && mpeg2dec->alloc_index < 3))
+		/* the last reference was already shown and discarded */
+		mpeg2dec->info.discard_fbuf = NULL;
 	}
 	if (mpeg2dec->convert) {
 	    mpeg2_convert_init_t convert_init;
@@ -729,8 +834,8 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
 		int y_size, uv_size;
 
 		mpeg2dec->decoder.convert_id =
-		    mpeg2_malloc (mpeg2dec->convert_id_size,
-				  MPEG2_ALLOC_CONVERT_ID);
+		    mpeg2_malloc_dec (mpeg2dec, mpeg2dec->convert_id_size,
+				      MPEG2_ALLOC_CONVERT_ID);
 		mpeg2dec->convert (MPEG2_CONVERT_START,
 				   mpeg2dec->decoder.convert_id,
 				   &(mpeg2dec->sequence),
@@ -742,46 +847,59 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
 		y_size = decoder->stride_frame * mpeg2dec->sequence.height;
 		uv_size = y_size >> (2 - mpeg2dec->decoder.chroma_format);
 		mpeg2dec->yuv_buf[0][0] =
-		    (uint8_t *) mpeg2_malloc (y_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, y_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[0][1] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, uv_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[0][2] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, uv_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[1][0] =
-		    (uint8_t *) mpeg2_malloc (y_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, y_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[1][1] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, uv_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[1][2] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, uv_size,
+						  MPEG2_ALLOC_YUV);
+		/* B pictures are converted row by row as they are decoded */
 		y_size = decoder->stride_frame * 32;
 		uv_size = y_size >> (2 - mpeg2dec->decoder.chroma_format);
 		mpeg2dec->yuv_buf[2][0] =
-		    (uint8_t *) mpeg2_malloc (y_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, y_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[2][1] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, uv_size,
+						  MPEG2_ALLOC_YUV);
 		mpeg2dec->yuv_buf[2][2] =
-		    (uint8_t *) mpeg2_malloc (uv_size, MPEG2_ALLOC_YUV);
+		    (uint8_t *) mpeg2_malloc_dec (mpeg2dec, uv_size,
+						  MPEG2_ALLOC_YUV);
 	    }
 	    if (!mpeg2dec->custom_fbuf) {
-		while (mpeg2dec->alloc_index < 3) {
+		while (mpeg2dec->alloc_index < nb_fbufs) {
 		    mpeg2_fbuf_t * fbuf;
 
 		    fbuf = &mpeg2dec->fbuf_alloc[mpeg2dec->alloc_index++].fbuf;
 		    fbuf->id = NULL;
 		    fbuf->buf[0] =
-			(uint8_t *) mpeg2_malloc (convert_init.buf_size[0],
-						  MPEG2_ALLOC_CONVERTED);
+			(uint8_t *) mpeg2_malloc_dec (mpeg2dec,
+						      convert_init.buf_size[0],
+						      MPEG2_ALLOC_CONVERTED);
 		    fbuf->buf[1] =
-			(uint8_t *) mpeg2_malloc (convert_init.buf_size[1],
-						  MPEG2_ALLOC_CONVERTED);
+			(uint8_t *) mpeg2_malloc_dec (mpeg2dec,
+						      convert_init.buf_size[1],
+						      MPEG2_ALLOC_CONVERTED);
 		    fbuf->buf[2] =
-			(uint8_t *) mpeg2_malloc (convert_init.buf_size[2],
-						  MPEG2_ALLOC_CONVERTED);
+			(uint8_t *) mpeg2_malloc_dec (mpeg2dec,
+						      convert_init.buf_size[2],
+						      MPEG2_ALLOC_CONVERTED);
 		}
 		mpeg2_set_fbuf (mpeg2dec, (decoder->coding_type == B_TYPE));
 	    }
 	} else if (!mpeg2dec->custom_fbuf) {
-	    while (mpeg2dec->alloc_index < 3) {
+	    while (mpeg2dec->alloc_index < nb_fbufs) {
 		mpeg2_fbuf_t * fbuf;
 		int y_size, uv_size;
 
@@ -789,15 +907,19 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels)
 		fbuf->id = NULL;
 		y_size = decoder->stride_frame * mpeg2dec->sequence.height;
 		uv_size = y_size >> (2 - decoder->chroma_format);
-		fbuf->buf[0] = (uint8_t *) mpeg2_malloc (y_size,
-							 MPEG2_ALLOC_YUV);
-		fbuf->buf[1] = (uint8_t *) mpeg2_malloc (uv_size,
-							 MPEG2_ALLOC_YUV);
-		fbuf->buf[2] = (uint8_t *) mpeg2_malloc (uv_size,
-							 MPEG2_ALLOC_YUV);
+		fbuf->buf[0] = (uint8_t *)
+		    mpeg2_malloc_dec (mpeg2dec, y_size, MPEG2_ALLOC_YUV);
+		fbuf->buf[1] = (uint8_t *)
+		    mpeg2_malloc_dec (mpeg2dec, uv_size, MPEG2_ALLOC_YUV);
+		fbuf->buf[2] = (uint8_t *)
+		    mpeg2_malloc_dec (mpeg2dec, uv_size, MPEG2_ALLOC_YUV);
 	    }
 	    mpeg2_set_fbuf (mpeg2dec, (decoder->coding_type == B_TYPE));
 	}
+	if (mpeg2dec->info.display_picture == picture)
+	    mpeg2dec->frame_pending = 1;
+	else
+	    mpeg2_display_ready (mpeg2dec);
     } else {
 	decoder->second_field = 1;
 	mpeg2dec->picture++;	/* second field picture */
@@ -879,6 +1001,33 @@ static void prescale (mpeg2dec_t * mpeg2dec, int idx)
     }
 }
 
+static void macroblock_info (mpeg2dec_t * mpeg2dec)
+{
+    mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
+    unsigned int size;
+
+    size = (decoder->width >> 4) * (decoder->height >> 4);
+    if (size > mpeg2dec->macroblocks_size) {
+	mpeg2_free (mpeg2dec->macroblocks);
+	mpeg2dec->macroblocks = (mpeg2_macroblock_t *)
+	    mpeg2_malloc_dec (mpeg2dec, size * sizeof (mpeg2_macroblock_t),
+			      MPEG2_ALLOC_MPEG2DEC);
+	mpeg2dec->macroblocks_size = mpeg2dec->macroblocks ? size : 0;
+	if (mpeg2dec->macroblocks == NULL)
+	    return;
+    }
+
+    /* field pictures: the second field follows the rows of the first one */
+    if (!decoder->second_field || mpeg2dec->info.macroblocks == NULL)
+	memset (mpeg2dec->macroblocks, 0, size * sizeof (mpeg2_macroblock_t));
+    decoder->macroblocks = mpeg2dec->macroblocks;
+    if (decoder->second_field)
+	decoder->macroblocks += size >> 1;
+    decoder->record = 1;
+    decoder->parse_only = (mpeg2dec->macroblock_info == 2);
+    mpeg2dec->info.macroblocks = mpeg2dec->macroblocks;
+}
+
 mpeg2_state_t mpeg2_header_slice_start (mpeg2dec_t * mpeg2dec)
 {
     mpeg2_decoder_t * decoder = &(mpeg2dec->decoder);
@@ -899,6 +1048,19 @@ mpeg2_state_t mpeg2_header_slice_start (mpeg2dec_t * mpeg2dec)
 	}
     }
 
+    decoder->record = decoder->parse_only = 0;
+    if (mpeg2dec->macroblock_info && mpeg2dec->nb_decode_slices)
+	macroblock_info (mpeg2dec);
+
+    /* rows of a first field do not complete any line of the frame */
+    decoder->row_ready = NULL;
+    if (mpeg2dec->row_ready && mpeg2dec->state == STATE_SLICE &&
+	mpeg2dec->nb_decode_slices) {
+	decoder->row_ready = mpeg2dec->row_ready;
+	decoder->row_ready_arg = mpeg2dec->row_ready_arg;
+	decoder->row_fbuf = mpeg2dec->fbuf[0];
+    }
+
     if (!(mpeg2dec->nb_decode_slices))
 	mpeg2dec->picture->flags |= PIC_FLAG_SKIP;
     else if (mpeg2dec->convert_start) {
@@ -950,7 +1112,8 @@ mpeg2_state_t mpeg2_header_end (mpeg2dec_t * mpeg2dec)
 	picture = mpeg2dec->pictures + 2;
 
     mpeg2_reset_info (&(mpeg2dec->info));
-    if (!(mpeg2dec->sequence.flags & SEQ_FLAG_LOW_DELAY)) {
+    if (!(mpeg2dec->sequence.flags & SEQ_FLAG_LOW_DELAY) &&
+	!(mpeg2dec->low_latency > 1 && mpeg2dec->first)) {
 	mpeg2dec->info.display_picture = picture;
 	if (picture->nb_fields == 1)
 	    mpeg2dec->info.display_picture_2nd = picture + 1;
@@ -959,6 +1122,7 @@ mpeg2_state_t mpeg2_header_end (mpeg2dec_t * mpeg2dec)
 	    mpeg2dec->info.discard_fbuf = mpeg2dec->fbuf[b_type + 1];
     } else if (!mpeg2dec->convert)
 	mpeg2dec->info.discard_fbuf = mpeg2dec->fbuf[b_type];
+    mpeg2_display_ready (mpeg2dec);
     mpeg2dec->action = seek_sequence;
     return STATE_END;
 }
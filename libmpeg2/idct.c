@@ -66,7 +66,8 @@ do {					\
 } while (0)
 #endif
 
-static inline void idct_row (int16_t * const block)
+/* returns 0 if the output row is all zero */
+static inline int idct_row (int16_t * const block)
 {
     int d0, d1, d2, d3;
     int a0, a1, a2, a3, b0, b1, b2, b3;
@@ -76,12 +77,16 @@ static inline void idct_row (int16_t * const block)
     if (likely (!(block[1] | ((int32_t *)block)[1] | ((int32_t *)block)[2] |
 		  ((int32_t *)block)[3]))) {
 	uint32_t tmp = (uint16_t) (block[0] >> 1);
+	if (!tmp) {
+	    block[0] = 0;
+	    return 0;
+	}
 	tmp |= tmp << 16;
 	((int32_t *)block)[0] = tmp;
 	((int32_t *)block)[1] = tmp;
 	((int32_t *)block)[2] = tmp;
 	((int32_t *)block)[3] = tmp;
-	return;
+	return 1;
     }
 
     d0 = (block[0] << 11) + 2048;
@@ -117,6 +122,7 @@ static inline void idct_row (int16_t * const block)
     block[5] = (a2 - b2) >> 12;
     block[6] = (a1 - b1) >> 12;
     block[7] = (a0 - b0) >> 12;
+    return 1;
 }
 
 static inline void idct_col (int16_t * const block)
@@ -160,15 +166,121 @@ static inline void idct_col (int16_t * const block)
     block[8*7] = (a0 - b0) >> 17;
 }
 
+/* the sparse column variants drop terms whose inputs are all zero, */
+/* so they give exactly the same result as idct_col */
+
+/* only row 0 is non-zero */
+static inline void idct_col_dc (int16_t * const block)
+{
+    int val = ((block[8*0] << 11) + 65536) >> 17;
+
+    block[8*0] = val;
+    block[8*1] = val;
+    block[8*2] = val;
+    block[8*3] = val;
+    block[8*4] = val;
+    block[8*5] = val;
+    block[8*6] = val;
+    block[8*7] = val;
+}
+
+/* only the four lowest frequency rows are non-zero */
+static inline void idct_col_4 (int16_t * const block)
+{
+    int d0, d1;
+    int a0, a1, a2, a3, b0, b1, b2, b3;
+    int t0, t1, t2, t3;
+
+    d0 = (block[8*0] << 11) + 65536;
+    d1 = block[8*1];
+    t2 = W2 * d1;
+    t3 = W6 * d1;
+    a0 = d0 + t2;
+    a1 = d0 + t3;
+    a2 = d0 - t3;
+    a3 = d0 - t2;
+
+    d0 = block[8*4];
+    d1 = block[8*5];
+    b0 = W1 * d0 + W3 * d1;
+    b3 = W7 * d0 - W5 * d1;
+    t0 = W1 * d0 - W3 * d1;
+    t1 = W7 * d0 + W5 * d1;
+    b1 = ((t0 + t1) >> 8) * 181;
+    b2 = ((t0 - t1) >> 8) * 181;
+
+    block[8*0] = (a0 + b0) >> 17;
+    block[8*1] = (a1 + b1) >> 17;
+    block[8*2] = (a2 + b2) >> 17;
+    block[8*3] = (a3 + b3) >> 17;
+    block[8*4] = (a3 - b3) >> 17;
+    block[8*5] = (a2 - b2) >> 17;
+    block[8*6] = (a1 - b1) >> 17;
+    block[8*7] = (a0 - b0) >> 17;
+}
+
+/* only the even rows are non-zero */
+static inline void idct_col_even (int16_t * const block)
+{
+    int d0, d1, d2, d3;
+    int a0, a1, a2, a3;
+    int t0, t1, t2, t3;
+
+    d0 = (block[8*0] << 11) + 65536;
+    d1 = block[8*1];
+    d2 = block[8*2] << 11;
+    d3 = block[8*3];
+    t0 = d0 + d2;
+    t1 = d0 - d2;
+    BUTTERFLY (t2, t3, W6, W2, d3, d1);
+    a0 = t0 + t2;
+    a1 = t1 + t3;
+    a2 = t1 - t3;
+    a3 = t0 - t2;
+
+    block[8*0] = a0 >> 17;
+    block[8*1] = a1 >> 17;
+    block[8*2] = a2 >> 17;
+    block[8*3] = a3 >> 17;
+    block[8*4] = a3 >> 17;
+    block[8*5] = a2 >> 17;
+    block[8*6] = a1 >> 17;
+    block[8*7] = a0 >> 17;
+}
+
+/*
+ * Rows are stored in the order 0 2 4 6 1 3 5 7 (see the scan table
+ * patching in mpeg2_idct_init), so the occupancy mask built by the
+ * row pass directly tells which column variant can be used.
+ */
+static inline void idct (int16_t * const block)
+{
+    int i, rows;
+
+    rows = 0;
+    for (i = 0; i < 8; i++)
+	rows |= idct_row (block + 8 * i) << i;
+    if (!(rows & 0xfe))
+	for (i = 0; i < 8; i++)
+	    idct_col_dc (block + i);
+    else if (!(rows & 0xcc))
+	for (i = 0; i < 8; i++)
+	    idct_col_4 (block + i);
+    else if (!(rows & 0xf0))
+	for (i = 0; i < 8; i++)
+	    idct_col_even (block + i);
+    else
+	for (i = 0; i < 8; i++)
+	    idct_col (block + i);
+}
+
 static void mpeg2_idct_copy_c (int16_t * block, uint8_t * dest,
 			       const int stride)
 {
     int i;
 
-    for (i = 0; i < 8; i++)
-	idct_row (block + 8 * i);
-    for (i = 0; i < 8; i++)
-	idct_col (block + i);
+    idct (block);
+    i = 8;
     do {
 	dest[0] = CLIP (block[0]);
 	dest[1] = CLIP (block[1]);
@@ -193,10 +305,8 @@ static void mpeg2_idct_add_c (const int last, int16_t * block,
     int i;
 
     if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
-	for (i = 0; i < 8; i++)
-	    idct_row (block + 8 * i);
-	for (i = 0; i < 8; i++)
-	    idct_col (block + i);
+	idct (block);
+	i = 8;
 	do {
 	    dest[0] = CLIP (block[0] + dest[0]);
 	    dest[1] = CLIP (block[1] + dest[1]);
@@ -973,6 +973,57 @@ static inline void sse2_idct (int16_t * const block)
     sse2_idct_col (block);
 }
 
+/*
+ * When rows 1 to 7 are zero, the row pass turns them into constant rows
+ * (1 for rows 1 and 2, 0 for the others, from the rounders), and the
+ * column pass then reduces to a few saturated adds around row 0.
+ * Outputs are stored over rows 0 to 3 of the block: y0, y1 (also y2 y5
+ * y6), y3 (also y4) and y7, as nothing keeps registers alive from one
+ * asm statement to the next.
+ */
+static inline void sse2_idct_row0 (int16_t * const block)
+{
+    static const int16_t table04[] ATTR_ALIGN(16) =
+	sse2_table (22725, 21407, 19266, 16384, 12873,  8867, 4520);
+    static const int32_t rounder0_128[] ATTR_ALIGN(16) =
+	rounder_sse2 ((1 << (COL_SHIFT - 1)) - 0.5);
+    static const int32_t rounder4_128[] ATTR_ALIGN(16) = rounder_sse2 (0);
+    static const short one_vector[] ATTR_ALIGN(16) = {1,1,1,1,1,1,1,1};
+
+    movdqa_m2r (block[0*8], xmm0);
+    pxor_r2r (xmm4, xmm4);
+    SSE2_IDCT_2ROW (table04, xmm0, xmm4, *rounder0_128, *rounder4_128);
+
+    movdqa_m2r (*one_vector, xmm1);	/* xmm1 = x1 = x2 = u17 = u26 = b0 */
+    movdqa_r2r (xmm0, xmm4);		/* xmm4 = x0 = a1 = a2 */
+    paddsw_r2r (xmm1, xmm4);		/* xmm4 = a0 */
+    movdqa_r2r (xmm0, xmm6);
+    psubsw_r2r (xmm1, xmm6);		/* xmm6 = a3 = a3+b3 = a3-b3 */
+    movdqa_r2r (xmm4, xmm7);
+    paddsw_r2r (xmm1, xmm4);		/* xmm4 = a0+b0 */
+    psubsw_r2r (xmm1, xmm7);		/* xmm7 = a0-b0 */
+    movdqa_r2r (xmm0, xmm5);		/* xmm5 = a1+b1 = a2+b2 ... */
+    psraw_i2r (COL_SHIFT, xmm4);	/* xmm4 = y0 */
+    psraw_i2r (COL_SHIFT, xmm5);	/* xmm5 = y1 y2 y5 y6 */
+    psraw_i2r (COL_SHIFT, xmm6);	/* xmm6 = y3 y4 */
+    psraw_i2r (COL_SHIFT, xmm7);	/* xmm7 = y7 */
+    movdqa_r2m (xmm4, block[0*8]);
+    movdqa_r2m (xmm5, block[1*8]);
+    movdqa_r2m (xmm6, block[2*8]);
+    movdqa_r2m (xmm7, block[3*8]);
+}
+
+static inline int rows_zero (const int16_t * const block)
+{
+    const int32_t * const row = (const int32_t *) block;
+
+    return !(row[4] | row[5] | row[6] | row[7] | row[8] | row[9] |
+	     row[10] | row[11] | row[12] | row[13] | row[14] | row[15] |
+	     row[16] | row[17] | row[18] | row[19] | row[20] | row[21] |
+	     row[22] | row[23] | row[24] | row[25] | row[26] | row[27] |
+	     row[28] | row[29] | row[30] | row[31]);
+}
+
 static void sse2_block_copy (int16_t * const block, uint8_t * dest,
 			     const int stride)
 {
@@ -1125,6 +1176,46 @@ static inline void block_add (int16_t * const block, uint8_t * dest,
 }
 
 
+static inline void sse2_block_copy_row0 (int16_t * const block,
+					 uint8_t * dest, const int stride)
+{
+    movdqa_m2r (*(block+0*8), xmm4);
+    movdqa_m2r (*(block+1*8), xmm5);
+    movdqa_m2r (*(block+2*8), xmm6);
+    movdqa_m2r (*(block+3*8), xmm7);
+    packuswb_r2r (xmm4, xmm4);
+    packuswb_r2r (xmm5, xmm5);
+    packuswb_r2r (xmm6, xmm6);
+    packuswb_r2r (xmm7, xmm7);
+    movq_r2m (xmm4, *(dest+0*stride));
+    movq_r2m (xmm5, *(dest+1*stride));
+    movq_r2m (xmm5, *(dest+2*stride));
+    movq_r2m (xmm6, *(dest+3*stride));
+    movq_r2m (xmm6, *(dest+4*stride));
+    movq_r2m (xmm5, *(dest+5*stride));
+    movq_r2m (xmm5, *(dest+6*stride));
+    movq_r2m (xmm7, *(dest+7*stride));
+}
+
+static inline void sse2_block_add_row0 (int16_t * const block,
+					uint8_t * dest, const int stride)
+{
+    pxor_r2r (xmm0, xmm0);
+    ADD_SSE2_2ROW (m2r, *(block+0*8), *(block+1*8));
+    ADD_SSE2_2ROW (m2r, *(block+1*8), *(block+2*8));
+    ADD_SSE2_2ROW (m2r, *(block+2*8), *(block+1*8));
+    ADD_SSE2_2ROW (m2r, *(block+1*8), *(block+3*8));
+}
+
+static inline void sse2_block_zero_row0 (int16_t * const block)
+{
+    pxor_r2r (xmm0, xmm0);
+    movdqa_r2m (xmm0, *(block+0*8));
+    movdqa_r2m (xmm0, *(block+1*8));
+    movdqa_r2m (xmm0, *(block+2*8));
+    movdqa_r2m (xmm0, *(block+3*8));
+}
+
 static inline void sse2_block_zero (int16_t * const block)
 {
     pxor_r2r (xmm0, xmm0);
@@ -1225,6 +1316,12 @@ static inline void block_add_DC (int16_t * const block, uint8_t * dest,
 void mpeg2_idct_copy_sse2 (int16_t * const block, uint8_t * const dest,
 			   const int stride)
 {
+    if (rows_zero (block)) {
+	sse2_idct_row0 (block);
+	sse2_block_copy_row0 (block, dest, stride);
+	sse2_block_zero_row0 (block);
+	return;
+    }
     sse2_idct (block);
     sse2_block_copy (block, dest, stride);
     sse2_block_zero (block);
@@ -1234,6 +1331,12 @@ void mpeg2_idct_add_sse2 (const int last, int16_t * const block,
 			  uint8_t * const dest, const int stride)
 {
     if (last != 129 || (block[0] & (7 << 4)) == (4 << 4)) {
+	if (rows_zero (block)) {
+	    sse2_idct_row0 (block);
+	    sse2_block_add_row0 (block, dest, stride);
+	    sse2_block_zero_row0 (block);
+	    return;
+	}
 	sse2_idct (block);
 	sse2_block_add (block, dest, stride);
 	sse2_block_zero (block);
@@ -64,6 +64,26 @@ typedef void motion_parser_t (mpeg2_decoder_t * decoder,
 			      motion_t * motion,
 			      mpeg2_mc_fct * const * table);
 
+/* two pass mode: reconstruction work recorded by the slice parser */
+#define RECON_OPS 512
+#define RECON_COEFS 8192
+
+typedef struct {
+    mpeg2_mc_fct * mc;		/* NULL for an idct block */
+    uint8_t * dest;
+    const uint8_t * ref;
+    int stride;
+    int size;			/* mc height, or idct last (-1 for intra) */
+    int coefs;			/* number of idct coefficients */
+} recon_op_t;
+
+typedef struct {
+    int ops;
+    int coefs;
+    recon_op_t op[RECON_OPS];
+    uint32_t coef[RECON_COEFS];	/* position << 16 | value */
+} recon_t;
+
 struct mpeg2_decoder_s {
     /* first, state that carries information from one macroblock to the */
     /* next inside a slice, and is never used outside of mpeg2_slice() */
@@ -93,6 +113,10 @@ struct mpeg2_decoder_s {
     motion_t f_motion;
     motion_parser_t * motion_parser[5];
 
+    /* slice loop, specialized on the picture parameters when possible */
+    void (* slice_loop) (mpeg2_decoder_t * decoder, int code,
+			 const uint8_t * buffer);
+
     /* predictor for DC coefficients in intra blocks */
     int16_t dc_dct_pred[3];
 
@@ -104,15 +128,33 @@ struct mpeg2_decoder_s {
 		      unsigned int v_offset);
     void * convert_id;
 
+    /* row progress of the current picture, see mpeg2_row_callback */
+    mpeg2_row_ready_t * row_ready;
+    void * row_ready_arg;
+    const mpeg2_fbuf_t * row_fbuf;
+
     int dmv_offset;
     unsigned int v_offset;
 
+    /* end of the data used by the last macroblock of the field */
+    const uint8_t * picture_end;
+
+    /* reconstruction queue, used when deferred is set */
+    recon_t * recon;
+    int two_pass;
+    int deferred;
+
+    /* macroblock side data of the current field, used when record is set */
+    mpeg2_macroblock_t * macroblocks;
+    int record;
+    int parse_only;
+
     /* now non-slice-specific information */
 
     /* sequence header stuff */
     uint16_t * quantizer_matrix[4];
     uint16_t (* chroma_quantizer[2])[64];
-    uint16_t quantizer_prescale[4][32][64];
+    uint16_t (* quantizer_prescale[4])[64];	/* chroma ones only if used */
 
     /* The width and height of the picture snapped to macroblock units */
     int width;
@@ -158,6 +200,9 @@ typedef struct {
     mpeg2_fbuf_t fbuf;
 } fbuf_alloc_t;
 
+/* alloc_stats index of the sum over all mpeg2_alloc_t reasons */
+#define MPEG2_ALLOC_TOTAL (MPEG2_ALLOC_CONVERTED + 1)
+
 struct mpeg2dec_s {
     mpeg2_decoder_t decoder;
 
@@ -171,6 +216,8 @@ struct mpeg2dec_s {
 
     /* allocated in init - gcc has problems allocating such big structures */
     uint8_t * chunk_buffer;
+    unsigned int chunk_size;	/* grows as needed in compact mode */
+    int compact;
     /* pointer to start of the current chunk */
     uint8_t * chunk_start;
     /* pointer to current position in chunk_buffer */
@@ -213,6 +260,42 @@ struct mpeg2dec_s {
 			    const mpeg2_picture_t * picture,
 			    const mpeg2_gop_t * gop);
 
+    /* frames are also reported through this, when set */
+    mpeg2_frame_ready_t * frame_ready;
+    void * frame_ready_arg;
+    int frame_pending;	/* display_fbuf is still being decoded */
+    mpeg2_field_ready_t * field_ready;
+    void * field_ready_arg;
+    unsigned int fields_sent;	/* fields of display_fbuf already reported */
+    mpeg2_row_ready_t * row_ready;
+    void * row_ready_arg;
+
+    /* late B pictures, see mpeg2_deadline */
+    mpeg2_late_t * late;
+    void * late_arg;
+    uint8_t late_decode_slices;	/* nb_decode_slices after it */
+
+    /* low latency mode, see mpeg2_low_latency */
+    int low_latency;
+    int low_delay;	/* current picture is displayed without reordering */
+    int b_pictures;	/* a B picture was seen since the last restart */
+    int inter_pictures;	/* same for P and B pictures, see intra only */
+    int intra_fbufs;	/* see mpeg2_intra_fbufs */
+
+    /* picture user data, kept until display by mpeg2_extract_user_data */
+    uint8_t * picture_user_data[4];
+    unsigned int picture_user_data_len[4];
+    unsigned int picture_user_data_size[4];
+
+    /* macroblock side data, see mpeg2_macroblock_info */
+    int macroblock_info;
+    mpeg2_macroblock_t * macroblocks;
+    unsigned int macroblocks_size;
+
+    /* buffers held by this decoder, by mpeg2_alloc_t then in total */
+    /* not atomic: only the thread using the decoder may allocate */
+    mpeg2_alloc_stats_t alloc_stats[MPEG2_ALLOC_TOTAL + 1];
+
     uint8_t * buf_start;
     uint8_t * buf_end;
 
@@ -232,6 +315,10 @@ typedef struct {
     int dummy;
 } cpu_state_t;
 
+/* alloc.c */
+void * mpeg2_malloc_dec (mpeg2dec_t * mpeg2dec, unsigned size,
+			 mpeg2_alloc_t reason);
+
 /* cpu_accel.c */
 uint32_t mpeg2_detect_accel (uint32_t accel);
 
@@ -257,6 +344,11 @@ void mpeg2_header_picture_finalize (mpeg2dec_t * mpeg2dec, uint32_t accels);
 mpeg2_state_t mpeg2_header_slice_start (mpeg2dec_t * mpeg2dec);
 mpeg2_state_t mpeg2_header_end (mpeg2dec_t * mpeg2dec);
 void mpeg2_set_fbuf (mpeg2dec_t * mpeg2dec, int b_type);
+void mpeg2_display_ready (mpeg2dec_t * mpeg2dec);
+void mpeg2_first_field_ready (mpeg2dec_t * mpeg2dec);
+
+/* slice.c */
+void mpeg2_conceal (mpeg2_decoder_t * decoder, int code, int end);
 
 /* idct.c */
 extern void mpeg2_idct_init (uint32_t accel);
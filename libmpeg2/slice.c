@@ -24,6 +24,8 @@
 
 #include "config.h"
 
+#include <stdlib.h>	/* defines NULL */
+#include <string.h>	/* memcpy */
 #include <inttypes.h>
 
 #include "mpeg2.h"
@@ -39,7 +41,18 @@ extern void (* mpeg2_cpu_state_restore) (cpu_state_t * state);
 
 #include "vlc.h"
 
-static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder)
+static inline void bitstream_init (mpeg2_decoder_t * decoder,
+				   const uint8_t * start)
+{
+    decoder->bitstream_buf =
+	(start[0] << 24) | (start[1] << 16) | (start[2] << 8) | start[3];
+    decoder->bitstream_ptr = start + 4;
+    decoder->bitstream_bits = -16;
+}
+
+static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder,
+					const int coding_type,
+					const int frame_picture)
 {
 #define bit_buf (decoder->bitstream_buf)
 #define bits (decoder->bitstream_bits)
@@ -47,15 +60,14 @@ static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder)
     int macroblock_modes;
     const MBtab * tab;
 
-    switch (decoder->coding_type) {
+    switch (coding_type) {
     case I_TYPE:
 
 	tab = MB_I + UBITS (bit_buf, 1);
 	DUMPBITS (bit_buf, bits, tab->len);
 	macroblock_modes = tab->modes;
 
-	if ((! (decoder->frame_pred_frame_dct)) &&
-	    (decoder->picture_structure == FRAME_PICTURE)) {
+	if ((! (decoder->frame_pred_frame_dct)) && frame_picture) {
 	    macroblock_modes |= UBITS (bit_buf, 1) * DCT_TYPE_INTERLACED;
 	    DUMPBITS (bit_buf, bits, 1);
 	}
@@ -68,7 +80,7 @@ static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder)
 	DUMPBITS (bit_buf, bits, tab->len);
 	macroblock_modes = tab->modes;
 
-	if (decoder->picture_structure != FRAME_PICTURE) {
+	if (!frame_picture) {
 	    if (macroblock_modes & MACROBLOCK_MOTION_FORWARD) {
 		macroblock_modes |= UBITS (bit_buf, 2) << MOTION_TYPE_SHIFT;
 		DUMPBITS (bit_buf, bits, 2);
@@ -96,7 +108,7 @@ static inline int get_macroblock_modes (mpeg2_decoder_t * const decoder)
 	DUMPBITS (bit_buf, bits, tab->len);
 	macroblock_modes = tab->modes;
 
-	if (decoder->picture_structure != FRAME_PICTURE) {
+	if (!frame_picture) {
 	    if (! (macroblock_modes & MACROBLOCK_INTRA)) {
 		macroblock_modes |= UBITS (bit_buf, 2) << MOTION_TYPE_SHIFT;
 		DUMPBITS (bit_buf, bits, 2);
@@ -928,8 +940,86 @@ static int get_mpeg1_non_intra_block (mpeg2_decoder_t * const decoder)
     return i;
 }
 
+/* in parse only mode nothing is queued, the blocks are just cleared */
+static void recon_flush (mpeg2_decoder_t * const decoder)
+{
+    recon_t * const recon = decoder->recon;
+    const recon_op_t * op;
+    const recon_op_t * end;
+    const uint32_t * coef;
+    int i;
+
+    if (decoder->parse_only)
+	return;
+    end = recon->op + recon->ops;
+    coef = recon->coef;
+    for (op = recon->op; op < end; op++)
+	if (op->mc)
+	    op->mc (op->dest, op->ref, op->stride, op->size);
+	else {
+	    for (i = op->coefs; i; i--, coef++)
+		decoder->DCTblock[*coef >> 16] = (int16_t) *coef;
+	    if (op->size < 0)
+		mpeg2_idct_copy (decoder->DCTblock, op->dest, op->stride);
+	    else
+		mpeg2_idct_add (op->size, decoder->DCTblock,
+				op->dest, op->stride);
+	}
+    recon->ops = recon->coefs = 0;
+}
+
+static void recon_mc (mpeg2_decoder_t * const decoder,
+		      mpeg2_mc_fct * const mc, uint8_t * const dest,
+		      const uint8_t * const ref, const int stride,
+		      const int size)
+{
+    recon_t * const recon = decoder->recon;
+    recon_op_t * op;
+
+    if (decoder->parse_only)
+	return;
+    if (recon->ops == RECON_OPS)
+	recon_flush (decoder);
+    op = recon->op + recon->ops++;
+    op->mc = mc;
+    op->dest = dest;
+    op->ref = ref;
+    op->stride = stride;
+    op->size = size;
+}
+
+static void recon_block (mpeg2_decoder_t * const decoder, const int last,
+			 uint8_t * const dest, const int stride)
+{
+    recon_t * const recon = decoder->recon;
+    int16_t * const block = decoder->DCTblock;
+    recon_op_t * op;
+    uint32_t * coef;
+    int i;
+
+    if (decoder->parse_only) {
+	memset (block, 0, 64 * sizeof (int16_t));
+	return;
+    }
+    if (recon->ops == RECON_OPS || recon->coefs > RECON_COEFS - 64)
+	recon_flush (decoder);
+    coef = recon->coef + recon->coefs;
+    for (i = 0; i < 64; i++)
+	if (block[i]) {
+	    *coef++ = (i << 16) | (uint16_t) block[i];
+	    block[i] = 0;
+	}
+    op = recon->op + recon->ops++;
+    op->mc = NULL;
+    op->dest = dest;
+    op->stride = stride;
+    op->size = last;
+    op->coefs = coef - (recon->coef + recon->coefs);
+    recon->coefs += op->coefs;
+}
+
 static inline void slice_intra_DCT (mpeg2_decoder_t * const decoder,
-				    const int cc,
+				    const int vlc, const int cc,
 				    uint8_t * const dest, const int stride)
 {
 #define bit_buf (decoder->bitstream_buf)
@@ -944,33 +1034,41 @@ static inline void slice_intra_DCT (mpeg2_decoder_t * const decoder,
 	decoder->DCTblock[0] =
 	    decoder->dc_dct_pred[cc] += get_chroma_dc_dct_diff (decoder);
 
-    if (decoder->mpeg1) {
+    if (vlc == 0) {
 	if (decoder->coding_type != D_TYPE)
 	    get_mpeg1_intra_block (decoder);
-    } else if (decoder->intra_vlc_format)
+    } else if (vlc == 2)
 	get_intra_block_B15 (decoder, decoder->quantizer_matrix[cc ? 2 : 0]);
     else
 	get_intra_block_B14 (decoder, decoder->quantizer_matrix[cc ? 2 : 0]);
-    mpeg2_idct_copy (decoder->DCTblock, dest, stride);
+    if (decoder->deferred)
+	recon_block (decoder, -1, dest, stride);
+    else
+	mpeg2_idct_copy (decoder->DCTblock, dest, stride);
 #undef bit_buf
 #undef bits
 #undef bit_ptr
 }
 
 static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
-					const int cc,
+					const int mpeg1, const int cc,
 					uint8_t * const dest, const int stride)
 {
     int last;
 
-    if (decoder->mpeg1)
+    if (mpeg1)
 	last = get_mpeg1_non_intra_block (decoder);
     else
 	last = get_non_intra_block (decoder,
 				    decoder->quantizer_matrix[cc ? 3 : 1]);
-    mpeg2_idct_add (last, decoder->DCTblock, dest, stride);
+    if (decoder->deferred)
+	recon_block (decoder, last, dest, stride);
+    else
+	mpeg2_idct_add (last, decoder->DCTblock, dest, stride);
 }
 
+#define MC(mc,dest,ref,stride,size) mc (dest, ref, stride, size)
+
 #define MOTION_420(table,ref,motion_x,motion_y,size,y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
     pos_y = 2 * decoder->v_offset + motion_y + 2 * y;			      \
@@ -983,20 +1081,21 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
 	motion_y = pos_y - 2 * decoder->v_offset - 2 * y;		      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    table[xy_half] (decoder->dest[0] + y * decoder->stride + decoder->offset, \
-		    ref[0] + (pos_x >> 1) + (pos_y >> 1) * decoder->stride,   \
-		    decoder->stride, size);				      \
+    MC (table[xy_half],							      \
+	decoder->dest[0] + y * decoder->stride + decoder->offset,	      \
+	ref[0] + (pos_x >> 1) + (pos_y >> 1) * decoder->stride,		      \
+	decoder->stride, size);						      \
     motion_x /= 2;	motion_y /= 2;					      \
     xy_half = ((motion_y & 1) << 1) | (motion_x & 1);			      \
     offset = (((decoder->offset + motion_x) >> 1) +			      \
 	      ((((decoder->v_offset + motion_y) >> 1) + y/2) *		      \
 	       decoder->uv_stride));					      \
-    table[4+xy_half] (decoder->dest[1] + y/2 * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      decoder->uv_stride, size/2);			      \
-    table[4+xy_half] (decoder->dest[2] + y/2 * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      decoder->uv_stride, size/2)
+    MC (table[4+xy_half], decoder->dest[1] + y/2 * decoder->uv_stride +	      \
+			  (decoder->offset >> 1), ref[1] + offset,	      \
+			  decoder->uv_stride, size/2);			      \
+    MC (table[4+xy_half], decoder->dest[2] + y/2 * decoder->uv_stride +	      \
+			  (decoder->offset >> 1), ref[2] + offset,	      \
+			  decoder->uv_stride, size/2)
 
 #define MOTION_FIELD_420(table,ref,motion_x,motion_y,dest_field,op,src_field) \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1010,22 +1109,24 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
 	motion_y = pos_y - decoder->v_offset;				      \
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
-    table[xy_half] (decoder->dest[0] + dest_field * decoder->stride +	      \
-		    decoder->offset,					      \
-		    (ref[0] + (pos_x >> 1) +				      \
-		     ((pos_y op) + src_field) * decoder->stride),	      \
-		    2 * decoder->stride, 8);				      \
+    MC (table[xy_half], decoder->dest[0] + dest_field * decoder->stride +     \
+			decoder->offset,				      \
+			(ref[0] + (pos_x >> 1) +			      \
+			 ((pos_y op) + src_field) * decoder->stride),	      \
+			2 * decoder->stride, 8);			      \
     motion_x /= 2;	motion_y /= 2;					      \
     xy_half = ((motion_y & 1) << 1) | (motion_x & 1);			      \
     offset = (((decoder->offset + motion_x) >> 1) +			      \
 	      (((decoder->v_offset >> 1) + (motion_y op) + src_field) *	      \
 	       decoder->uv_stride));					      \
-    table[4+xy_half] (decoder->dest[1] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      2 * decoder->uv_stride, 4);			      \
-    table[4+xy_half] (decoder->dest[2] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      2 * decoder->uv_stride, 4)
+    MC (table[4+xy_half],						      \
+	decoder->dest[1] + dest_field * decoder->uv_stride +		      \
+	(decoder->offset >> 1), ref[1] + offset,			      \
+	2 * decoder->uv_stride, 4);					      \
+    MC (table[4+xy_half],						      \
+	decoder->dest[2] + dest_field * decoder->uv_stride +		      \
+	(decoder->offset >> 1), ref[2] + offset,			      \
+	2 * decoder->uv_stride, 4)
 
 #define MOTION_DMV_420(table,ref,motion_x,motion_y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1040,39 +1141,40 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + (pos_y & ~1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + decoder->offset,			      \
-		    ref[0] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[0] + decoder->stride + decoder->offset,     \
-		    ref[0] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
+    MC (table[xy_half], decoder->dest[0] + decoder->offset,		      \
+			ref[0] + offset, 2 * decoder->stride, 8);	      \
+    MC (table[xy_half], decoder->dest[0] + decoder->stride + decoder->offset, \
+			ref[0] + decoder->stride + offset,		      \
+			2 * decoder->stride, 8);			      \
     motion_x /= 2;	motion_y /= 2;					      \
     xy_half = ((motion_y & 1) << 1) | (motion_x & 1);			      \
     offset = (((decoder->offset + motion_x) >> 1) +			      \
 	      (((decoder->v_offset >> 1) + (motion_y & ~1)) *		      \
 	       decoder->uv_stride));					      \
-    table[4+xy_half] (decoder->dest[1] + (decoder->offset >> 1),	      \
-		      ref[1] + offset, 2 * decoder->uv_stride, 4);	      \
-    table[4+xy_half] (decoder->dest[1] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[1] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 4);			      \
-    table[4+xy_half] (decoder->dest[2] + (decoder->offset >> 1),	      \
-		      ref[2] + offset, 2 * decoder->uv_stride, 4);	      \
-    table[4+xy_half] (decoder->dest[2] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[2] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 4)
+    MC (table[4+xy_half], decoder->dest[1] + (decoder->offset >> 1),	      \
+			  ref[1] + offset, 2 * decoder->uv_stride, 4);	      \
+    MC (table[4+xy_half], decoder->dest[1] + decoder->uv_stride +	      \
+			  (decoder->offset >> 1),			      \
+			  ref[1] + decoder->uv_stride + offset,		      \
+			  2 * decoder->uv_stride, 4);			      \
+    MC (table[4+xy_half], decoder->dest[2] + (decoder->offset >> 1),	      \
+			  ref[2] + offset, 2 * decoder->uv_stride, 4);	      \
+    MC (table[4+xy_half], decoder->dest[2] + decoder->uv_stride +	      \
+			  (decoder->offset >> 1),			      \
+			  ref[2] + decoder->uv_stride + offset,		      \
+			  2 * decoder->uv_stride, 4)
 
 #define MOTION_ZERO_420(table,ref)					      \
-    table[0] (decoder->dest[0] + decoder->offset,			      \
-	      (ref[0] + decoder->offset +				      \
-	       decoder->v_offset * decoder->stride), decoder->stride, 16);    \
+    MC (table[0],							      \
+	decoder->dest[0] + decoder->offset,				      \
+	(ref[0] + decoder->offset +					      \
+	 decoder->v_offset * decoder->stride), decoder->stride, 16);	      \
     offset = ((decoder->offset >> 1) +					      \
 	      (decoder->v_offset >> 1) * decoder->uv_stride);		      \
-    table[4] (decoder->dest[1] + (decoder->offset >> 1),		      \
-	      ref[1] + offset, decoder->uv_stride, 8);			      \
-    table[4] (decoder->dest[2] + (decoder->offset >> 1),		      \
-	      ref[2] + offset, decoder->uv_stride, 8)
+    MC (table[4], decoder->dest[1] + (decoder->offset >> 1),		      \
+		  ref[1] + offset, decoder->uv_stride, 8);		      \
+    MC (table[4], decoder->dest[2] + (decoder->offset >> 1),		      \
+		  ref[2] + offset, decoder->uv_stride, 8)
 
 #define MOTION_422(table,ref,motion_x,motion_y,size,y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1087,17 +1189,18 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + (pos_y >> 1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + y * decoder->stride + decoder->offset, \
-		    ref[0] + offset, decoder->stride, size);		      \
+    MC (table[xy_half],							      \
+	decoder->dest[0] + y * decoder->stride + decoder->offset,	      \
+	ref[0] + offset, decoder->stride, size);			      \
     offset = (offset + (motion_x & (motion_x < 0))) >> 1;		      \
     motion_x /= 2;							      \
     xy_half = ((pos_y & 1) << 1) | (motion_x & 1);			      \
-    table[4+xy_half] (decoder->dest[1] + y * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      decoder->uv_stride, size);			      \
-    table[4+xy_half] (decoder->dest[2] + y * decoder->uv_stride +	      \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      decoder->uv_stride, size)
+    MC (table[4+xy_half], decoder->dest[1] + y * decoder->uv_stride +	      \
+			  (decoder->offset >> 1), ref[1] + offset,	      \
+			  decoder->uv_stride, size);			      \
+    MC (table[4+xy_half], decoder->dest[2] + y * decoder->uv_stride +	      \
+			  (decoder->offset >> 1), ref[2] + offset,	      \
+			  decoder->uv_stride, size)
 
 #define MOTION_FIELD_422(table,ref,motion_x,motion_y,dest_field,op,src_field) \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1112,18 +1215,20 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + ((pos_y op) + src_field) * decoder->stride;	      \
-    table[xy_half] (decoder->dest[0] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[0] + offset,			      \
-		    2 * decoder->stride, 8);				      \
+    MC (table[xy_half], decoder->dest[0] + dest_field * decoder->stride +     \
+			decoder->offset, ref[0] + offset,		      \
+			2 * decoder->stride, 8);			      \
     offset = (offset + (motion_x & (motion_x < 0))) >> 1;		      \
     motion_x /= 2;							      \
     xy_half = ((pos_y & 1) << 1) | (motion_x & 1);			      \
-    table[4+xy_half] (decoder->dest[1] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[1] + offset,		      \
-		      2 * decoder->uv_stride, 8);			      \
-    table[4+xy_half] (decoder->dest[2] + dest_field * decoder->uv_stride +    \
-		      (decoder->offset >> 1), ref[2] + offset,		      \
-		      2 * decoder->uv_stride, 8)
+    MC (table[4+xy_half],						      \
+	decoder->dest[1] + dest_field * decoder->uv_stride +		      \
+	(decoder->offset >> 1), ref[1] + offset,			      \
+	2 * decoder->uv_stride, 8);					      \
+    MC (table[4+xy_half],						      \
+	decoder->dest[2] + dest_field * decoder->uv_stride +		      \
+	(decoder->offset >> 1), ref[2] + offset,			      \
+	2 * decoder->uv_stride, 8)
 
 #define MOTION_DMV_422(table,ref,motion_x,motion_y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1138,36 +1243,36 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + (pos_y & ~1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + decoder->offset,			      \
-		    ref[0] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[0] + decoder->stride + decoder->offset,     \
-		    ref[0] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
+    MC (table[xy_half], decoder->dest[0] + decoder->offset,		      \
+			ref[0] + offset, 2 * decoder->stride, 8);	      \
+    MC (table[xy_half], decoder->dest[0] + decoder->stride + decoder->offset, \
+			ref[0] + decoder->stride + offset,		      \
+			2 * decoder->stride, 8);			      \
     offset = (offset + (motion_x & (motion_x < 0))) >> 1;		      \
     motion_x /= 2;							      \
     xy_half = ((pos_y & 1) << 1) | (motion_x & 1);			      \
-    table[4+xy_half] (decoder->dest[1] + (decoder->offset >> 1),	      \
-		      ref[1] + offset, 2 * decoder->uv_stride, 8);	      \
-    table[4+xy_half] (decoder->dest[1] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[1] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 8);			      \
-    table[4+xy_half] (decoder->dest[2] + (decoder->offset >> 1),	      \
-		      ref[2] + offset, 2 * decoder->uv_stride, 8);	      \
-    table[4+xy_half] (decoder->dest[2] + decoder->uv_stride +		      \
-		      (decoder->offset >> 1),				      \
-		      ref[2] + decoder->uv_stride + offset,		      \
-		      2 * decoder->uv_stride, 8)
+    MC (table[4+xy_half], decoder->dest[1] + (decoder->offset >> 1),	      \
+			  ref[1] + offset, 2 * decoder->uv_stride, 8);	      \
+    MC (table[4+xy_half], decoder->dest[1] + decoder->uv_stride +	      \
+			  (decoder->offset >> 1),			      \
+			  ref[1] + decoder->uv_stride + offset,		      \
+			  2 * decoder->uv_stride, 8);			      \
+    MC (table[4+xy_half], decoder->dest[2] + (decoder->offset >> 1),	      \
+			  ref[2] + offset, 2 * decoder->uv_stride, 8);	      \
+    MC (table[4+xy_half], decoder->dest[2] + decoder->uv_stride +	      \
+			  (decoder->offset >> 1),			      \
+			  ref[2] + decoder->uv_stride + offset,		      \
+			  2 * decoder->uv_stride, 8)
 
 #define MOTION_ZERO_422(table,ref)					      \
     offset = decoder->offset + decoder->v_offset * decoder->stride;	      \
-    table[0] (decoder->dest[0] + decoder->offset,			      \
-	      ref[0] + offset, decoder->stride, 16);			      \
+    MC (table[0], decoder->dest[0] + decoder->offset,			      \
+		  ref[0] + offset, decoder->stride, 16);		      \
     offset >>= 1;							      \
-    table[4] (decoder->dest[1] + (decoder->offset >> 1),		      \
-	      ref[1] + offset, decoder->uv_stride, 16);			      \
-    table[4] (decoder->dest[2] + (decoder->offset >> 1),		      \
-	      ref[2] + offset, decoder->uv_stride, 16)
+    MC (table[4], decoder->dest[1] + (decoder->offset >> 1),		      \
+		  ref[1] + offset, decoder->uv_stride, 16);		      \
+    MC (table[4], decoder->dest[2] + (decoder->offset >> 1),		      \
+		  ref[2] + offset, decoder->uv_stride, 16)
 
 #define MOTION_444(table,ref,motion_x,motion_y,size,y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1182,12 +1287,15 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + (pos_y >> 1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + y * decoder->stride + decoder->offset, \
-		    ref[0] + offset, decoder->stride, size);		      \
-    table[xy_half] (decoder->dest[1] + y * decoder->stride + decoder->offset, \
-		    ref[1] + offset, decoder->stride, size);		      \
-    table[xy_half] (decoder->dest[2] + y * decoder->stride + decoder->offset, \
-		    ref[2] + offset, decoder->stride, size)
+    MC (table[xy_half],							      \
+	decoder->dest[0] + y * decoder->stride + decoder->offset,	      \
+	ref[0] + offset, decoder->stride, size);			      \
+    MC (table[xy_half],							      \
+	decoder->dest[1] + y * decoder->stride + decoder->offset,	      \
+	ref[1] + offset, decoder->stride, size);			      \
+    MC (table[xy_half],							      \
+	decoder->dest[2] + y * decoder->stride + decoder->offset,	      \
+	ref[2] + offset, decoder->stride, size)
 
 #define MOTION_FIELD_444(table,ref,motion_x,motion_y,dest_field,op,src_field) \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1202,15 +1310,15 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + ((pos_y op) + src_field) * decoder->stride;	      \
-    table[xy_half] (decoder->dest[0] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[0] + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[1] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[1] + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[2] + dest_field * decoder->stride +	      \
-		    decoder->offset, ref[2] + offset,			      \
-		    2 * decoder->stride, 8)
+    MC (table[xy_half], decoder->dest[0] + dest_field * decoder->stride +     \
+			decoder->offset, ref[0] + offset,		      \
+			2 * decoder->stride, 8);			      \
+    MC (table[xy_half], decoder->dest[1] + dest_field * decoder->stride +     \
+			decoder->offset, ref[1] + offset,		      \
+			2 * decoder->stride, 8);			      \
+    MC (table[xy_half], decoder->dest[2] + dest_field * decoder->stride +     \
+			decoder->offset, ref[2] + offset,		      \
+			2 * decoder->stride, 8)
 
 #define MOTION_DMV_444(table,ref,motion_x,motion_y)			      \
     pos_x = 2 * decoder->offset + motion_x;				      \
@@ -1225,59 +1333,61 @@ static inline void slice_non_intra_DCT (mpeg2_decoder_t * const decoder,
     }									      \
     xy_half = ((pos_y & 1) << 1) | (pos_x & 1);				      \
     offset = (pos_x >> 1) + (pos_y & ~1) * decoder->stride;		      \
-    table[xy_half] (decoder->dest[0] + decoder->offset,			      \
-		    ref[0] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[0] + decoder->stride + decoder->offset,     \
-		    ref[0] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[1] + decoder->offset,			      \
-		    ref[1] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[1] + decoder->stride + decoder->offset,     \
-		    ref[1] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8);				      \
-    table[xy_half] (decoder->dest[2] + decoder->offset,			      \
-		    ref[2] + offset, 2 * decoder->stride, 8);		      \
-    table[xy_half] (decoder->dest[2] + decoder->stride + decoder->offset,     \
-		    ref[2] + decoder->stride + offset,			      \
-		    2 * decoder->stride, 8)
+    MC (table[xy_half], decoder->dest[0] + decoder->offset,		      \
+			ref[0] + offset, 2 * decoder->stride, 8);	      \
+    MC (table[xy_half], decoder->dest[0] + decoder->stride + decoder->offset, \
+			ref[0] + decoder->stride + offset,		      \
+			2 * decoder->stride, 8);			      \
+    MC (table[xy_half], decoder->dest[1] + decoder->offset,		      \
+			ref[1] + offset, 2 * decoder->stride, 8);	      \
+    MC (table[xy_half], decoder->dest[1] + decoder->stride + decoder->offset, \
+			ref[1] + decoder->stride + offset,		      \
+			2 * decoder->stride, 8);			      \
+    MC (table[xy_half], decoder->dest[2] + decoder->offset,		      \
+			ref[2] + offset, 2 * decoder->stride, 8);	      \
+    MC (table[xy_half], decoder->dest[2] + decoder->stride + decoder->offset, \
+			ref[2] + decoder->stride + offset,		      \
+			2 * decoder->stride, 8)
 
 #define MOTION_ZERO_444(table,ref)					      \
     offset = decoder->offset + decoder->v_offset * decoder->stride;	      \
-    table[0] (decoder->dest[0] + decoder->offset,			      \
-	      ref[0] + offset, decoder->stride, 16);			      \
-    table[4] (decoder->dest[1] + decoder->offset,			      \
-	      ref[1] + offset, decoder->stride, 16);			      \
-    table[4] (decoder->dest[2] + decoder->offset,			      \
-	      ref[2] + offset, decoder->stride, 16)
+    MC (table[0], decoder->dest[0] + decoder->offset,			      \
+		  ref[0] + offset, decoder->stride, 16);		      \
+    MC (table[4], decoder->dest[1] + decoder->offset,			      \
+		  ref[1] + offset, decoder->stride, 16);		      \
+    MC (table[4], decoder->dest[2] + decoder->offset,			      \
+		  ref[2] + offset, decoder->stride, 16)
 
 #define bit_buf (decoder->bitstream_buf)
 #define bits (decoder->bitstream_bits)
 #define bit_ptr (decoder->bitstream_ptr)
 
-static void motion_mp1 (mpeg2_decoder_t * const decoder,
-			motion_t * const motion,
-			mpeg2_mc_fct * const * const table)
-{
-    int motion_x, motion_y;
-    unsigned int pos_x, pos_y, xy_half, offset;
-
-    NEEDBITS (bit_buf, bits, bit_ptr);
-    motion_x = (motion->pmv[0][0] +
-		(get_motion_delta (decoder,
-				   motion->f_code[0]) << motion->f_code[1]));
-    motion_x = bound_motion_vector (motion_x,
-				    motion->f_code[0] + motion->f_code[1]);
-    motion->pmv[0][0] = motion_x;
-
-    NEEDBITS (bit_buf, bits, bit_ptr);
-    motion_y = (motion->pmv[0][1] +
-		(get_motion_delta (decoder,
-				   motion->f_code[0]) << motion->f_code[1]));
-    motion_y = bound_motion_vector (motion_y,
-				    motion->f_code[0] + motion->f_code[1]);
-    motion->pmv[0][1] = motion_y;
-
-    MOTION_420 (table, motion->ref[0], motion_x, motion_y, 16, 0);
+#define MOTION_MP1(FORMAT)						      \
+									      \
+static void motion_mp1_##FORMAT (mpeg2_decoder_t * const decoder,	      \
+				 motion_t * const motion,		      \
+				 mpeg2_mc_fct * const * const table)	      \
+{									      \
+    int motion_x, motion_y;						      \
+    unsigned int pos_x, pos_y, xy_half, offset;				      \
+									      \
+    NEEDBITS (bit_buf, bits, bit_ptr);					      \
+    motion_x = (motion->pmv[0][0] +					      \
+		(get_motion_delta (decoder,				      \
+				   motion->f_code[0]) << motion->f_code[1])); \
+    motion_x = bound_motion_vector (motion_x,				      \
+				    motion->f_code[0] + motion->f_code[1]);   \
+    motion->pmv[0][0] = motion_x;					      \
+									      \
+    NEEDBITS (bit_buf, bits, bit_ptr);					      \
+    motion_y = (motion->pmv[0][1] +					      \
+		(get_motion_delta (decoder,				      \
+				   motion->f_code[0]) << motion->f_code[1])); \
+    motion_y = bound_motion_vector (motion_y,				      \
+				    motion->f_code[0] + motion->f_code[1]);   \
+    motion->pmv[0][1] = motion_y;					      \
+									      \
+    MOTION_420 (table, motion->ref[0], motion_x, motion_y, 16, 0);	      \
 }
 
 #define MOTION_FUNCTIONS(FORMAT,MOTION,MOTION_FIELD,MOTION_DMV,MOTION_ZERO)   \
@@ -1506,6 +1616,20 @@ MOTION_FUNCTIONS (422, MOTION_422, MOTION_FIELD_422, MOTION_DMV_422,
 		  MOTION_ZERO_422)
 MOTION_FUNCTIONS (444, MOTION_444, MOTION_FIELD_444, MOTION_DMV_444,
 		  MOTION_ZERO_444)
+MOTION_MP1 (420)
+
+/* same parsers, queueing the motion compensation for recon_flush() */
+#undef MC
+#define MC(mc,dest,ref,stride,size) \
+    recon_mc (decoder, mc, dest, ref, stride, size)
+
+MOTION_FUNCTIONS (420_deferred, MOTION_420, MOTION_FIELD_420, MOTION_DMV_420,
+		  MOTION_ZERO_420)
+MOTION_FUNCTIONS (422_deferred, MOTION_422, MOTION_FIELD_422, MOTION_DMV_422,
+		  MOTION_ZERO_422)
+MOTION_FUNCTIONS (444_deferred, MOTION_444, MOTION_FIELD_444, MOTION_DMV_444,
+		  MOTION_ZERO_444)
+MOTION_MP1 (420_deferred)
 
 /* like motion_frame, but parsing without actual motion compensation */
 static void motion_fr_conceal (mpeg2_decoder_t * const decoder)
@@ -1552,6 +1676,214 @@ static void motion_fi_conceal (mpeg2_decoder_t * const decoder)
 #undef bits
 #undef bit_ptr
 
+/*
+ * Runs of skipped macroblocks within a row. In P pictures they are
+ * a plain copy from the reference, done as one wide copy per line
+ * (not for 4:4:4, where motion_zero_444 only predicts 8 chroma
+ * columns). In 4:2:0 B pictures they all reuse the same vectors, so
+ * as long as none of them needs clipping the source pointers are
+ * computed once for the whole run.
+ */
+static inline void motion_zero_run (mpeg2_decoder_t * const decoder,
+				    const int count, const int chroma_format)
+{
+    motion_t * const motion = &(decoder->f_motion);
+    unsigned int offset, size;
+    int i, height;
+
+    motion->pmv[0][0] = motion->pmv[0][1] = 0;
+    motion->pmv[1][0] = motion->pmv[1][1] = 0;
+
+    size = 16 * count;
+    offset = decoder->offset + decoder->v_offset * decoder->stride;
+    for (i = 0; i < 16; i++)
+	memcpy (decoder->dest[0] + decoder->offset + i * decoder->stride,
+		motion->ref[0][0] + offset + i * decoder->stride, size);
+
+    if (chroma_format == 0) {
+	offset = ((decoder->offset >> 1) +
+		  (decoder->v_offset >> 1) * decoder->uv_stride);
+	height = 8;
+    } else {
+	offset >>= 1;
+	height = 16;
+    }
+    size >>= 1;
+    for (i = 0; i < height; i++) {
+	memcpy (decoder->dest[1] + (decoder->offset >> 1) +
+		i * decoder->uv_stride,
+		motion->ref[0][1] + offset + i * decoder->uv_stride, size);
+	memcpy (decoder->dest[2] + (decoder->offset >> 1) +
+		i * decoder->uv_stride,
+		motion->ref[0][2] + offset + i * decoder->uv_stride, size);
+    }
+}
+
+static inline int motion_reuse_fits (mpeg2_decoder_t * const decoder,
+				     motion_t * const motion, const int count)
+{
+    unsigned int pos_x, pos_y;
+
+    pos_x = 2 * decoder->offset + motion->pmv[0][0];
+    pos_y = 2 * decoder->v_offset + motion->pmv[0][1];
+    return (pos_x <= decoder->limit_x - 32 * (count - 1) &&
+	    pos_y <= decoder->limit_y_16);
+}
+
+static inline void motion_reuse_row_420 (mpeg2_decoder_t * const decoder,
+					 motion_t * const motion,
+					 mpeg2_mc_fct * const * const table,
+					 const int count)
+{
+    int motion_x, motion_y, i;
+    unsigned int pos_x, pos_y, xy_half, offset;
+    uint8_t * dest;
+    const uint8_t * ref;
+
+    motion_x = motion->pmv[0][0];
+    motion_y = motion->pmv[0][1];
+    pos_x = 2 * decoder->offset + motion_x;
+    pos_y = 2 * decoder->v_offset + motion_y;
+
+    xy_half = ((pos_y & 1) << 1) | (pos_x & 1);
+    dest = decoder->dest[0] + decoder->offset;
+    ref = motion->ref[0][0] + (pos_x >> 1) + (pos_y >> 1) * decoder->stride;
+    for (i = 0; i < count; i++)
+	table[xy_half] (dest + 16 * i, ref + 16 * i, decoder->stride, 16);
+
+    motion_x /= 2;	motion_y /= 2;
+    xy_half = ((motion_y & 1) << 1) | (motion_x & 1);
+    offset = (((decoder->offset + motion_x) >> 1) +
+	      ((decoder->v_offset + motion_y) >> 1) * decoder->uv_stride);
+    for (i = 0; i < count; i++) {
+	table[4+xy_half] (decoder->dest[1] + (decoder->offset >> 1) + 8 * i,
+			  motion->ref[0][1] + offset + 8 * i,
+			  decoder->uv_stride, 8);
+	table[4+xy_half] (decoder->dest[2] + (decoder->offset >> 1) + 8 * i,
+			  motion->ref[0][2] + offset + 8 * i,
+			  decoder->uv_stride, 8);
+    }
+}
+
+static inline int motion_reuse_run_420 (mpeg2_decoder_t * const decoder,
+					const int direction, const int count)
+{
+    if (((direction & MACROBLOCK_MOTION_FORWARD) &&
+	 !motion_reuse_fits (decoder, &(decoder->f_motion), count)) ||
+	((direction & MACROBLOCK_MOTION_BACKWARD) &&
+	 !motion_reuse_fits (decoder, &(decoder->b_motion), count)))
+	return 0;
+    if (direction & MACROBLOCK_MOTION_FORWARD)
+	motion_reuse_row_420 (decoder, &(decoder->f_motion), mpeg2_mc.put,
+			      count);
+    if (direction & MACROBLOCK_MOTION_BACKWARD)
+	motion_reuse_row_420 (decoder, &(decoder->b_motion),
+			      ((direction & MACROBLOCK_MOTION_FORWARD) ?
+			       mpeg2_mc.avg : mpeg2_mc.put), count);
+    return 1;
+}
+
+static inline int skip_run (mpeg2_decoder_t * const decoder, const int count)
+{
+    int run;
+
+    if (decoder->deferred)
+	return 1;
+    run = (decoder->width - decoder->offset) >> 4;
+    return (run < count) ? run : count;
+}
+
+/*
+ * Macroblock side data. The vectors are the motion vector predictors
+ * left by the macroblock, so field vectors of frame pictures have
+ * their vertical component doubled as in the PMV of the standard.
+ */
+static const uint8_t non_linear_scale[32] = {
+     0,  1,  2,  3,  4,  5,   6,   7,
+     8, 10, 12, 14, 16, 18,  20,  22,
+    24, 28, 32, 36, 40, 44,  48,  52,
+    56, 64, 72, 80, 88, 96, 104, 112
+};
+
+static inline mpeg2_macroblock_t *
+record_init (mpeg2_decoder_t * const decoder)
+{
+    mpeg2_macroblock_t * mb;
+    int code;
+
+    mb = (decoder->macroblocks +
+	  (decoder->v_offset >> 4) * (decoder->width >> 4) +
+	  (decoder->offset >> 4));
+    /* quantizer_matrix[0] points to the quantizer_scale_code entry */
+    code = ((decoder->quantizer_matrix[0] -
+	     decoder->quantizer_prescale[0][0]) >> 6);
+    mb->quantizer_scale =
+	decoder->q_scale_type ? non_linear_scale[code] : (code << 1);
+    return mb;
+}
+
+static inline void record_motion (int16_t * const mv, const motion_t * motion)
+{
+    mv[0] = motion->pmv[0][0];
+    mv[1] = motion->pmv[0][1];
+    mv[2] = motion->pmv[1][0];
+    mv[3] = motion->pmv[1][1];
+}
+
+static void record_macroblock (mpeg2_decoder_t * const decoder,
+			       const int macroblock_modes,
+			       const int coded_block_pattern, const int dc)
+{
+    mpeg2_macroblock_t * mb;
+    int i;
+
+    mb = record_init (decoder);
+    mb->flags = macroblock_modes & 63;
+    mb->motion_type = (macroblock_modes >> MOTION_TYPE_SHIFT) & 3;
+    if (macroblock_modes & MACROBLOCK_INTRA) {
+	mb->coded_block_pattern =
+	    (1 << (4 + (2 << decoder->chroma_format))) - 1;
+	/* the dc predictors are 128 << 7 for mid grey */
+	mb->dc = (dc < 0) ? 0 : (dc >= 256 << 9) ? 255 : dc >> 9;
+    } else {
+	/* 4:2:2 and 4:4:4 blocks are in the top bits, highest first */
+	mb->coded_block_pattern = coded_block_pattern & 63;
+	for (i = 0; i < 6; i++)
+	    if (coded_block_pattern & (1 << (31 - i)))
+		mb->coded_block_pattern |= 64 << i;
+    }
+    /* intra macroblocks keep their concealment vectors */
+    if (macroblock_modes & (MACROBLOCK_INTRA | MACROBLOCK_MOTION_FORWARD))
+	record_motion (mb->mv[0][0], &(decoder->f_motion));
+    if (macroblock_modes & MACROBLOCK_MOTION_BACKWARD)
+	record_motion (mb->mv[1][0], &(decoder->b_motion));
+}
+
+static void record_skipped (mpeg2_decoder_t * const decoder,
+			    const int direction, const int motion_type,
+			    const int count)
+{
+    mpeg2_macroblock_t * mb;
+    int i;
+
+    mb = record_init (decoder);
+    mb->flags = MB_FLAG_SKIPPED | direction;
+    mb->motion_type = motion_type;
+    /* skipped macroblocks reuse the first vector for the whole area */
+    if (direction & MACROBLOCK_MOTION_FORWARD) {
+	record_motion (mb->mv[0][0], &(decoder->f_motion));
+	mb->mv[0][1][0] = mb->mv[0][0][0];
+	mb->mv[0][1][1] = mb->mv[0][0][1];
+    }
+    if (direction & MACROBLOCK_MOTION_BACKWARD) {
+	record_motion (mb->mv[1][0], &(decoder->b_motion));
+	mb->mv[1][1][0] = mb->mv[1][0][0];
+	mb->mv[1][1][1] = mb->mv[1][0][1];
+    }
+    for (i = 1; i < count; i++)
+	mb[i] = mb[0];
+}
+
 #define MOTION_CALL(routine,direction)				\
 do {								\
     if ((direction) & MACROBLOCK_MOTION_FORWARD)		\
@@ -1562,15 +1894,25 @@ do {								\
 		  mpeg2_mc.avg : mpeg2_mc.put));		\
 } while (0)
 
+/* the second field of a pair completes two lines of the frame per line */
+static void row_done (mpeg2_decoder_t * const decoder)
+{
+    decoder->row_ready (decoder->row_ready_arg, decoder->row_fbuf,
+			decoder->v_offset <<
+			(decoder->picture_structure != FRAME_PICTURE));
+}
+
 #define NEXT_MACROBLOCK							\
 do {									\
     decoder->offset += 16;						\
     if (decoder->offset == decoder->width) {				\
+	if (decoder->deferred)						\
+	    recon_flush (decoder);					\
 	do { /* just so we can use the break statement */		\
 	    if (decoder->convert) {					\
 		decoder->convert (decoder->convert_id, decoder->dest,	\
 				  decoder->v_offset);			\
-		if (decoder->coding_type == B_TYPE)			\
+		if (coding_type == B_TYPE)				\
 		    break;						\
 	    }								\
 	    decoder->dest[0] += decoder->slice_stride;			\
@@ -1578,7 +1920,10 @@ do {									\
 	    decoder->dest[2] += decoder->slice_uv_stride;		\
 	} while (0);							\
 	decoder->v_offset += 16;					\
+	if (decoder->row_ready)						\
+	    row_done (decoder);						\
 	if (decoder->v_offset > decoder->limit_y) {			\
+	    decoder->picture_end = bit_ptr - ((16 - bits) >> 3);	\
 	    if (mpeg2_cpu_state_restore)				\
 		mpeg2_cpu_state_restore (&cpu_state);			\
 	    return;							\
@@ -1597,110 +1942,62 @@ static void motion_dummy (mpeg2_decoder_t * const decoder,
 {
 }
 
-void mpeg2_init_fbuf (mpeg2_decoder_t * decoder, uint8_t * current_fbuf[3],
-		      uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3])
-{
-    int offset, stride, height, bottom_field;
-
-    stride = decoder->stride_frame;
-    bottom_field = (decoder->picture_structure == BOTTOM_FIELD);
-    offset = bottom_field ? stride : 0;
-    height = decoder->height;
-
-    decoder->picture_dest[0] = current_fbuf[0] + offset;
-    decoder->picture_dest[1] = current_fbuf[1] + (offset >> 1);
-    decoder->picture_dest[2] = current_fbuf[2] + (offset >> 1);
-
-    decoder->f_motion.ref[0][0] = forward_fbuf[0] + offset;
-    decoder->f_motion.ref[0][1] = forward_fbuf[1] + (offset >> 1);
-    decoder->f_motion.ref[0][2] = forward_fbuf[2] + (offset >> 1);
-
-    decoder->b_motion.ref[0][0] = backward_fbuf[0] + offset;
-    decoder->b_motion.ref[0][1] = backward_fbuf[1] + (offset >> 1);
-    decoder->b_motion.ref[0][2] = backward_fbuf[2] + (offset >> 1);
-
-    if (decoder->picture_structure != FRAME_PICTURE) {
-	decoder->dmv_offset = bottom_field ? 1 : -1;
-	decoder->f_motion.ref2[0] = decoder->f_motion.ref[bottom_field];
-	decoder->f_motion.ref2[1] = decoder->f_motion.ref[!bottom_field];
-	decoder->b_motion.ref2[0] = decoder->b_motion.ref[bottom_field];
-	decoder->b_motion.ref2[1] = decoder->b_motion.ref[!bottom_field];
-	offset = stride - offset;
-
-	if (decoder->second_field && (decoder->coding_type != B_TYPE))
-	    forward_fbuf = current_fbuf;
-
-	decoder->f_motion.ref[1][0] = forward_fbuf[0] + offset;
-	decoder->f_motion.ref[1][1] = forward_fbuf[1] + (offset >> 1);
-	decoder->f_motion.ref[1][2] = forward_fbuf[2] + (offset >> 1);
-
-	decoder->b_motion.ref[1][0] = backward_fbuf[0] + offset;
-	decoder->b_motion.ref[1][1] = backward_fbuf[1] + (offset >> 1);
-	decoder->b_motion.ref[1][2] = backward_fbuf[2] + (offset >> 1);
-
-	stride <<= 1;
-	height >>= 1;
-    }
-
-    decoder->stride = stride;
-    decoder->uv_stride = stride >> 1;
-    decoder->slice_stride = 16 * stride;
-    decoder->slice_uv_stride =
-	decoder->slice_stride >> (2 - decoder->chroma_format);
-    decoder->limit_x = 2 * decoder->width - 32;
-    decoder->limit_y_16 = 2 * height - 32;
-    decoder->limit_y_8 = 2 * height - 16;
-    decoder->limit_y = height - 16;
-
-    if (decoder->mpeg1) {
-	decoder->motion_parser[0] = motion_zero_420;
-        decoder->motion_parser[MC_FIELD] = motion_dummy;
- 	decoder->motion_parser[MC_FRAME] = motion_mp1;
-        decoder->motion_parser[MC_DMV] = motion_dummy;
-	decoder->motion_parser[4] = motion_reuse_420;
-    } else if (decoder->picture_structure == FRAME_PICTURE) {
-	if (decoder->chroma_format == 0) {
-	    decoder->motion_parser[0] = motion_zero_420;
-	    decoder->motion_parser[MC_FIELD] = motion_fr_field_420;
-	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_420;
-	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_420;
-	    decoder->motion_parser[4] = motion_reuse_420;
-	} else if (decoder->chroma_format == 1) {
-	    decoder->motion_parser[0] = motion_zero_422;
-	    decoder->motion_parser[MC_FIELD] = motion_fr_field_422;
-	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_422;
-	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_422;
-	    decoder->motion_parser[4] = motion_reuse_422;
-	} else {
-	    decoder->motion_parser[0] = motion_zero_444;
-	    decoder->motion_parser[MC_FIELD] = motion_fr_field_444;
-	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_444;
-	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_444;
-	    decoder->motion_parser[4] = motion_reuse_444;
-	}
-    } else {
-	if (decoder->chroma_format == 0) {
-	    decoder->motion_parser[0] = motion_zero_420;
-	    decoder->motion_parser[MC_FIELD] = motion_fi_field_420;
-	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_420;
-	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_420;
-	    decoder->motion_parser[4] = motion_reuse_420;
-	} else if (decoder->chroma_format == 1) {
-	    decoder->motion_parser[0] = motion_zero_422;
-	    decoder->motion_parser[MC_FIELD] = motion_fi_field_422;
-	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_422;
-	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_422;
-	    decoder->motion_parser[4] = motion_reuse_422;
-	} else {
-	    decoder->motion_parser[0] = motion_zero_444;
-	    decoder->motion_parser[MC_FIELD] = motion_fi_field_444;
-	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_444;
-	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_444;
-	    decoder->motion_parser[4] = motion_reuse_444;
-	}
-    }
+#define MOTION_PARSERS(NAME,F420,F422,F444)				      \
+static void NAME (mpeg2_decoder_t * const decoder)			      \
+{									      \
+    if (decoder->mpeg1) {						      \
+	decoder->motion_parser[0] = motion_zero_##F420;			      \
+	decoder->motion_parser[MC_FIELD] = motion_dummy;		      \
+	decoder->motion_parser[MC_FRAME] = motion_mp1_##F420;		      \
+	decoder->motion_parser[MC_DMV] = motion_dummy;			      \
+	decoder->motion_parser[4] = motion_reuse_##F420;		      \
+    } else if (decoder->picture_structure == FRAME_PICTURE) {		      \
+	if (decoder->chroma_format == 0) {				      \
+	    decoder->motion_parser[0] = motion_zero_##F420;		      \
+	    decoder->motion_parser[MC_FIELD] = motion_fr_field_##F420;	      \
+	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_##F420;	      \
+	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_##F420;	      \
+	    decoder->motion_parser[4] = motion_reuse_##F420;		      \
+	} else if (decoder->chroma_format == 1) {			      \
+	    decoder->motion_parser[0] = motion_zero_##F422;		      \
+	    decoder->motion_parser[MC_FIELD] = motion_fr_field_##F422;	      \
+	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_##F422;	      \
+	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_##F422;	      \
+	    decoder->motion_parser[4] = motion_reuse_##F422;		      \
+	} else {							      \
+	    decoder->motion_parser[0] = motion_zero_##F444;		      \
+	    decoder->motion_parser[MC_FIELD] = motion_fr_field_##F444;	      \
+	    decoder->motion_parser[MC_FRAME] = motion_fr_frame_##F444;	      \
+	    decoder->motion_parser[MC_DMV] = motion_fr_dmv_##F444;	      \
+	    decoder->motion_parser[4] = motion_reuse_##F444;		      \
+	}								      \
+    } else {								      \
+	if (decoder->chroma_format == 0) {				      \
+	    decoder->motion_parser[0] = motion_zero_##F420;		      \
+	    decoder->motion_parser[MC_FIELD] = motion_fi_field_##F420;	      \
+	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_##F420;	      \
+	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_##F420;	      \
+	    decoder->motion_parser[4] = motion_reuse_##F420;		      \
+	} else if (decoder->chroma_format == 1) {			      \
+	    decoder->motion_parser[0] = motion_zero_##F422;		      \
+	    decoder->motion_parser[MC_FIELD] = motion_fi_field_##F422;	      \
+	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_##F422;	      \
+	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_##F422;	      \
+	    decoder->motion_parser[4] = motion_reuse_##F422;		      \
+	} else {							      \
+	    decoder->motion_parser[0] = motion_zero_##F444;		      \
+	    decoder->motion_parser[MC_FIELD] = motion_fi_field_##F444;	      \
+	    decoder->motion_parser[MC_16X8] = motion_fi_16x8_##F444;	      \
+	    decoder->motion_parser[MC_DMV] = motion_fi_dmv_##F444;	      \
+	    decoder->motion_parser[4] = motion_reuse_##F444;		      \
+	}								      \
+    }									      \
 }
 
+MOTION_PARSERS (motion_parsers, 420, 422, 444)
+MOTION_PARSERS (motion_parsers_deferred, 420_deferred, 422_deferred,
+		444_deferred)
+
 static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
 {
 #define bit_buf (decoder->bitstream_buf)
@@ -1784,12 +2081,29 @@ static inline int slice_init (mpeg2_decoder_t * const decoder, int code)
 #undef bit_ptr
 }
 
-void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
-		  const uint8_t * const buffer)
+/*
+ * The slice loop is instantiated once with the picture parameters read
+ * from the decoder, and once per coding type and intra vlc format for
+ * MPEG-2 4:2:0 frame pictures ("fixed"), where the per macroblock
+ * tests on these parameters fold away and the motion parsers are
+ * called directly. A last generic instance records the macroblock
+ * side data, so that the others do not pay for it. MPEG-2 I pictures
+ * go through slice_intra_loop instead.
+ */
+static inline void slice_loop (mpeg2_decoder_t * const decoder,
+			       const int code, const uint8_t * const buffer,
+			       const int fixed, const int coding_type,
+			       const int intra_vlc_format, const int record)
 {
 #define bit_buf (decoder->bitstream_buf)
 #define bits (decoder->bitstream_bits)
 #define bit_ptr (decoder->bitstream_ptr)
+    const int mpeg1 = !fixed && decoder->mpeg1;
+    const int chroma_format = fixed ? 0 : decoder->chroma_format;
+    const int frame_picture =
+	fixed || decoder->picture_structure == FRAME_PICTURE;
+    /* intra vlc: 0 for MPEG-1, 1 for table B-14, 2 for table B-15 */
+    const int vlc = mpeg1 ? 0 : 1 + intra_vlc_format;
     cpu_state_t cpu_state;
 
     bitstream_init (decoder, buffer);
@@ -1807,7 +2121,8 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 
 	NEEDBITS (bit_buf, bits, bit_ptr);
 
-	macroblock_modes = get_macroblock_modes (decoder);
+	macroblock_modes = get_macroblock_modes (decoder, coding_type,
+						 frame_picture);
 
 	/* maybe integrate MACROBLOCK_QUANT test into get_macroblock_modes ? */
 	if (macroblock_modes & MACROBLOCK_QUANT)
@@ -1816,11 +2131,11 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 	if (macroblock_modes & MACROBLOCK_INTRA) {
 
 	    int DCT_offset, DCT_stride;
-	    int offset;
+	    int offset, dc;
 	    uint8_t * dest_y;
 
 	    if (decoder->concealment_motion_vectors) {
-		if (decoder->picture_structure == FRAME_PICTURE)
+		if (frame_picture)
 		    motion_fr_conceal (decoder);
 		else
 		    motion_fi_conceal (decoder);
@@ -1841,60 +2156,94 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 
 	    offset = decoder->offset;
 	    dest_y = decoder->dest[0] + offset;
-	    slice_intra_DCT (decoder, 0, dest_y, DCT_stride);
-	    slice_intra_DCT (decoder, 0, dest_y + 8, DCT_stride);
-	    slice_intra_DCT (decoder, 0, dest_y + DCT_offset, DCT_stride);
-	    slice_intra_DCT (decoder, 0, dest_y + DCT_offset + 8, DCT_stride);
-	    if (likely (decoder->chroma_format == 0)) {
-		slice_intra_DCT (decoder, 1, decoder->dest[1] + (offset >> 1),
+	    slice_intra_DCT (decoder, vlc, 0, dest_y, DCT_stride);
+	    dc = decoder->dc_dct_pred[0];
+	    slice_intra_DCT (decoder, vlc, 0, dest_y + 8, DCT_stride);
+	    dc += decoder->dc_dct_pred[0];
+	    slice_intra_DCT (decoder, vlc, 0, dest_y + DCT_offset, DCT_stride);
+	    dc += decoder->dc_dct_pred[0];
+	    slice_intra_DCT (decoder, vlc, 0, dest_y + DCT_offset + 8,
+			     DCT_stride);
+	    dc += decoder->dc_dct_pred[0];
+	    if (record)
+		record_macroblock (decoder, macroblock_modes, 0, dc);
+	    if (likely (chroma_format == 0)) {
+		slice_intra_DCT (decoder, vlc, 1,
+				 decoder->dest[1] + (offset >> 1),
 				 decoder->uv_stride);
-		slice_intra_DCT (decoder, 2, decoder->dest[2] + (offset >> 1),
+		slice_intra_DCT (decoder, vlc, 2,
+				 decoder->dest[2] + (offset >> 1),
 				 decoder->uv_stride);
-		if (decoder->coding_type == D_TYPE) {
+		if (coding_type == D_TYPE) {
 		    NEEDBITS (bit_buf, bits, bit_ptr);
 		    DUMPBITS (bit_buf, bits, 1);
 		}
-	    } else if (likely (decoder->chroma_format == 1)) {
+	    } else if (likely (chroma_format == 1)) {
 		uint8_t * dest_u = decoder->dest[1] + (offset >> 1);
 		uint8_t * dest_v = decoder->dest[2] + (offset >> 1);
 		DCT_stride >>= 1;
 		DCT_offset >>= 1;
-		slice_intra_DCT (decoder, 1, dest_u, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + DCT_offset, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + DCT_offset, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 1, dest_u, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 2, dest_v, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 1, dest_u + DCT_offset,
+				 DCT_stride);
+		slice_intra_DCT (decoder, vlc, 2, dest_v + DCT_offset,
+				 DCT_stride);
 	    } else {
 		uint8_t * dest_u = decoder->dest[1] + offset;
 		uint8_t * dest_v = decoder->dest[2] + offset;
-		slice_intra_DCT (decoder, 1, dest_u, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + DCT_offset, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + DCT_offset, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + 8, DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + 8, DCT_stride);
-		slice_intra_DCT (decoder, 1, dest_u + DCT_offset + 8,
+		slice_intra_DCT (decoder, vlc, 1, dest_u, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 2, dest_v, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 1, dest_u + DCT_offset,
+				 DCT_stride);
+		slice_intra_DCT (decoder, vlc, 2, dest_v + DCT_offset,
 				 DCT_stride);
-		slice_intra_DCT (decoder, 2, dest_v + DCT_offset + 8,
+		slice_intra_DCT (decoder, vlc, 1, dest_u + 8, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 2, dest_v + 8, DCT_stride);
+		slice_intra_DCT (decoder, vlc, 1, dest_u + DCT_offset + 8,
+				 DCT_stride);
+		slice_intra_DCT (decoder, vlc, 2, dest_v + DCT_offset + 8,
 				 DCT_stride);
 	    }
 	} else {
 
 	    motion_parser_t * parser;
+	    int coded_block_pattern = 0;
 
 	    if (   ((macroblock_modes >> MOTION_TYPE_SHIFT) < 0)
                 || ((macroblock_modes >> MOTION_TYPE_SHIFT) >=
                     (int)(sizeof(decoder->motion_parser) 
                           / sizeof(decoder->motion_parser[0])))
 	       ) {
+		if (decoder->deferred)
+		    recon_flush (decoder);
 		break; // Illegal !
 	    }
 
-	    parser =
-		decoder->motion_parser[macroblock_modes >> MOTION_TYPE_SHIFT];
-	    MOTION_CALL (parser, macroblock_modes);
+	    if (fixed)
+		switch (macroblock_modes >> MOTION_TYPE_SHIFT) {
+		case 0:
+		    MOTION_CALL (motion_zero_420, macroblock_modes);
+		    break;
+		case MC_FIELD:
+		    MOTION_CALL (motion_fr_field_420, macroblock_modes);
+		    break;
+		case MC_FRAME:
+		    MOTION_CALL (motion_fr_frame_420, macroblock_modes);
+		    break;
+		case MC_DMV:
+		    MOTION_CALL (motion_fr_dmv_420, macroblock_modes);
+		    break;
+		default:
+		    MOTION_CALL (motion_reuse_420, macroblock_modes);
+		}
+	    else {
+		parser = decoder->motion_parser[macroblock_modes >>
+						MOTION_TYPE_SHIFT];
+		MOTION_CALL (parser, macroblock_modes);
+	    }
 
 	    if (macroblock_modes & MACROBLOCK_PATTERN) {
-		int coded_block_pattern;
 		int DCT_offset, DCT_stride;
 
 		if (macroblock_modes & DCT_TYPE_INTERLACED) {
@@ -1907,30 +2256,31 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 
 		coded_block_pattern = get_coded_block_pattern (decoder);
 
-		if (likely (decoder->chroma_format == 0)) {
+		if (likely (chroma_format == 0)) {
 		    int offset = decoder->offset;
 		    uint8_t * dest_y = decoder->dest[0] + offset;
 		    if (coded_block_pattern & 1)
-			slice_non_intra_DCT (decoder, 0, dest_y, DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 0, dest_y,
+					     DCT_stride);
 		    if (coded_block_pattern & 2)
-			slice_non_intra_DCT (decoder, 0, dest_y + 8,
+			slice_non_intra_DCT (decoder, mpeg1, 0, dest_y + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & 4)
-			slice_non_intra_DCT (decoder, 0, dest_y + DCT_offset,
-					     DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 0,
+					     dest_y + DCT_offset, DCT_stride);
 		    if (coded_block_pattern & 8)
-			slice_non_intra_DCT (decoder, 0,
+			slice_non_intra_DCT (decoder, mpeg1, 0,
 					     dest_y + DCT_offset + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & 16)
-			slice_non_intra_DCT (decoder, 1,
+			slice_non_intra_DCT (decoder, mpeg1, 1,
 					     decoder->dest[1] + (offset >> 1),
 					     decoder->uv_stride);
 		    if (coded_block_pattern & 32)
-			slice_non_intra_DCT (decoder, 2,
+			slice_non_intra_DCT (decoder, mpeg1, 2,
 					     decoder->dest[2] + (offset >> 1),
 					     decoder->uv_stride);
-		} else if (likely (decoder->chroma_format == 1)) {
+		} else if (likely (chroma_format == 1)) {
 		    int offset;
 		    uint8_t * dest_y;
 
@@ -1940,34 +2290,35 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 		    offset = decoder->offset;
 		    dest_y = decoder->dest[0] + offset;
 		    if (coded_block_pattern & 1)
-			slice_non_intra_DCT (decoder, 0, dest_y, DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 0, dest_y,
+					     DCT_stride);
 		    if (coded_block_pattern & 2)
-			slice_non_intra_DCT (decoder, 0, dest_y + 8,
+			slice_non_intra_DCT (decoder, mpeg1, 0, dest_y + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & 4)
-			slice_non_intra_DCT (decoder, 0, dest_y + DCT_offset,
-					     DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 0,
+					     dest_y + DCT_offset, DCT_stride);
 		    if (coded_block_pattern & 8)
-			slice_non_intra_DCT (decoder, 0,
+			slice_non_intra_DCT (decoder, mpeg1, 0,
 					     dest_y + DCT_offset + 8,
 					     DCT_stride);
 
 		    DCT_stride >>= 1;
 		    DCT_offset = (DCT_offset + offset) >> 1;
 		    if (coded_block_pattern & 16)
-			slice_non_intra_DCT (decoder, 1,
+			slice_non_intra_DCT (decoder, mpeg1, 1,
 					     decoder->dest[1] + (offset >> 1),
 					     DCT_stride);
 		    if (coded_block_pattern & 32)
-			slice_non_intra_DCT (decoder, 2,
+			slice_non_intra_DCT (decoder, mpeg1, 2,
 					     decoder->dest[2] + (offset >> 1),
 					     DCT_stride);
 		    if (coded_block_pattern & (2 << 30))
-			slice_non_intra_DCT (decoder, 1,
+			slice_non_intra_DCT (decoder, mpeg1, 1,
 					     decoder->dest[1] + DCT_offset,
 					     DCT_stride);
 		    if (coded_block_pattern & (1 << 30))
-			slice_non_intra_DCT (decoder, 2,
+			slice_non_intra_DCT (decoder, mpeg1, 2,
 					     decoder->dest[2] + DCT_offset,
 					     DCT_stride);
 		} else {
@@ -1983,44 +2334,50 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 		    dest_v = decoder->dest[2] + offset;
 
 		    if (coded_block_pattern & 1)
-			slice_non_intra_DCT (decoder, 0, dest_y, DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 0, dest_y,
+					     DCT_stride);
 		    if (coded_block_pattern & 2)
-			slice_non_intra_DCT (decoder, 0, dest_y + 8,
+			slice_non_intra_DCT (decoder, mpeg1, 0, dest_y + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & 4)
-			slice_non_intra_DCT (decoder, 0, dest_y + DCT_offset,
-					     DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 0,
+					     dest_y + DCT_offset, DCT_stride);
 		    if (coded_block_pattern & 8)
-			slice_non_intra_DCT (decoder, 0,
+			slice_non_intra_DCT (decoder, mpeg1, 0,
 					     dest_y + DCT_offset + 8,
 					     DCT_stride);
 
 		    if (coded_block_pattern & 16)
-			slice_non_intra_DCT (decoder, 1, dest_u, DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 1, dest_u,
+					     DCT_stride);
 		    if (coded_block_pattern & 32)
-			slice_non_intra_DCT (decoder, 2, dest_v, DCT_stride);
-		    if (coded_block_pattern & (32 << 26))
-			slice_non_intra_DCT (decoder, 1, dest_u + DCT_offset,
+			slice_non_intra_DCT (decoder, mpeg1, 2, dest_v,
 					     DCT_stride);
+		    if (coded_block_pattern & (32 << 26))
+			slice_non_intra_DCT (decoder, mpeg1, 1,
+					     dest_u + DCT_offset, DCT_stride);
 		    if (coded_block_pattern & (16 << 26))
-			slice_non_intra_DCT (decoder, 2, dest_v + DCT_offset,
-					     DCT_stride);
+			slice_non_intra_DCT (decoder, mpeg1, 2,
+					     dest_v + DCT_offset, DCT_stride);
 		    if (coded_block_pattern & (8 << 26))
-			slice_non_intra_DCT (decoder, 1, dest_u + 8,
+			slice_non_intra_DCT (decoder, mpeg1, 1, dest_u + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & (4 << 26))
-			slice_non_intra_DCT (decoder, 2, dest_v + 8,
+			slice_non_intra_DCT (decoder, mpeg1, 2, dest_v + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & (2 << 26))
-			slice_non_intra_DCT (decoder, 1,
+			slice_non_intra_DCT (decoder, mpeg1, 1,
 					     dest_u + DCT_offset + 8,
 					     DCT_stride);
 		    if (coded_block_pattern & (1 << 26))
-			slice_non_intra_DCT (decoder, 2,
+			slice_non_intra_DCT (decoder, mpeg1, 2,
 					     dest_v + DCT_offset + 8,
 					     DCT_stride);
 		}
 	    }
+	    if (record)
+		record_macroblock (decoder, macroblock_modes,
+				   coded_block_pattern, 0);
 
 	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =
 		decoder->dc_dct_pred[2] = 16384;
@@ -2046,6 +2403,8 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 		NEEDBITS (bit_buf, bits, bit_ptr);
 		continue;
 	    default:	/* end of slice, or error */
+		if (decoder->deferred)
+		    recon_flush (decoder);
 		if (mpeg2_cpu_state_restore)
 		    mpeg2_cpu_state_restore (&cpu_state);
 		return;
@@ -2055,20 +2414,54 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 	mba_inc += mba->mba;
 
 	if (mba_inc) {
+	    int run;
+
 	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =
 		decoder->dc_dct_pred[2] = 16384;
 
-	    if (decoder->coding_type == P_TYPE) {
+	    if (coding_type == P_TYPE) {
 		do {
-		    MOTION_CALL (decoder->motion_parser[0],
-				 MACROBLOCK_MOTION_FORWARD);
+		    run = skip_run (decoder, mba_inc);
+		    if (run > 1 && chroma_format != 2)
+			motion_zero_run (decoder, run, chroma_format);
+		    else {
+			run = 1;
+			if (fixed)
+			    MOTION_CALL (motion_zero_420,
+					 MACROBLOCK_MOTION_FORWARD);
+			else
+			    MOTION_CALL (decoder->motion_parser[0],
+					 MACROBLOCK_MOTION_FORWARD);
+		    }
+		    if (record)
+			record_skipped (decoder, MACROBLOCK_MOTION_FORWARD, 0,
+					run);
+		    decoder->offset += 16 * (run - 1);
 		    NEXT_MACROBLOCK;
-		} while (--mba_inc);
+		} while (mba_inc -= run);
 	    } else {
 		do {
-		    MOTION_CALL (decoder->motion_parser[4], macroblock_modes);
+		    run = skip_run (decoder, mba_inc);
+		    if (run == 1 || chroma_format != 0 ||
+			!motion_reuse_run_420 (decoder, macroblock_modes,
+					       run)) {
+			run = 1;
+			if (fixed)
+			    MOTION_CALL (motion_reuse_420, macroblock_modes);
+			else
+			    MOTION_CALL (decoder->motion_parser[4],
+					 macroblock_modes);
+		    }
+		    if (record)
+			record_skipped (decoder,
+					macroblock_modes &
+					(MACROBLOCK_MOTION_FORWARD |
+					 MACROBLOCK_MOTION_BACKWARD),
+					frame_picture ? MC_FRAME : MC_FIELD,
+					run);
+		    decoder->offset += 16 * (run - 1);
 		    NEXT_MACROBLOCK;
-		} while (--mba_inc);
+		} while (mba_inc -= run);
 	    }
 	}
     }
@@ -2076,3 +2469,353 @@ void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
 #undef bits
 #undef bit_ptr
 }
+
+/*
+ * I pictures of any chroma format and picture structure: every
+ * macroblock is intra, so there is no motion state and no prediction.
+ * Skipped macroblocks are illegal here, they are left as they are like
+ * the generic loop does.
+ */
+static inline void slice_intra_loop (mpeg2_decoder_t * const decoder,
+				     const int code,
+				     const uint8_t * const buffer,
+				     const int chroma_format,
+				     const int intra_vlc_format)
+{
+#define bit_buf (decoder->bitstream_buf)
+#define bits (decoder->bitstream_bits)
+#define bit_ptr (decoder->bitstream_ptr)
+    const int coding_type = I_TYPE;
+    const int frame_picture = decoder->picture_structure == FRAME_PICTURE;
+    const int vlc = 1 + intra_vlc_format;
+    cpu_state_t cpu_state;
+
+    bitstream_init (decoder, buffer);
+
+    if (slice_init (decoder, code))
+	return;
+
+    if (mpeg2_cpu_state_save)
+	mpeg2_cpu_state_save (&cpu_state);
+
+    while (1) {
+	int macroblock_modes;
+	int mba_inc;
+	const MBAtab * mba;
+	int DCT_offset, DCT_stride;
+	int offset;
+	uint8_t * dest_y;
+
+	NEEDBITS (bit_buf, bits, bit_ptr);
+
+	macroblock_modes = get_macroblock_modes (decoder, I_TYPE,
+						 frame_picture);
+
+	if (macroblock_modes & MACROBLOCK_QUANT)
+	    get_quantizer_scale (decoder);
+
+	if (decoder->concealment_motion_vectors) {
+	    if (frame_picture)
+		motion_fr_conceal (decoder);
+	    else
+		motion_fi_conceal (decoder);
+	}
+
+	if (macroblock_modes & DCT_TYPE_INTERLACED) {
+	    DCT_offset = decoder->stride;
+	    DCT_stride = decoder->stride * 2;
+	} else {
+	    DCT_offset = decoder->stride * 8;
+	    DCT_stride = decoder->stride;
+	}
+
+	offset = decoder->offset;
+	dest_y = decoder->dest[0] + offset;
+	slice_intra_DCT (decoder, vlc, 0, dest_y, DCT_stride);
+	slice_intra_DCT (decoder, vlc, 0, dest_y + 8, DCT_stride);
+	slice_intra_DCT (decoder, vlc, 0, dest_y + DCT_offset, DCT_stride);
+	slice_intra_DCT (decoder, vlc, 0, dest_y + DCT_offset + 8,
+			 DCT_stride);
+	if (chroma_format == 0) {
+	    slice_intra_DCT (decoder, vlc, 1,
+			     decoder->dest[1] + (offset >> 1),
+			     decoder->uv_stride);
+	    slice_intra_DCT (decoder, vlc, 2,
+			     decoder->dest[2] + (offset >> 1),
+			     decoder->uv_stride);
+	} else if (chroma_format == 1) {
+	    uint8_t * dest_u = decoder->dest[1] + (offset >> 1);
+	    uint8_t * dest_v = decoder->dest[2] + (offset >> 1);
+	    DCT_stride >>= 1;
+	    DCT_offset >>= 1;
+	    slice_intra_DCT (decoder, vlc, 1, dest_u, DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 2, dest_v, DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 1, dest_u + DCT_offset,
+			     DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 2, dest_v + DCT_offset,
+			     DCT_stride);
+	} else {
+	    uint8_t * dest_u = decoder->dest[1] + offset;
+	    uint8_t * dest_v = decoder->dest[2] + offset;
+	    slice_intra_DCT (decoder, vlc, 1, dest_u, DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 2, dest_v, DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 1, dest_u + DCT_offset,
+			     DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 2, dest_v + DCT_offset,
+			     DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 1, dest_u + 8, DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 2, dest_v + 8, DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 1, dest_u + DCT_offset + 8,
+			     DCT_stride);
+	    slice_intra_DCT (decoder, vlc, 2, dest_v + DCT_offset + 8,
+			     DCT_stride);
+	}
+
+	NEXT_MACROBLOCK;
+
+	NEEDBITS (bit_buf, bits, bit_ptr);
+	mba_inc = 0;
+	while (1) {
+	    if (bit_buf >= 0x10000000) {
+		mba = MBA_5 + (UBITS (bit_buf, 5) - 2);
+		break;
+	    } else if (bit_buf >= 0x03000000) {
+		mba = MBA_11 + (UBITS (bit_buf, 11) - 24);
+		break;
+	    } else switch (UBITS (bit_buf, 11)) {
+	    case 8:		/* macroblock_escape */
+		mba_inc += 33;
+		/* pass through */
+	    case 15:	/* macroblock_stuffing (MPEG1 only) */
+		DUMPBITS (bit_buf, bits, 11);
+		NEEDBITS (bit_buf, bits, bit_ptr);
+		continue;
+	    default:	/* end of slice, or error */
+		if (mpeg2_cpu_state_restore)
+		    mpeg2_cpu_state_restore (&cpu_state);
+		return;
+	    }
+	}
+	DUMPBITS (bit_buf, bits, mba->len);
+	mba_inc += mba->mba;
+
+	if (mba_inc) {
+	    decoder->dc_dct_pred[0] = decoder->dc_dct_pred[1] =
+		decoder->dc_dct_pred[2] = 16384;
+	    do {
+		NEXT_MACROBLOCK;
+	    } while (--mba_inc);
+	}
+    }
+#undef bit_buf
+#undef bits
+#undef bit_ptr
+}
+
+static void slice_generic (mpeg2_decoder_t * const decoder, const int code,
+			   const uint8_t * const buffer)
+{
+    slice_loop (decoder, code, buffer, 0, decoder->coding_type,
+		decoder->intra_vlc_format, 0);
+}
+
+static void slice_record (mpeg2_decoder_t * const decoder, const int code,
+			  const uint8_t * const buffer)
+{
+    slice_loop (decoder, code, buffer, 0, decoder->coding_type,
+		decoder->intra_vlc_format, 1);
+}
+
+#define SLICE_FIXED(NAME,CODING_TYPE,INTRA_VLC_FORMAT)			\
+static void NAME (mpeg2_decoder_t * const decoder, const int code,	\
+		  const uint8_t * const buffer)				\
+{									\
+    slice_loop (decoder, code, buffer, 1, CODING_TYPE,			\
+		INTRA_VLC_FORMAT, 0);					\
+}
+
+SLICE_FIXED (slice_p_b14, P_TYPE, 0)
+SLICE_FIXED (slice_p_b15, P_TYPE, 1)
+SLICE_FIXED (slice_b_b14, B_TYPE, 0)
+SLICE_FIXED (slice_b_b15, B_TYPE, 1)
+
+#define SLICE_INTRA(NAME,CHROMA_FORMAT,INTRA_VLC_FORMAT)		\
+static void NAME (mpeg2_decoder_t * const decoder, const int code,	\
+		  const uint8_t * const buffer)				\
+{									\
+    slice_intra_loop (decoder, code, buffer, CHROMA_FORMAT,		\
+		      INTRA_VLC_FORMAT);				\
+}
+
+SLICE_INTRA (slice_i_420_b14, 0, 0)
+SLICE_INTRA (slice_i_420_b15, 0, 1)
+SLICE_INTRA (slice_i_422_b14, 1, 0)
+SLICE_INTRA (slice_i_422_b15, 1, 1)
+SLICE_INTRA (slice_i_444_b14, 2, 0)
+SLICE_INTRA (slice_i_444_b15, 2, 1)
+
+/* I pictures use no motion state, see mpeg2_init_fbuf */
+static int slice_intra (mpeg2_decoder_t * const decoder)
+{
+    static void (* const intra[3][2]) (mpeg2_decoder_t *, int,
+					const uint8_t *) = {
+	{slice_i_420_b14, slice_i_420_b15},
+	{slice_i_422_b14, slice_i_422_b15},
+	{slice_i_444_b14, slice_i_444_b15}
+    };
+
+    if (decoder->record || decoder->deferred || decoder->mpeg1 ||
+	decoder->coding_type != I_TYPE)
+	return 0;
+    decoder->slice_loop =
+	intra[decoder->chroma_format][!!decoder->intra_vlc_format];
+    return 1;
+}
+
+static void slice_select (mpeg2_decoder_t * const decoder)
+{
+    static void (* const fixed[2][2]) (mpeg2_decoder_t *, int,
+					const uint8_t *) = {
+	{slice_p_b14, slice_p_b15},
+	{slice_b_b14, slice_b_b15}
+    };
+
+    if (decoder->record)
+	decoder->slice_loop = slice_record;
+    else if (decoder->deferred || decoder->mpeg1 || decoder->chroma_format ||
+	decoder->picture_structure != FRAME_PICTURE ||
+	decoder->coding_type < P_TYPE || decoder->coding_type > B_TYPE)
+	decoder->slice_loop = slice_generic;
+    else
+	decoder->slice_loop =
+	    fixed[decoder->coding_type - P_TYPE][!!decoder->intra_vlc_format];
+}
+
+void mpeg2_slice (mpeg2_decoder_t * const decoder, const int code,
+		  const uint8_t * const buffer)
+{
+    decoder->slice_loop (decoder, code, buffer);
+}
+
+/*
+ * Fills the rows of a B picture from the one of slice "code" to the one
+ * before slice "end", as if each macroblock was predicted from the
+ * forward reference with a zero vector, instead of decoding the slices
+ * that code them.
+ */
+void mpeg2_conceal (mpeg2_decoder_t * const decoder, const int code,
+		    const int end)
+{
+#define bit_buf (decoder->bitstream_buf)
+#define bits (decoder->bitstream_bits)
+#define bit_ptr (decoder->bitstream_ptr)
+    const int coding_type = B_TYPE;
+    cpu_state_t cpu_state;
+    int offset;
+
+    decoder->v_offset = (code - 1) * 16;
+    if (decoder->v_offset > decoder->limit_y)
+	return;
+    offset = 0;
+    if (!(decoder->convert))
+	offset = (code - 1) * decoder->slice_stride;
+    decoder->dest[0] = decoder->picture_dest[0] + offset;
+    offset >>= (2 - decoder->chroma_format);
+    decoder->dest[1] = decoder->picture_dest[1] + offset;
+    decoder->dest[2] = decoder->picture_dest[2] + offset;
+    decoder->offset = 0;
+
+    if (mpeg2_cpu_state_save)
+	mpeg2_cpu_state_save (&cpu_state);
+
+    while (1) {
+	decoder->motion_parser[0] (decoder, &(decoder->f_motion),
+				   mpeg2_mc.put);
+	NEXT_MACROBLOCK;
+	if (!decoder->offset && decoder->v_offset == (end - 1) * 16U)
+	    break;
+    }
+    if (mpeg2_cpu_state_restore)
+	mpeg2_cpu_state_restore (&cpu_state);
+#undef bit_buf
+#undef bits
+#undef bit_ptr
+}
+
+static void motion_init (mpeg2_decoder_t * decoder, uint8_t * current_fbuf[3],
+			 uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3])
+{
+    int offset, stride, bottom_field;
+
+    stride = decoder->stride_frame;
+    bottom_field = (decoder->picture_structure == BOTTOM_FIELD);
+    offset = bottom_field ? stride : 0;
+
+    decoder->f_motion.ref[0][0] = forward_fbuf[0] + offset;
+    decoder->f_motion.ref[0][1] = forward_fbuf[1] + (offset >> 1);
+    decoder->f_motion.ref[0][2] = forward_fbuf[2] + (offset >> 1);
+
+    decoder->b_motion.ref[0][0] = backward_fbuf[0] + offset;
+    decoder->b_motion.ref[0][1] = backward_fbuf[1] + (offset >> 1);
+    decoder->b_motion.ref[0][2] = backward_fbuf[2] + (offset >> 1);
+
+    if (decoder->picture_structure != FRAME_PICTURE) {
+	decoder->dmv_offset = bottom_field ? 1 : -1;
+	decoder->f_motion.ref2[0] = decoder->f_motion.ref[bottom_field];
+	decoder->f_motion.ref2[1] = decoder->f_motion.ref[!bottom_field];
+	decoder->b_motion.ref2[0] = decoder->b_motion.ref[bottom_field];
+	decoder->b_motion.ref2[1] = decoder->b_motion.ref[!bottom_field];
+	offset = stride - offset;
+
+	if (decoder->second_field && (decoder->coding_type != B_TYPE))
+	    forward_fbuf = current_fbuf;
+
+	decoder->f_motion.ref[1][0] = forward_fbuf[0] + offset;
+	decoder->f_motion.ref[1][1] = forward_fbuf[1] + (offset >> 1);
+	decoder->f_motion.ref[1][2] = forward_fbuf[2] + (offset >> 1);
+
+	decoder->b_motion.ref[1][0] = backward_fbuf[0] + offset;
+	decoder->b_motion.ref[1][1] = backward_fbuf[1] + (offset >> 1);
+	decoder->b_motion.ref[1][2] = backward_fbuf[2] + (offset >> 1);
+    }
+
+    if (decoder->deferred)
+	motion_parsers_deferred (decoder);
+    else
+	motion_parsers (decoder);
+}
+
+void mpeg2_init_fbuf (mpeg2_decoder_t * decoder, uint8_t * current_fbuf[3],
+		      uint8_t * forward_fbuf[3], uint8_t * backward_fbuf[3])
+{
+    int offset, stride, height;
+
+    stride = decoder->stride_frame;
+    offset = (decoder->picture_structure == BOTTOM_FIELD) ? stride : 0;
+    height = decoder->height;
+
+    decoder->picture_dest[0] = current_fbuf[0] + offset;
+    decoder->picture_dest[1] = current_fbuf[1] + (offset >> 1);
+    decoder->picture_dest[2] = current_fbuf[2] + (offset >> 1);
+
+    if (decoder->picture_structure != FRAME_PICTURE) {
+	stride <<= 1;
+	height >>= 1;
+    }
+
+    decoder->stride = stride;
+    decoder->uv_stride = stride >> 1;
+    decoder->slice_stride = 16 * stride;
+    decoder->slice_uv_stride =
+	decoder->slice_stride >> (2 - decoder->chroma_format);
+    decoder->limit_x = 2 * decoder->width - 32;
+    decoder->limit_y_16 = 2 * height - 32;
+    decoder->limit_y_8 = 2 * height - 16;
+    decoder->limit_y = height - 16;
+
+    decoder->deferred = decoder->two_pass || decoder->parse_only;
+    if (!slice_intra (decoder)) {
+	motion_init (decoder, current_fbuf, forward_fbuf, backward_fbuf);
+	slice_select (decoder);
+    }
+}
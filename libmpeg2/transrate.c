@@ -0,0 +1,955 @@
+/*
+ * transrate.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <string.h>	/* memcpy/memset */
+#include <inttypes.h>
+
+#include "mpeg2.h"
+#include "attributes.h"
+#include "mpeg2_internal.h"
+
+#include "vlc.h"
+
+/* room for the slice parser to read past the last chunk */
+#define SLACK 4096
+
+/*
+ * Requantization in the compressed domain. Headers are passed through
+ * (with the bit rate and vbv_delay fields updated), and each slice is
+ * parsed down to its run/level pairs, which are requantized with a
+ * coarser quantizer_scale and written back with the same VLC tables.
+ * Motion vectors and intra DC differences are copied bit for bit, so
+ * no IDCT or motion compensation is ever needed.
+ */
+
+typedef struct {
+    int count;
+    unsigned int dc_start, dc_end;	/* intra DC bits in the input */
+    uint8_t run[64];
+    int16_t level[64];
+} block_t;
+
+struct mpeg2_transrate_s {
+    /* input, split in chunks from one start code to the next */
+    uint8_t * buf;
+    unsigned int buf_size, buf_start, buf_end, scan;
+
+    /* bit reader over the current slice */
+    uint32_t bitstream_buf;
+    int bitstream_bits;
+    const uint8_t * bitstream_ptr;
+    const uint8_t * bitstream_start;
+
+    /* bit writer for the requantized slice */
+    uint8_t * out;
+    unsigned int out_size;
+    uint8_t * out_ptr;
+    uint32_t pending;
+    int pending_bits;
+
+    /* sequence and picture parameters */
+    int mpeg1, blocks, vertical_position_extension;
+    unsigned int frame_period, byte_rate;
+    int coding_type, picture_structure, frame_pred_frame_dct;
+    int concealment_motion_vectors, q_scale_type, intra_vlc_format;
+    int repeat_first_field;
+    int f_code[2][2];
+    int new_picture;
+
+    /* rate control */
+    unsigned int bitrate;
+    unsigned long long in_bits, out_bits, fields;
+    unsigned int ratio;	/* output/input, 1/1024 units */
+    int mult;		/* quantizer_scale multiplier, 1/256 units */
+    uint8_t quantizer[32];
+
+    block_t block[12];
+};
+
+static const uint8_t non_linear_scale[32] = {
+     0,  1,  2,  3,  4,  5,   6,   7,
+     8, 10, 12, 14, 16, 18,  20,  22,
+    24, 28, 32, 36, 40, 44,  48,  52,
+    56, 64, 72, 80, 88, 96, 104, 112
+};
+
+typedef struct {
+    uint16_t code;
+    uint8_t len;
+} VLCcode;
+
+/* tables for the write side, built from the decoding tables */
+static VLCcode dct_code[2][32][41];
+static VLCcode mb_code[4][32];
+static VLCcode cbp_code[64];
+
+#define bit_buf (tr->bitstream_buf)
+#define bits (tr->bitstream_bits)
+#define bit_ptr (tr->bitstream_ptr)
+
+/* len is the code length, without the sign bit */
+static inline const DCTtab * dct_lookup (const uint32_t code, const int table,
+					 int * const len)
+{
+    const DCTtab * tab;
+
+    if (table == 2 && code >= 0x04000000)
+	tab = DCT_B15_8 + (UBITS (code, 8) - 4);
+    else if (table == 2 && code >= 0x02000000)
+	tab = DCT_B15_10 + (UBITS (code, 10) - 8);
+    else if (table < 2 && code >= 0x28000000)
+	tab = (table ? DCT_B14AC_5 : DCT_B14DC_5) + (UBITS (code, 5) - 5);
+    else if (table < 2 && code >= 0x04000000)
+	tab = DCT_B14_8 + (UBITS (code, 8) - 4);
+    else if (table < 2 && code >= 0x02000000)
+	tab = DCT_B14_10 + (UBITS (code, 10) - 8);
+    else if (code >= 0x00800000)
+	tab = DCT_13 + (UBITS (code, 13) - 16);
+    else if (code >= 0x00200000)
+	tab = DCT_15 + (UBITS (code, 15) - 16);
+    else {
+	tab = DCT_16 + UBITS (code, 16);
+	*len = 16;
+	return tab;
+    }
+    *len = tab->len;
+    return tab;
+}
+
+static void init_tables (void)
+{
+    static int done = 0;
+    const DCTtab * tab;
+    int table, code, len;
+
+    if (done)
+	return;
+    done = 1;
+
+    for (table = 1; table <= 2; table++)
+	for (code = 0; code < 65536; code++) {
+	    tab = dct_lookup ((uint32_t) code << 16, table, &len);
+	    if (tab->run > 32 || tab->level > 40 ||
+		dct_code[table - 1][tab->run - 1][tab->level].len)
+		continue;
+	    dct_code[table - 1][tab->run - 1][tab->level].code =
+		code >> (16 - len);
+	    dct_code[table - 1][tab->run - 1][tab->level].len = len;
+	}
+
+    mb_code[I_TYPE][MACROBLOCK_INTRA].code = 1;
+    mb_code[I_TYPE][MACROBLOCK_INTRA].len = 1;
+    mb_code[I_TYPE][MACROBLOCK_INTRA | MACROBLOCK_QUANT].code = 1;
+    mb_code[I_TYPE][MACROBLOCK_INTRA | MACROBLOCK_QUANT].len = 2;
+    for (code = 0; code < 32; code++)
+	if (!mb_code[P_TYPE][MB_P[code].modes].len) {
+	    len = MB_P[code].len;
+	    /* intra with quant is the only 6 bit code */
+	    mb_code[P_TYPE][MB_P[code].modes].code =
+		(len > 5) ? 1 : code >> (5 - len);
+	    mb_code[P_TYPE][MB_P[code].modes].len = len;
+	}
+    for (code = 1; code < 64; code++)
+	if (!mb_code[B_TYPE][MB_B[code].modes].len) {
+	    len = MB_B[code].len;
+	    mb_code[B_TYPE][MB_B[code].modes].code = code >> (6 - len);
+	    mb_code[B_TYPE][MB_B[code].modes].len = len;
+	}
+
+    for (code = 16; code < 128; code++)
+	if (!cbp_code[CBP_7[code - 16].cbp].len) {
+	    len = CBP_7[code - 16].len;
+	    cbp_code[CBP_7[code - 16].cbp].code = code >> (7 - len);
+	    cbp_code[CBP_7[code - 16].cbp].len = len;
+	}
+    for (code = 1; code < 64; code++)
+	if (!cbp_code[CBP_9[code].cbp].len) {
+	    len = CBP_9[code].len;
+	    cbp_code[CBP_9[code].cbp].code = code >> (9 - len);
+	    cbp_code[CBP_9[code].cbp].len = len;
+	}
+}
+
+static inline void bitstream_start (mpeg2_transrate_t * tr,
+				    const uint8_t * start)
+{
+    bit_buf = (((uint32_t) start[0] << 24) | (start[1] << 16) |
+	       (start[2] << 8) | start[3]);
+    bit_ptr = start + 4;
+    bits = -16;
+    tr->bitstream_start = start;
+}
+
+static inline unsigned int bit_position (mpeg2_transrate_t * tr)
+{
+    return 8 * (bit_ptr - tr->bitstream_start) + bits - 16;
+}
+
+/* n must be at most 24 */
+static inline void put_bits (mpeg2_transrate_t * tr, uint32_t value, int n)
+{
+    tr->pending = (tr->pending << n) | value;
+    tr->pending_bits += n;
+    while (tr->pending_bits >= 8) {
+	tr->pending_bits -= 8;
+	*tr->out_ptr++ = tr->pending >> tr->pending_bits;
+    }
+}
+
+/* copies the input bits from start to end, as they are */
+static void copy_bits (mpeg2_transrate_t * tr, unsigned int start,
+		       unsigned int end)
+{
+    const uint8_t * p = tr->bitstream_start + (start >> 3);
+    int n;
+
+    if (start & 7) {
+	n = 8 - (start & 7);
+	if (n > (int) (end - start))
+	    n = end - start;
+	put_bits (tr, (*p++ >> (8 - (start & 7) - n)) & ((1 << n) - 1), n);
+	start += n;
+    }
+    for (; end - start >= 8; start += 8)
+	put_bits (tr, *p++, 8);
+    if (end > start)
+	put_bits (tr, *p >> (8 - (end - start)), end - start);
+}
+
+static inline void skip_motion_delta (mpeg2_transrate_t * tr, const int r)
+{
+    const MVtab * tab;
+
+    NEEDBITS (bit_buf, bits, bit_ptr);
+    if (bit_buf & 0x80000000) {
+	DUMPBITS (bit_buf, bits, 1);
+	return;
+    } else if (bit_buf >= 0x0c000000)
+	tab = MV_4 + UBITS (bit_buf, 4);
+    else
+	tab = MV_10 + UBITS (bit_buf, 10);
+    DUMPBITS (bit_buf, bits, tab->len + 1);	/* code and sign */
+    NEEDBITS (bit_buf, bits, bit_ptr);
+    DUMPBITS (bit_buf, bits, r);
+}
+
+static inline void skip_dmv (mpeg2_transrate_t * tr)
+{
+    NEEDBITS (bit_buf, bits, bit_ptr);
+    DUMPBITS (bit_buf, bits, DMV_2[UBITS (bit_buf, 2)].len);
+}
+
+static void skip_motion (mpeg2_transrate_t * tr, const int * const f_code,
+			 const int motion_type)
+{
+    int i, n;
+
+    if (motion_type == MC_DMV) {
+	skip_motion_delta (tr, f_code[0]);
+	skip_dmv (tr);
+	skip_motion_delta (tr, f_code[1]);
+	skip_dmv (tr);
+	return;
+    }
+    n = 1;
+    if (tr->picture_structure == FRAME_PICTURE ? motion_type == MC_FIELD :
+	motion_type == MC_16X8)
+	n = 2;
+    for (i = 0; i < n; i++) {
+	if (tr->picture_structure != FRAME_PICTURE || motion_type == MC_FIELD) {
+	    NEEDBITS (bit_buf, bits, bit_ptr);
+	    DUMPBITS (bit_buf, bits, 1);	/* field_select */
+	}
+	skip_motion_delta (tr, f_code[0]);
+	skip_motion_delta (tr, f_code[1]);
+    }
+}
+
+static inline void skip_dc (mpeg2_transrate_t * tr, const int cc)
+{
+    const DCtab * tab;
+
+    NEEDBITS (bit_buf, bits, bit_ptr);
+    if (bit_buf < 0xf8000000) {
+	tab = (cc ? DC_chrom_5 : DC_lum_5) + UBITS (bit_buf, 5);
+	DUMPBITS (bit_buf, bits, tab->size ? tab->len : 3 - !!cc);
+    } else if (!cc) {
+	tab = DC_long + (UBITS (bit_buf, 9) - 0x1e0);
+	DUMPBITS (bit_buf, bits, tab->len);
+    } else {
+	tab = DC_long + (UBITS (bit_buf, 10) - 0x3e0);
+	DUMPBITS (bit_buf, bits, tab->len + 1);
+    }
+    NEEDBITS (bit_buf, bits, bit_ptr);
+    DUMPBITS (bit_buf, bits, tab->size);
+}
+
+/*
+ * table is 0 for the first coefficient of a non intra block, 1 for
+ * table B-14 and 2 for table B-15. Returns 1 on a bitstream error.
+ */
+static int get_block (mpeg2_transrate_t * tr, block_t * const block,
+		      int table)
+{
+    const DCTtab * tab;
+    int i, run, level, len;
+
+    block->count = 0;
+    i = table ? 0 : -1;
+    while (1) {
+	NEEDBITS (bit_buf, bits, bit_ptr);
+	tab = dct_lookup (bit_buf, table, &len);
+	if (tab->run == 129) {
+	    if (len > 4)
+		return 1;
+	    DUMPBITS (bit_buf, bits, len);	/* end of block */
+	    return 0;
+	} else if (tab->run == 65) {
+	    run = UBITS (bit_buf << 6, 6);
+	    DUMPBITS (bit_buf, bits, 12);
+	    NEEDBITS (bit_buf, bits, bit_ptr);
+	    if (tr->mpeg1) {
+		level = SBITS (bit_buf, 8);
+		if (! (level & 0x7f)) {
+		    DUMPBITS (bit_buf, bits, 8);
+		    level = UBITS (bit_buf, 8) + 2 * level;
+		}
+		DUMPBITS (bit_buf, bits, 8);
+	    } else {
+		level = SBITS (bit_buf, 12);
+		DUMPBITS (bit_buf, bits, 12);
+	    }
+	    if (!level)
+		return 1;
+	} else {
+	    run = tab->run - 1;
+	    level = tab->level;
+	    DUMPBITS (bit_buf, bits, len);
+	    NEEDBITS (bit_buf, bits, bit_ptr);
+	    if (bit_buf & 0x80000000)
+		level = -level;
+	    DUMPBITS (bit_buf, bits, 1);
+	}
+	i += run + 1;
+	if (i >= 64)
+	    return 1;
+	block->run[block->count] = run;
+	block->level[block->count++] = level;
+	if (!table)
+	    table = 1;
+    }
+}
+
+static void put_block (mpeg2_transrate_t * tr, const block_t * const block,
+		       const int table, const int intra)
+{
+    int i, run, level, sign, len;
+
+    for (i = 0; i < block->count; i++) {
+	run = block->run[i];
+	level = block->level[i];
+	sign = level < 0;
+	if (sign)
+	    level = -level;
+	if (!i && !intra && !run && level == 1)
+	    put_bits (tr, 2 | sign, 2);
+	else if (run < 32 && level <= 40 &&
+		 (len = dct_code[table - 1][run][level].len))
+	    put_bits (tr, (dct_code[table - 1][run][level].code << 1) | sign,
+		      len + 1);
+	else {
+	    put_bits (tr, (1 << 6) | run, 12);	/* escape */
+	    if (sign)
+		level = -level;
+	    if (!tr->mpeg1)
+		put_bits (tr, level & 0xfff, 12);
+	    else if (level >= -127 && level <= 127)
+		put_bits (tr, level & 0xff, 8);
+	    else
+		put_bits (tr, (level < 0 ? 0x8000 : 0) | (level & 0xff), 16);
+	}
+    }
+    if (table == 2)
+	put_bits (tr, 6, 4);	/* end of block */
+    else
+	put_bits (tr, 2, 2);
+}
+
+/* returns 1 if none of the coefficients is left */
+static int requantize (block_t * const block, const int intra,
+		       const int q_in, const int q_out)
+{
+    int i, j, run, level;
+
+    run = 0;
+    for (i = j = 0; i < block->count; i++) {
+	level = block->level[i];
+	if (level < 0)
+	    level = -level;
+	if (intra)
+	    level = (level * q_in + (q_out >> 1)) / q_out;
+	else
+	    level = ((2 * level + 1) * q_in) / (2 * q_out);
+	run += block->run[i];
+	if (!level) {
+	    run++;
+	    continue;
+	}
+	block->run[j] = run;
+	block->level[j++] = (block->level[i] < 0) ? -level : level;
+	run = 0;
+    }
+    block->count = j;
+    return !j;
+}
+
+static inline int scale (mpeg2_transrate_t * tr, const int code)
+{
+    return tr->q_scale_type ? non_linear_scale[code] : 2 * code;
+}
+
+static void set_quantizer (mpeg2_transrate_t * tr)
+{
+    int i, code, target;
+
+    code = 1;
+    for (i = 1; i < 32; i++) {
+	target = (scale (tr, i) * tr->mult + 255) >> 8;
+	if (code < i)
+	    code = i;
+	while (code < 31 && scale (tr, code) < target)
+	    code++;
+	tr->quantizer[i] = code;
+    }
+}
+
+/*
+ * Requantizes one slice into tr->out. Returns 1 if the slice could not
+ * be parsed, in which case it is passed through unchanged.
+ */
+static int transrate_slice (mpeg2_transrate_t * tr, const uint8_t * chunk,
+			    unsigned int len)
+{
+    const int frame_picture = tr->picture_structure == FRAME_PICTURE;
+    const int vlc = tr->mpeg1 ? 1 : 1 + tr->intra_vlc_format;
+    const int blocks = tr->blocks;
+    const unsigned int size = 8 * (len - 4);
+    unsigned int start, mv_start, mv_end;
+    int q_in, q_out, mb_q, modes, motion_type, dct_type, cbp, b;
+    const MBtab * tab;
+    const MBAtab * mba;
+
+    tr->out_ptr = tr->out;
+    tr->pending = tr->pending_bits = 0;
+    put_bits (tr, 1, 24);
+    put_bits (tr, chunk[3], 8);
+
+    bitstream_start (tr, chunk + 4);
+    start = 0;
+    if (tr->vertical_position_extension)
+	DUMPBITS (bit_buf, bits, 3);
+    q_in = UBITS (bit_buf, 5);
+    DUMPBITS (bit_buf, bits, 5);
+    if (!q_in)
+	return 1;
+    copy_bits (tr, start, bit_position (tr) - 5);
+    q_out = tr->quantizer[q_in];
+    put_bits (tr, q_out, 5);
+
+    /* intra_slice and the extra data */
+    start = bit_position (tr);
+    NEEDBITS (bit_buf, bits, bit_ptr);
+    while (bit_buf & 0x80000000) {
+	DUMPBITS (bit_buf, bits, 9);
+	NEEDBITS (bit_buf, bits, bit_ptr);
+    }
+    DUMPBITS (bit_buf, bits, 1);
+
+    while (1) {
+	/* macroblock_address_increment, copied as it is */
+	NEEDBITS (bit_buf, bits, bit_ptr);
+	while (1) {
+	    if (bit_buf >= 0x10000000) {
+		mba = MBA_5 + (UBITS (bit_buf, 5) - 2);
+		break;
+	    } else if (bit_buf >= 0x03000000) {
+		mba = MBA_11 + (UBITS (bit_buf, 11) - 24);
+		break;
+	    } else switch (UBITS (bit_buf, 11)) {
+	    case 8:		/* macroblock_escape */
+	    case 15:	/* macroblock_stuffing (MPEG1 only) */
+		DUMPBITS (bit_buf, bits, 11);
+		NEEDBITS (bit_buf, bits, bit_ptr);
+		continue;
+	    default:	/* end of slice, or error */
+		if (UBITS (bit_buf, 11) || bit_position (tr) > size)
+		    return 1;
+		if (tr->pending_bits)
+		    put_bits (tr, 0, 8 - tr->pending_bits);
+		return 0;
+	    }
+	}
+	DUMPBITS (bit_buf, bits, mba->len);
+	copy_bits (tr, start, bit_position (tr));
+
+	NEEDBITS (bit_buf, bits, bit_ptr);
+	switch (tr->coding_type) {
+	case I_TYPE:
+	    tab = MB_I + UBITS (bit_buf, 1);
+	    break;
+	case P_TYPE:
+	    tab = MB_P + UBITS (bit_buf, 5);
+	    break;
+	default:
+	    tab = MB_B + UBITS (bit_buf, 6);
+	    if (!tab->modes)
+		return 1;
+	}
+	DUMPBITS (bit_buf, bits, tab->len);
+	modes = tab->modes;
+
+	motion_type = MC_FRAME;
+	if (!tr->mpeg1 && !(frame_picture && tr->frame_pred_frame_dct) &&
+	    (modes & (MACROBLOCK_MOTION_FORWARD |
+		      MACROBLOCK_MOTION_BACKWARD))) {
+	    motion_type = UBITS (bit_buf, 2);
+	    DUMPBITS (bit_buf, bits, 2);
+	    if (!motion_type)
+		return 1;
+	}
+	dct_type = 0;
+	if (frame_picture && !tr->frame_pred_frame_dct &&
+	    (modes & (MACROBLOCK_INTRA | MACROBLOCK_PATTERN))) {
+	    dct_type = UBITS (bit_buf, 1);
+	    DUMPBITS (bit_buf, bits, 1);
+	}
+	if (modes & MACROBLOCK_QUANT) {
+	    q_in = UBITS (bit_buf, 5);
+	    DUMPBITS (bit_buf, bits, 5);
+	    if (!q_in)
+		return 1;
+	}
+
+	mv_start = bit_position (tr);
+	if (modes & MACROBLOCK_INTRA) {
+	    if (tr->concealment_motion_vectors) {
+		if (!frame_picture) {
+		    NEEDBITS (bit_buf, bits, bit_ptr);
+		    DUMPBITS (bit_buf, bits, 1);	/* field_select */
+		}
+		skip_motion_delta (tr, tr->f_code[0][0]);
+		skip_motion_delta (tr, tr->f_code[0][1]);
+		NEEDBITS (bit_buf, bits, bit_ptr);
+		DUMPBITS (bit_buf, bits, 1);	/* marker_bit */
+	    }
+	} else {
+	    if (modes & MACROBLOCK_MOTION_FORWARD)
+		skip_motion (tr, tr->f_code[0], motion_type);
+	    if (modes & MACROBLOCK_MOTION_BACKWARD)
+		skip_motion (tr, tr->f_code[1], motion_type);
+	}
+	mv_end = bit_position (tr);
+
+	cbp = 0;
+	if (modes & MACROBLOCK_INTRA) {
+	    for (b = 0; b < blocks; b++) {
+		tr->block[b].dc_start = bit_position (tr);
+		skip_dc (tr, (b < 4) ? 0 : 1 + (b & 1));
+		tr->block[b].dc_end = bit_position (tr);
+		if (get_block (tr, tr->block + b, vlc))
+		    return 1;
+	    }
+	} else if (modes & MACROBLOCK_PATTERN) {
+	    const CBPtab * cbp_tab;
+
+	    NEEDBITS (bit_buf, bits, bit_ptr);
+	    if (bit_buf >= 0x20000000)
+		cbp_tab = CBP_7 + (UBITS (bit_buf, 7) - 16);
+	    else
+		cbp_tab = CBP_9 + UBITS (bit_buf, 9);
+	    DUMPBITS (bit_buf, bits, cbp_tab->len);
+	    cbp = cbp_tab->cbp;
+	    if (blocks > 6) {
+		/* extension bits, block 6 first */
+		for (b = 6; b < blocks; b++) {
+		    cbp |= UBITS (bit_buf, 1) << b;
+		    DUMPBITS (bit_buf, bits, 1);
+		}
+	    }
+	    for (b = 0; b < blocks; b++)
+		if ((cbp & (1 << b)) && get_block (tr, tr->block + b, 0))
+		    return 1;
+	}
+
+	/* requantize, possibly changing the macroblock type */
+	mb_q = tr->quantizer[q_in];
+	modes &= ~MACROBLOCK_QUANT;
+	if (modes & MACROBLOCK_INTRA) {
+	    if (mb_q != q_in)
+		for (b = 0; b < blocks; b++)
+		    requantize (tr->block + b, 1, scale (tr, q_in),
+				scale (tr, mb_q));
+	    if (mb_q != q_out)
+		modes |= MACROBLOCK_QUANT;
+	} else if (modes & MACROBLOCK_PATTERN) {
+	    int new_cbp = cbp;
+
+	    if (mb_q != q_in)
+		for (b = 0; b < blocks; b++)
+		    if ((cbp & (1 << b)) &&
+			requantize (tr->block + b, 0, scale (tr, q_in),
+				    scale (tr, mb_q)))
+			new_cbp &= ~(1 << b);
+	    if (new_cbp)
+		;
+	    else if (modes & (MACROBLOCK_MOTION_FORWARD |
+			      MACROBLOCK_MOTION_BACKWARD))
+		modes &= ~MACROBLOCK_PATTERN;
+	    else if (tr->mpeg1) {
+		/* MPEG-1 has no code for an empty pattern: keep one ±1 */
+		for (b = 0; !(cbp & (1 << b)); b++);
+		tr->block[b].count = 1;
+		tr->block[b].level[0] = (tr->block[b].level[0] < 0) ? -1 : 1;
+		new_cbp = 1 << b;
+	    }
+	    cbp = new_cbp;
+	    if (cbp && mb_q != q_out)
+		modes |= MACROBLOCK_QUANT;
+	}
+	if (modes & MACROBLOCK_QUANT)
+	    q_out = mb_q;
+
+	/* write the macroblock back */
+	put_bits (tr, mb_code[tr->coding_type][modes].code,
+		  mb_code[tr->coding_type][modes].len);
+	if (!tr->mpeg1 && !(frame_picture && tr->frame_pred_frame_dct) &&
+	    (modes & (MACROBLOCK_MOTION_FORWARD |
+		      MACROBLOCK_MOTION_BACKWARD)))
+	    put_bits (tr, motion_type, 2);
+	if (frame_picture && !tr->frame_pred_frame_dct &&
+	    (modes & (MACROBLOCK_INTRA | MACROBLOCK_PATTERN)))
+	    put_bits (tr, dct_type, 1);
+	if (modes & MACROBLOCK_QUANT)
+	    put_bits (tr, q_out, 5);
+	copy_bits (tr, mv_start, mv_end);
+	if (modes & MACROBLOCK_INTRA)
+	    for (b = 0; b < blocks; b++) {
+		copy_bits (tr, tr->block[b].dc_start, tr->block[b].dc_end);
+		put_block (tr, tr->block + b, vlc, 1);
+	    }
+	else if (modes & MACROBLOCK_PATTERN) {
+	    put_bits (tr, cbp_code[cbp & 63].code, cbp_code[cbp & 63].len);
+	    for (b = 6; b < blocks; b++)
+		put_bits (tr, (cbp >> b) & 1, 1);
+	    for (b = 0; b < blocks; b++)
+		if (cbp & (1 << b))
+		    put_block (tr, tr->block + b, 1, 0);
+	}
+
+	start = bit_position (tr);
+	if (start > size ||
+	    tr->out_ptr - tr->out > (int)(tr->out_size - 4096))
+	    return 1;
+    }
+}
+
+#undef bit_buf
+#undef bits
+#undef bit_ptr
+
+static void header (mpeg2_transrate_t * tr, uint8_t * chunk, unsigned int len)
+{
+    static const unsigned int frame_period[16] = {
+	0, 1126125, 1125000, 1080000, 900900, 900000, 540000, 450450, 450000,
+	1800000, 5400000, 2700000, 2250000, 1800000, 0, 0
+    };
+    static const int blocks[4] = {6, 6, 8, 12};
+    uint8_t * buffer = chunk + 4;
+    unsigned int rate;
+
+    switch (chunk[3]) {
+    case 0x00:	/* picture_start_code */
+	if (len < 8)
+	    break;
+	tr->coding_type = (buffer[1] >> 3) & 7;
+	tr->new_picture = 1;
+	if (tr->bitrate) {
+	    /* the vbv_delay is meaningless once the sizes change */
+	    buffer[1] |= 0x07;
+	    buffer[2] = 0xff;
+	    buffer[3] |= 0xf8;
+	}
+	if (!tr->mpeg1)
+	    break;
+	tr->picture_structure = FRAME_PICTURE;
+	tr->frame_pred_frame_dct = 1;
+	tr->concealment_motion_vectors = tr->q_scale_type = 0;
+	tr->intra_vlc_format = tr->repeat_first_field = 0;
+	if (len < 9)	/* I pictures have no motion vectors */
+	    break;
+	tr->f_code[0][0] = tr->f_code[0][1] =
+	    (((buffer[3] << 1) | (buffer[4] >> 7)) & 7) - 1;
+	tr->f_code[1][0] = tr->f_code[1][1] = ((buffer[4] >> 3) & 7) - 1;
+	break;
+
+    case 0xb3:	/* sequence_header_code */
+	if (len < 12)
+	    break;
+	tr->mpeg1 = 1;
+	tr->blocks = 6;
+	tr->vertical_position_extension =
+	    (((buffer[1] & 15) << 8) | buffer[2]) > 2800;
+	tr->frame_period = frame_period[buffer[3] & 15];
+	tr->byte_rate = (buffer[4] << 10) | (buffer[5] << 2) | (buffer[6] >> 6);
+	rate = (tr->bitrate + 399) / 400;
+	if (tr->bitrate && rate < tr->byte_rate) {
+	    buffer[4] = rate >> 10;
+	    buffer[5] = rate >> 2;
+	    buffer[6] = (buffer[6] & 0x3f) | (rate << 6);
+	}
+	break;
+
+    case 0xb5:	/* extension_start_code */
+	if (len < 8)
+	    break;
+	switch (buffer[0] >> 4) {
+	case 1:	/* sequence extension */
+	    if (len < 10)
+		break;
+	    tr->mpeg1 = 0;
+	    tr->blocks = blocks[(buffer[1] >> 1) & 3];
+	    tr->frame_period = (tr->frame_period * ((buffer[5] & 31) + 1) /
+				(((buffer[5] >> 5) & 3) + 1));
+	    /* the bit_rate_extension is left alone, it is only an upper bound */
+	    tr->byte_rate |= (((buffer[2] & 31) << 7) | (buffer[3] >> 1)) << 18;
+	    break;
+	case 8:	/* picture coding extension */
+	    tr->f_code[0][0] = (buffer[0] & 15) - 1;
+	    tr->f_code[0][1] = (buffer[1] >> 4) - 1;
+	    tr->f_code[1][0] = (buffer[1] & 15) - 1;
+	    tr->f_code[1][1] = (buffer[2] >> 4) - 1;
+	    tr->picture_structure = buffer[2] & 3;
+	    tr->frame_pred_frame_dct = (buffer[3] >> 6) & 1;
+	    tr->concealment_motion_vectors = (buffer[3] >> 5) & 1;
+	    tr->q_scale_type = (buffer[3] >> 4) & 1;
+	    tr->intra_vlc_format = (buffer[3] >> 3) & 1;
+	    tr->repeat_first_field = (buffer[3] >> 1) & 1;
+	    break;
+	}
+	break;
+    }
+}
+
+/*
+ * Rate control: the target output/input ratio comes from the budget
+ * of the pictures seen so far, and the quantizer multiplier is moved
+ * after each slice in proportion to how far the output is from it.
+ */
+static void picture_budget (mpeg2_transrate_t * tr)
+{
+    unsigned long long ticks, budget;
+
+    tr->new_picture = 0;
+    if (!tr->bitrate || !tr->frame_period)
+	return;
+    /* 27 MHz ticks over two fields per frame */
+    ticks = tr->fields * tr->frame_period;
+    budget = ((ticks / 54000000) * tr->bitrate +
+	      (ticks % 54000000) * tr->bitrate / 54000000);
+    if (tr->fields && tr->in_bits)
+	tr->ratio = (budget << 10) / tr->in_bits;
+    else if (400ULL * tr->byte_rate > tr->bitrate)
+	tr->ratio = ((unsigned long long) tr->bitrate << 10) /
+	    (400ULL * tr->byte_rate);
+    else
+	tr->ratio = 1024;
+    if (tr->ratio > 1024)
+	tr->ratio = 1024;
+    else if (!tr->ratio)
+	tr->ratio = 1;
+    if (tr->picture_structure != FRAME_PICTURE)
+	tr->fields += 1;
+    else
+	tr->fields += 2 + tr->repeat_first_field;
+}
+
+static void rate_control (mpeg2_transrate_t * tr)
+{
+    long long error;
+    int delta;
+
+    if (!tr->bitrate || !tr->ratio)
+	return;
+    error = tr->out_bits - ((tr->in_bits * tr->ratio) >> 10);
+    delta = (tr->mult * error) / (tr->bitrate / 4 + 1);
+    if (delta > tr->mult / 8)
+	delta = tr->mult / 8;
+    else if (delta < -tr->mult / 8)
+	delta = -tr->mult / 8;
+    tr->mult += delta;
+    if (tr->mult < 256)
+	tr->mult = 256;
+    else if (tr->mult > 256 * 16)
+	tr->mult = 256 * 16;
+}
+
+static int chunk (mpeg2_transrate_t * tr, uint8_t * data, unsigned int len,
+		  mpeg2_write_t * callback, void * arg)
+{
+    int code, result;
+
+    code = (len >= 4 && !data[0] && !data[1] && data[2] == 1) ? data[3] : -1;
+    tr->in_bits += 8 * len;
+    if (code >= 0x01 && code <= 0xaf) {
+	if (tr->new_picture)
+	    picture_budget (tr);
+	if (tr->mult > 256 && tr->coding_type >= I_TYPE &&
+	    tr->coding_type <= B_TYPE) {
+	    if (tr->out_size < len + 4096) {
+		mpeg2_free (tr->out);
+		tr->out_size = 2 * len + 4096;
+		tr->out = (uint8_t *) mpeg2_malloc (tr->out_size,
+						    MPEG2_ALLOC_CHUNK);
+		if (tr->out == NULL) {
+		    tr->out_size = 0;
+		    return -1;
+		}
+	    }
+	    set_quantizer (tr);
+	    if (!transrate_slice (tr, data, len) &&
+		(unsigned int) (tr->out_ptr - tr->out) < len) {
+		data = tr->out;
+		len = tr->out_ptr - tr->out;
+	    }
+	}
+	tr->out_bits += 8 * len;
+	result = callback (arg, data, len);
+	rate_control (tr);
+	return result;
+    }
+    if (code >= 0)
+	header (tr, data, len);
+    tr->out_bits += 8 * len;
+    return callback (arg, data, len);
+}
+
+mpeg2_transrate_t * mpeg2_transrate_init (unsigned int bitrate)
+{
+    mpeg2_transrate_t * tr;
+
+    init_tables ();
+
+    tr = (mpeg2_transrate_t *) mpeg2_malloc (sizeof (mpeg2_transrate_t),
+					     MPEG2_ALLOC_MPEG2DEC);
+    if (tr == NULL)
+	return NULL;
+    memset (tr, 0, sizeof (mpeg2_transrate_t));
+    tr->bitrate = bitrate;
+    tr->mult = 256;
+    tr->picture_structure = FRAME_PICTURE;
+    return tr;
+}
+
+/* returns a pointer to the code following the next 00 00 01, or NULL */
+static uint8_t * find_start_code (uint8_t * p, const uint8_t * end)
+{
+    for (p += 2; p < end - 1; )
+	if (*p > 1)
+	    p += 3;
+	else if (*p == 0)
+	    p++;
+	else if (p[-1] | p[-2])
+	    p += 3;
+	else
+	    return p + 1;
+    return NULL;
+}
+
+int mpeg2_transrate (mpeg2_transrate_t * tr, const uint8_t * start,
+		     const uint8_t * end, mpeg2_write_t * callback, void * arg)
+{
+    unsigned int size;
+    uint8_t * buf;
+    uint8_t * code;
+    int result;
+
+    /* keep the chunk in progress at the head of the buffer */
+    if (tr->buf_start) {
+	memmove (tr->buf, tr->buf + tr->buf_start,
+		 tr->buf_end - tr->buf_start);
+	tr->buf_end -= tr->buf_start;
+	tr->scan -= tr->buf_start;
+	tr->buf_start = 0;
+    }
+    size = tr->buf_end + (end - start);
+    if (size + SLACK > tr->buf_size) {
+	buf = (uint8_t *) mpeg2_malloc (2 * size + SLACK, MPEG2_ALLOC_CHUNK);
+	if (buf == NULL)
+	    return -1;
+	if (tr->buf_end)
+	    memcpy (buf, tr->buf, tr->buf_end);
+	mpeg2_free (tr->buf);
+	tr->buf = buf;
+	tr->buf_size = 2 * size + SLACK;
+    }
+    memcpy (tr->buf + tr->buf_end, start, end - start);
+    tr->buf_end = size;
+
+    if (tr->scan < tr->buf_start + 1)
+	tr->scan = tr->buf_start + 1;
+    while ((code = find_start_code (tr->buf + tr->scan,
+				    tr->buf + tr->buf_end)) != NULL) {
+	result = chunk (tr, tr->buf + tr->buf_start,
+			code - 3 - (tr->buf + tr->buf_start), callback, arg);
+	tr->buf_start = code - 3 - tr->buf;
+	tr->scan = tr->buf_start + 1;
+	if (result)
+	    return result;
+    }
+    if (tr->buf_end >= 3 && tr->scan < tr->buf_end - 3)
+	tr->scan = tr->buf_end - 3;
+    return 0;
+}
+
+int mpeg2_transrate_flush (mpeg2_transrate_t * tr,
+			   mpeg2_write_t * callback, void * arg)
+{
+    int result;
+
+    if (tr->buf_end == tr->buf_start)
+	return 0;
+    memset (tr->buf + tr->buf_end, 0, tr->buf_size - tr->buf_end);
+    result = chunk (tr, tr->buf + tr->buf_start, tr->buf_end - tr->buf_start,
+		    callback, arg);
+    tr->buf_start = tr->buf_end = tr->scan = 0;
+    return result;
+}
+
+void mpeg2_transrate_close (mpeg2_transrate_t * tr)
+{
+    mpeg2_free (tr->buf);
+    mpeg2_free (tr->out);
+    mpeg2_free (tr);
+}
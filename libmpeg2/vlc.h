@@ -26,19 +26,10 @@
 
 #define GETWORD(bit_buf,shift,bit_ptr)				\
 do {								\
-    bit_buf |= ((bit_ptr[0] << 8) | bit_ptr[1]) << (shift);	\
+    bit_buf |= (uint32_t) ((bit_ptr[0] << 8) | bit_ptr[1]) << (shift);	\
     bit_ptr += 2;						\
 } while (0)
 
-static inline void bitstream_init (mpeg2_decoder_t * decoder,
-				   const uint8_t * start)
-{
-    decoder->bitstream_buf =
-	(start[0] << 24) | (start[1] << 16) | (start[2] << 8) | start[3];
-    decoder->bitstream_ptr = start + 4;
-    decoder->bitstream_bits = -16;
-}
-
 /* make sure that there are at least 16 valid bits in bit_buf */
 #define NEEDBITS(bit_buf,bits,bit_ptr)		\
 do {						\
@@ -36,6 +36,7 @@
 typedef struct pgm_instance_s {
     vo_instance_t vo;
     int framenum;
+    char prefix[32];
     int width;
     int height;
     int chroma_width;
@@ -81,7 +82,7 @@ static void pgm_draw_frame (vo_instance_t * _instance,
     pgm_instance_t * instance = (pgm_instance_t *) _instance;
     char filename[128];
 
-    sprintf (filename, "%d.pgm", instance->framenum++);
+    sprintf (filename, "%s%d.pgm", instance->prefix, instance->framenum++);
     instance->file = fopen (filename, "wb");
     if (instance->file == NULL)
 	return;
@@ -137,6 +138,7 @@ static vo_instance_t * internal_open (void draw (vo_instance_t *,
     instance->vo.discard = NULL;
     instance->vo.close = (void (*) (vo_instance_t *)) free;
     instance->framenum = 0;
+    instance->prefix[0] = '\0';
     instance->writer = writer;
     instance->file = stdout;
 
@@ -334,12 +336,24 @@ static void md5_draw_frame (vo_instance_t * _instance,
     little_endian (instance->md5_block, 14);
     md5_transform (instance->md5_hash, instance->md5_block);
 
-    printf ("%08x%08x%08x%08x *%d.pgm\n", swap (instance->md5_hash[0]),
+    printf ("%08x%08x%08x%08x *%s%d.pgm\n", swap (instance->md5_hash[0]),
 	    swap (instance->md5_hash[1]) , swap (instance->md5_hash[2]),
-	    swap (instance->md5_hash[3]), instance->framenum++);
+	    swap (instance->md5_hash[3]), instance->prefix,
+	    instance->framenum++);
 }
 
 vo_instance_t * vo_md5_open (void)
 {
     return internal_open (md5_draw_frame, md5_writer);
 }
+
+void vo_name_frames (vo_instance_t * _instance, const char * prefix)
+{
+    pgm_instance_t * instance = (pgm_instance_t *) _instance;
+
+    if (_instance->draw == pgm_draw_frame ||
+	_instance->draw == md5_draw_frame) {
+	strncpy (instance->prefix, prefix, sizeof (instance->prefix) - 1);
+	instance->prefix[sizeof (instance->prefix) - 1] = '\0';
+    }
+}
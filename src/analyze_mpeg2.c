@@ -0,0 +1,412 @@
+/*
+ * analyze_mpeg2.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#ifdef HAVE_IO_H
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <inttypes.h>
+
+#include "mpeg2demux.h"
+
+/*
+ * Header only analysis: the elementary stream is searched for start
+ * codes and only the few bytes following each one are looked at, so
+ * no macroblock is ever parsed.
+ */
+
+#define BUFFER_SIZE (1024 * 1024)
+#define HEADER_SIZE 8	/* bytes needed after a start code */
+static uint8_t buffer[BUFFER_SIZE + HEADER_SIZE];
+static uint8_t * buffer_end = buffer;
+static unsigned long long buffer_offset = 0;
+static FILE * in_file;
+static int demux_track = 0;
+static int demux_pid = 0;
+static int demux_pva = 0;
+static int summary_only = 0;
+
+static struct {
+    unsigned int width, height;
+    int mpeg2;
+    unsigned int shown_width, shown_height;
+    int shown_mpeg2;
+    /* current picture */
+    int picture;
+    unsigned long long offset;
+    int type, temporal_reference, structure;
+    int slices, qmin, qmax, qsum;
+} es;
+
+static struct {
+    int pictures;
+    unsigned long long bytes;
+    int qmin, qmax;
+    unsigned long long qsum, slices;
+} total[5];
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: "
+	     "%s [-h] [-q] [-s <track>] [-t <pid>] [-p] <file>\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-q\tonly print the summary\n"
+	     "\t-s\tuse program stream demultiplexer, "
+	     "track 0-15 or 0xe0-0xef\n"
+	     "\t-t\tuse transport stream demultiplexer, pid 0x10-0x1ffe\n"
+	     "\t-p\tuse pva demultiplexer\n",
+	     argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+
+    while ((c = getopt (argc, argv, "hqs:t:p")) != -1)
+	switch (c) {
+	case 'q':
+	    summary_only = 1;
+	    break;
+
+	case 's':
+	    demux_track = strtol (optarg, &s, 0);
+	    if (demux_track < 0xe0)
+		demux_track += 0xe0;
+	    if (demux_track < 0xe0 || demux_track > 0xef || *s) {
+		fprintf (stderr, "Invalid track number: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 't':
+	    demux_pid = strtol (optarg, &s, 0);
+	    if (demux_pid < 0x10 || demux_pid > 0x1ffe || *s) {
+		fprintf (stderr, "Invalid pid: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 'p':
+	    demux_pva = 1;
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind < argc) {
+	in_file = fopen (argv[optind], "rb");
+	if (!in_file) {
+	    fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		     argv[optind]);
+	    exit (1);
+	}
+    } else
+	in_file = stdin;
+}
+
+static void picture_end (unsigned long long offset)
+{
+    static const char type[] = "?IPBD";
+    static const char structure[] = "?TBF";
+    int t;
+
+    if (!es.picture)
+	return;
+    es.picture = 0;
+
+    t = es.type;
+    total[t].pictures++;
+    total[t].bytes += offset - es.offset;
+    total[t].slices += es.slices;
+    total[t].qsum += es.qsum;
+    if (es.slices) {
+	if (!total[t].qmin || es.qmin < total[t].qmin)
+	    total[t].qmin = es.qmin;
+	if (es.qmax > total[t].qmax)
+	    total[t].qmax = es.qmax;
+    }
+
+    if (summary_only)
+	return;
+    printf ("%12llu %c %4d %c %8llu %6d", es.offset, type[t],
+	    es.temporal_reference, structure[es.structure],
+	    offset - es.offset, es.slices);
+    if (es.slices)
+	printf (" %4d %5.2f %4d\n", es.qmin,
+		(double) es.qsum / es.slices, es.qmax);
+    else
+	printf ("    -     -    -\n");
+}
+
+static void sequence_show (void)
+{
+    if (summary_only || (es.width == es.shown_width &&
+			 es.height == es.shown_height &&
+			 es.mpeg2 == es.shown_mpeg2))
+	return;
+    printf ("# sequence %ux%u MPEG%d\n", es.width, es.height,
+	    es.mpeg2 ? 2 : 1);
+    es.shown_width = es.width;
+    es.shown_height = es.height;
+    es.shown_mpeg2 = es.mpeg2;
+}
+
+static void header (int code, const uint8_t * buf, unsigned long long offset)
+{
+    int q;
+
+    switch (code) {
+    case 0x00:	/* picture_start_code */
+	picture_end (offset);
+	sequence_show ();
+	es.picture = 1;
+	es.offset = offset;
+	es.temporal_reference = (buf[0] << 2) | (buf[1] >> 6);
+	es.type = (buf[1] >> 3) & 7;
+	if (es.type > 4)
+	    es.type = 0;
+	es.structure = 3;
+	es.slices = es.qsum = es.qmax = 0;
+	es.qmin = 31;
+	break;
+
+    case 0xb3:	/* sequence_header_code */
+	picture_end (offset);
+	es.width = (buf[0] << 4) | (buf[1] >> 4);
+	es.height = ((buf[1] & 15) << 8) | buf[2];
+	es.mpeg2 = 0;
+	break;
+
+    case 0xb5:	/* extension_start_code */
+	switch (buf[0] >> 4) {
+	case 1:	/* sequence extension */
+	    es.width |= (((buf[1] & 1) << 1) | (buf[2] >> 7)) << 12;
+	    es.height |= ((buf[2] >> 5) & 3) << 12;
+	    es.mpeg2 = 1;
+	    break;
+	case 8:	/* picture coding extension */
+	    if (es.picture)
+		es.structure = buf[2] & 3;
+	    break;
+	}
+	break;
+
+    case 0xb7:	/* sequence_end_code */
+	picture_end (offset);
+	break;
+
+    case 0xb8:	/* group_start_code */
+	picture_end (offset);
+	sequence_show ();
+	if (!summary_only)
+	    printf ("# gop %02d:%02d:%02d:%02d%s%s%s\n",
+		    (buf[0] >> 2) & 31, ((buf[0] & 3) << 4) | (buf[1] >> 4),
+		    ((buf[1] & 7) << 3) | (buf[2] >> 5),
+		    ((buf[2] & 31) << 1) | (buf[3] >> 7),
+		    (buf[0] & 0x80) ? " drop" : "",
+		    (buf[3] & 0x40) ? " closed" : "",
+		    (buf[3] & 0x20) ? " broken" : "");
+	break;
+
+    default:
+	if (code >= 0x01 && code <= 0xaf && es.picture) {
+	    /* slice_vertical_position_extension precedes the quantizer */
+	    if (es.height > 2800)
+		q = buf[0] & 31;
+	    else
+		q = buf[0] >> 3;
+	    es.slices++;
+	    es.qsum += q;
+	    if (q < es.qmin)
+		es.qmin = q;
+	    if (q > es.qmax)
+		es.qmax = q;
+	}
+    }
+}
+
+/* returns a pointer to the code following the next 00 00 01, or NULL */
+static const uint8_t * find_start_code (const uint8_t * p,
+					const uint8_t * end)
+{
+    for (p += 2; p < end - 1; )
+	if (*p > 1)
+	    p += 3;
+	else if (*p == 0)
+	    p++;
+	else if (p[-1] | p[-2])
+	    p += 3;
+	else
+	    return p + 1;
+    return NULL;
+}
+
+static void scan (int eof)
+{
+    const uint8_t * p;
+    const uint8_t * end;
+    const uint8_t * code;
+
+    if (eof) {
+	/* headers cut short by the end of the stream read as zeroes */
+	memset (buffer_end, 0, HEADER_SIZE);
+	end = buffer_end;
+    } else
+	end = buffer_end - HEADER_SIZE;
+
+    p = buffer;
+    while (end - p > 3 && (code = find_start_code (p, end)) != NULL) {
+	header (code[0], code + 1, buffer_offset + (code - 3 - buffer));
+	p = code + 1;
+    }
+    if (eof) {
+	picture_end (buffer_offset + (buffer_end - buffer));
+	return;
+    }
+
+    /* keep what might still hold the beginning of a start code */
+    if (p < end - 3)
+	p = end - 3;
+    if (p < buffer)
+	p = buffer;
+    memmove (buffer, p, buffer_end - p);
+    buffer_offset += p - buffer;
+    buffer_end -= p - buffer;
+}
+
+static void analyze (const uint8_t * data, int size)
+{
+    int len;
+
+    while (size) {
+	len = BUFFER_SIZE - (buffer_end - buffer);
+	if (len > size)
+	    len = size;
+	memcpy (buffer_end, data, len);
+	buffer_end += len;
+	data += len;
+	size -= len;
+	if (buffer_end == buffer + BUFFER_SIZE)
+	    scan (0);
+    }
+}
+
+static void es_loop (void)
+{
+    int size;
+
+    do {
+	size = fread (buffer_end, 1, BUFFER_SIZE - (buffer_end - buffer),
+		      in_file);
+	buffer_end += size;
+	if (buffer_end == buffer + BUFFER_SIZE)
+	    scan (0);
+    } while (size);
+}
+
+static void demux_loop (mpeg2demux_format_t format, int stream)
+{
+    static uint8_t in_buffer[65536];
+    uint8_t * end;
+    mpeg2demux_t * demux;
+    const mpeg2demux_info_t * info;
+    mpeg2demux_state_t state;
+
+    demux = mpeg2demux_init (format, stream);
+    if (demux == NULL)
+	exit (1);
+    info = mpeg2demux_info (demux);
+    do {
+	end = in_buffer + fread (in_buffer, 1, sizeof (in_buffer), in_file);
+	mpeg2demux_buffer (demux, in_buffer, end);
+	while ((state = mpeg2demux_parse (demux)) != MPEG2DEMUX_BUFFER) {
+	    if (state == MPEG2DEMUX_END)
+		goto done;	/* hit program_end_code */
+	    else if (state == MPEG2DEMUX_ERROR) {
+		fprintf (stderr, "%s\n", mpeg2demux_error_string (demux));
+		if (info->error == MPEG2DEMUX_ERROR_STREAM_ID)
+		    exit (1);
+	    } else
+		analyze (info->buf, info->end - info->buf);
+	}
+    } while (end == in_buffer + sizeof (in_buffer));
+    done:
+    mpeg2demux_close (demux);
+}
+
+static void print_summary (void)
+{
+    static const char type[] = "?IPBD";
+    unsigned long long bytes = 0;
+    int t, pictures = 0;
+
+    for (t = 0; t < 5; t++) {
+	if (!total[t].pictures)
+	    continue;
+	pictures += total[t].pictures;
+	bytes += total[t].bytes;
+	printf ("# %c %8d pictures %8llu bytes avg", type[t],
+		total[t].pictures, total[t].bytes / total[t].pictures);
+	if (total[t].slices)
+	    printf (" qscale %d %.2f %d\n", total[t].qmin,
+		    (double) total[t].qsum / total[t].slices, total[t].qmax);
+	else
+	    printf ("\n");
+    }
+    printf ("# total %4d pictures %8llu bytes\n", pictures, bytes);
+}
+
+int main (int argc, char ** argv)
+{
+#ifdef HAVE_IO_H
+    setmode (fileno (stdin), O_BINARY);
+#endif
+
+    handle_args (argc, argv);
+
+    if (!summary_only)
+	printf ("#     offset t tref s    bytes slices qmin  qavg qmax\n");
+    if (demux_pva)
+	demux_loop (MPEG2DEMUX_PVA, 0);
+    else if (demux_pid)
+	demux_loop (MPEG2DEMUX_TS, demux_pid);
+    else if (demux_track)
+	demux_loop (MPEG2DEMUX_PS, demux_track);
+    else
+	es_loop ();
+    scan (1);
+    print_summary ();
+
+    return 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * cut_mpeg2.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#ifdef HAVE_IO_H
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <inttypes.h>
+
+/*
+ * Cuts and splices elementary streams at GOP boundaries. Nothing is
+ * decoded: the stream is searched for start codes, every chunk between
+ * two start codes is either copied or dropped, and the only bytes ever
+ * rewritten are the GOP flags and temporal references of the first GOP
+ * of each segment.
+ */
+
+#define BUFFER_SIZE (1024 * 1024)
+#define HEADER_SIZE 8	/* bytes needed after a start code */
+static uint8_t buffer[BUFFER_SIZE + HEADER_SIZE];
+static uint8_t * buffer_end;
+static unsigned long long buffer_offset;
+static FILE * in_file;
+static FILE * out_file;
+static int list_only = 0;
+static int keep_leading_b = 0;
+
+enum mode { DROP, EMIT, SAVE };
+
+static struct {
+    enum mode mode;
+    const uint8_t * chunk;	/* start of the bytes not handled yet */
+    /* requested range */
+    int first, last;
+    int done;
+    /* last sequence header, with its extensions and user data */
+    uint8_t * sequence;
+    unsigned int sequence_len, sequence_size;
+    int sequence_pending;
+    /* current GOP */
+    int gop;
+    int selected;
+    int drop_leading_b;
+    int i_tr;
+    int shift;
+} cut;
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: "
+	     "%s [-h] [-l] [-b] [-o <file>] <file>[:<first>[-<last>]] ...\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-l\tlist the GOPs of each file instead of cutting\n"
+	     "\t-b\tkeep leading B pictures, mark the GOP as broken\n"
+	     "\t-o\twrite to file instead of stdout\n",
+	     argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+
+    while ((c = getopt (argc, argv, "hlbo:")) != -1)
+	switch (c) {
+	case 'l':
+	    list_only = 1;
+	    break;
+
+	case 'b':
+	    keep_leading_b = 1;
+	    break;
+
+	case 'o':
+	    out_file = fopen (optarg, "wb");
+	    if (!out_file) {
+		fprintf (stderr, "%s - could not open file %s\n",
+			 strerror (errno), optarg);
+		exit (1);
+	    }
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind >= argc)
+	print_usage (argv);
+}
+
+/* splits "file:first-last" - anything else is taken as a file name */
+static char * parse_range (char * arg, int * first, int * last)
+{
+    static char name[4096];
+    char * colon;
+    char * s;
+    long value;
+
+    *first = 0;
+    *last = -1;
+    colon = strrchr (arg, ':');
+    if (colon == NULL || colon == arg || colon - arg >= (int) sizeof (name))
+	return arg;
+    value = strtol (colon + 1, &s, 10);
+    if (s == colon + 1 || value < 0)
+	return arg;
+    *first = value;
+    if (*s == '-') {
+	value = strtol (s + 1, &s, 10);
+	if (value < *first)
+	    return arg;
+	*last = value;
+    }
+    if (*s) {
+	*first = 0;
+	*last = -1;
+	return arg;
+    }
+    memcpy (name, arg, colon - arg);
+    name[colon - arg] = 0;
+    return name;
+}
+
+static void save (const uint8_t * data, unsigned int len)
+{
+    uint8_t * buf;
+
+    if (cut.sequence_len + len > cut.sequence_size) {
+	cut.sequence_size = 2 * (cut.sequence_len + len);
+	buf = (uint8_t *) realloc (cut.sequence, cut.sequence_size);
+	if (buf == NULL) {
+	    fprintf (stderr, "could not allocate sequence header buffer\n");
+	    exit (1);
+	}
+	cut.sequence = buf;
+    }
+    memcpy (cut.sequence + cut.sequence_len, data, len);
+    cut.sequence_len += len;
+}
+
+static void emit (const uint8_t * data, unsigned int len)
+{
+    if (len && fwrite (data, len, 1, out_file) != 1) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+}
+
+static void flush (const uint8_t * end)
+{
+    if (list_only)
+	;
+    else if (cut.mode == EMIT)
+	emit (cut.chunk, end - cut.chunk);
+    else if (cut.mode == SAVE)
+	save (cut.chunk, end - cut.chunk);
+    cut.chunk = end;
+}
+
+static void gop_start (uint8_t * buf, unsigned long long offset)
+{
+    cut.gop++;
+    if (list_only) {
+	printf ("%6d %12llu", cut.gop, offset);
+	if (buf != NULL)
+	    printf (" %02d:%02d:%02d:%02d%s%s%s\n",
+		    (buf[0] >> 2) & 31, ((buf[0] & 3) << 4) | (buf[1] >> 4),
+		    ((buf[1] & 7) << 3) | (buf[2] >> 5),
+		    ((buf[2] & 31) << 1) | (buf[3] >> 7),
+		    (buf[0] & 0x80) ? " drop" : "",
+		    (buf[3] & 0x40) ? " closed" : "",
+		    (buf[3] & 0x20) ? " broken" : "");
+	else
+	    printf (" --:--:--:--\n");
+	return;
+    }
+    if (cut.last >= 0 && cut.gop > cut.last) {
+	cut.done = 1;
+	return;
+    }
+    cut.selected = (cut.gop >= cut.first);
+    cut.drop_leading_b = cut.shift = 0;
+    cut.i_tr = -1;
+    if (!cut.selected)
+	return;
+
+    if (cut.gop == cut.first || cut.sequence_pending) {
+	if (!cut.sequence_len) {
+	    fprintf (stderr, "no sequence header before GOP %d\n", cut.gop);
+	    exit (1);
+	}
+	emit (cut.sequence, cut.sequence_len);
+	cut.sequence_pending = 0;
+    }
+
+    /* leading B pictures of an open GOP refer to the previous GOP */
+    if (cut.gop != cut.first)
+	;
+    else if (buf == NULL)
+	cut.drop_leading_b = !keep_leading_b;
+    else if (!(buf[3] & 0x40)) {
+	if (keep_leading_b)
+	    buf[3] |= 0x20;	/* broken_link */
+	else {
+	    buf[3] = (buf[3] | 0x40) & ~0x20;	/* closed_gop */
+	    cut.drop_leading_b = 1;
+	}
+    }
+}
+
+static enum mode picture (uint8_t * buf)
+{
+    int tr, type;
+
+    if (!cut.selected)
+	return DROP;
+    tr = (buf[0] << 2) | (buf[1] >> 6);
+    type = (buf[1] >> 3) & 7;
+    if (cut.drop_leading_b) {
+	if (cut.i_tr < 0) {
+	    /* nothing before the first I picture can be decoded */
+	    if (type != 1)
+		return DROP;
+	    cut.i_tr = cut.shift = tr;
+	} else if (type == 3 && tr < cut.i_tr)
+	    return DROP;
+    }
+    if (cut.shift) {
+	tr -= cut.shift;
+	buf[0] = tr >> 2;
+	buf[1] = (buf[1] & 0x3f) | (tr << 6);
+    }
+    return EMIT;
+}
+
+static void header (int code, uint8_t * buf, const uint8_t * start)
+{
+    unsigned long long offset;
+
+    offset = buffer_offset + (start - buffer);
+    switch (code) {
+    case 0x00:	/* picture_start_code */
+	/* a picture straight after a sequence header starts a GOP too */
+	if (cut.mode == SAVE)
+	    gop_start (NULL, offset);
+	if (!cut.done)
+	    cut.mode = picture (buf);
+	break;
+
+    case 0xb3:	/* sequence_header_code */
+	cut.sequence_len = 0;
+	cut.sequence_pending = 1;
+	cut.mode = SAVE;
+	break;
+
+    case 0xb7:	/* sequence_end_code */
+	cut.mode = DROP;
+	break;
+
+    case 0xb8:	/* group_start_code */
+	gop_start (buf, offset);
+	cut.mode = cut.selected ? EMIT : DROP;
+	break;
+    }
+}
+
+/* returns a pointer to the code following the next 00 00 01, or NULL */
+static uint8_t * find_start_code (uint8_t * p, const uint8_t * end)
+{
+    for (p += 2; p < end - 1; )
+	if (*p > 1)
+	    p += 3;
+	else if (*p == 0)
+	    p++;
+	else if (p[-1] | p[-2])
+	    p += 3;
+	else
+	    return p + 1;
+    return NULL;
+}
+
+static void scan (int eof)
+{
+    uint8_t * p;
+    uint8_t * end;
+    uint8_t * code;
+
+    if (eof) {
+	/* headers cut short by the end of the stream read as zeroes */
+	memset (buffer_end, 0, HEADER_SIZE);
+	end = buffer_end;
+    } else
+	end = buffer_end - HEADER_SIZE;
+
+    p = buffer;
+    while (end - p > 3 && (code = find_start_code (p, end)) != NULL) {
+	flush (code - 3);
+	header (code[0], code + 1, code - 3);
+	if (cut.done)
+	    return;
+	p = code + 1;
+    }
+    if (eof) {
+	flush (buffer_end);
+	return;
+    }
+
+    /* keep what might still hold the beginning of a start code */
+    if (p < end - 3)
+	p = end - 3;
+    if (p < buffer)
+	p = buffer;
+    flush (p);
+    memmove (buffer, p, buffer_end - p);
+    buffer_offset += p - buffer;
+    buffer_end -= p - buffer;
+    cut.chunk = buffer;
+}
+
+static void cut_file (const char * name, int first, int last)
+{
+    int size;
+
+    in_file = fopen (name, "rb");
+    if (!in_file) {
+	fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+    if (list_only)
+	printf ("# %s\n#  gop       offset timecode\n", name);
+
+    buffer_end = buffer;
+    buffer_offset = 0;
+    cut.mode = DROP;
+    cut.chunk = buffer;
+    cut.first = first;
+    cut.last = last;
+    cut.done = cut.sequence_pending = cut.selected = 0;
+    cut.sequence_len = 0;
+    cut.gop = -1;
+
+    do {
+	size = fread (buffer_end, 1, BUFFER_SIZE - (buffer_end - buffer),
+		      in_file);
+	buffer_end += size;
+	if (buffer_end == buffer + BUFFER_SIZE)
+	    scan (0);
+    } while (size && !cut.done);
+    if (!cut.done)
+	scan (1);
+
+    fclose (in_file);
+}
+
+int main (int argc, char ** argv)
+{
+    static const uint8_t end_code[] = {0x00, 0x00, 0x01, 0xb7};
+    int first, last;
+    char * name;
+
+    out_file = stdout;
+    handle_args (argc, argv);
+#ifdef HAVE_IO_H
+    setmode (fileno (out_file), O_BINARY);
+#endif
+
+    for (; optind < argc; optind++) {
+	name = parse_range (argv[optind], &first, &last);
+	cut_file (name, first, last);
+    }
+    if (!list_only)
+	emit (end_code, 4);
+    if (fclose (out_file)) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+
+    return 0;
+}
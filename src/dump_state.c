@@ -209,6 +209,40 @@ static void pic_code_del (const mpeg2_picture_t * pic)
 	}
 }
 
+/*
+ * one character per macroblock: I intra, F forward, B backward,
+ * X bidirectional, P no motion vector (P picture macroblock with zero
+ * motion), lowercase when skipped, . when not decoded
+ */
+static void macroblocks_dump (FILE * f, const mpeg2_info_t * info)
+{
+    static const char type[2][4] = {{'P', 'B', 'F', 'X'},
+				    {'p', 'b', 'f', 'x'}};
+    const mpeg2_macroblock_t * mb = info->macroblocks;
+    unsigned int x, y, coded, quantizer;
+
+    coded = quantizer = 0;
+    for (y = 0; y < info->sequence->height >> 4; y++) {
+	fprintf (f, "         ");
+	for (x = 0; x < info->sequence->width >> 4; x++, mb++)
+	    if (!mb->flags)
+		fputc ('.', f);
+	    else {
+		if (mb->flags & MB_FLAG_INTRA)
+		    fputc ('I', f);
+		else
+		    fputc (type[!!(mb->flags & MB_FLAG_SKIPPED)]
+			   [(mb->flags >> 2) & 3], f);
+		coded++;
+		quantizer += mb->quantizer_scale;
+	    }
+	fprintf (f, "\n");
+    }
+    if (coded)
+	fprintf (f, "         MACROBLOCKS %u qscale %.1f\n",
+		 coded, (double) quantizer / coded);
+}
+
 void dump_state (FILE * f, mpeg2_state_t state, const mpeg2_info_t * info,
 		 int offset, int verbose)
 {
@@ -421,6 +455,9 @@ void dump_state (FILE * f, mpeg2_state_t state, const mpeg2_info_t * info,
 		fprintf (f, "\n");
 	    }
     }
+    if (verbose > 4 && info->macroblocks &&
+	(state == STATE_SLICE_1ST || state == STATE_SLICE))
+	macroblocks_dump (f, info);
     if (state == STATE_END || state == STATE_INVALID_END) {
 	sequence_save (NULL);
 	gop_save (NULL);
@@ -36,23 +36,50 @@
 #ifdef LIBVO_SDL
 #include <SDL/SDL.h>
 #endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <inttypes.h>
 
 #include "mpeg2.h"
+#include "mpeg2demux.h"
 #include "video_out.h"
 #include "gettimeofday.h"
 
-static int buffer_size = 4096;
+typedef struct {
+    mpeg2dec_t * mpeg2dec;
+    vo_instance_t * output;
+    int total_offset;
+    int frames;
+    /* -d only: when the first picture was checked, and B pictures cut short */
+    double start;
+    unsigned int degraded;
+    int pid;
+    int program;
+    /* payloads queued for the next decode round, -m mode only */
+    int num_payloads;
+    int max_payloads;
+    mpeg2demux_info_t * payloads;
+} decoder_t;
+
+static int buffer_size = 0;
 static FILE * in_file;
 static int demux_track = 0;
 static int demux_pid = 0;
 static int demux_pva = 0;
-static mpeg2dec_t * mpeg2dec;
+static int demux_all = 0;
+static int gop_parallel = 0;
+static int num_threads = 4;
+static decoder_t main_decoder;
+static int num_programs = 0;
+static decoder_t ** programs = NULL;
 static vo_open_t * output_open = NULL;
-static vo_instance_t * output;
+static const char * output_name = NULL;
 static int sigint = 0;
-static int total_offset = 0;
 static int verbose = 0;
+static int low_latency = 0;
+static int compact = 0;
+static int degrade = 0;
 
 void dump_state (FILE * f, mpeg2_state_t state, const mpeg2_info_t * info,
 		 int offset, int verbose);
@@ -121,12 +148,36 @@ static void print_fps (int final)
     last_count = frame_counter;
 }
 
+/* a picture is late once decoding falls behind the frame rate */
+static int picture_late (void * arg, const mpeg2_picture_t * picture)
+{
+    decoder_t * decoder = (decoder_t *) arg;
+    const mpeg2_info_t * info = mpeg2_info (decoder->mpeg2dec);
+    struct timeval tv;
+    double now;
+
+    gettimeofday (&tv, NULL);
+    now = tv.tv_sec + tv.tv_usec * 0.000001;
+    if (!decoder->start)
+	decoder->start = now;
+    if ((now - decoder->start) * 27000000 <
+	(decoder->frames + 1) * (double) info->sequence->frame_period)
+	return 0;
+    decoder->degraded++;
+    return 1;
+}
+
 #else /* !HAVE_GETTIMEOFDAY */
 
 static void print_fps (int final)
 {
 }
 
+static int picture_late (void * arg, const mpeg2_picture_t * picture)
+{
+    return 0;
+}
+
 #endif
 
 static void print_usage (char ** argv)
@@ -135,16 +186,27 @@ static void print_usage (char ** argv)
     vo_driver_t const * drivers;
 
     fprintf (stderr, "usage: "
-	     "%s [-h] [-o <mode>] [-s [<track>]] [-t <pid>] [-p] [-c] \\\n"
-	     "\t\t[-v] [-b <bufsize>] <file>\n"
+	     "%s [-h] [-o <mode>] [-s [<track>]] [-t <pid>] [-m [<threads>]] \\\n"
+	     "\t\t[-g [<threads>]] [-p] [-c] [-l] [-d] [-f] [-v] \\\n"
+	     "\t\t[-b <bufsize>] <file>\n"
 	     "\t-h\tdisplay help and available video output modes\n"
 	     "\t-s\tuse program stream demultiplexer, "
 	     "track 0-15 or 0xe0-0xef\n"
 	     "\t-t\tuse transport stream demultiplexer, pid 0x10-0x1ffe\n"
+	     "\t-m\tuse transport stream demultiplexer, decode all programs\n"
+	     "\t\tusing 1-64 threads, default 4\n"
+	     "\t-g\tdecode ranges of gops in parallel using 1-64 threads,\n"
+	     "\t\tdefault 4, elementary streams only\n"
 	     "\t-p\tuse pva demultiplexer\n"
 	     "\t-c\tuse c implementation, disables all accelerations\n"
+	     "\t-l\tlow latency, show pictures as soon as they are decoded\n"
+	     "\t\tuse twice if the stream has no B pictures\n"
+	     "\t-d\tcut B pictures short when decoding falls behind the "
+	     "frame rate\n"
+	     "\t-f\tsmall memory footprint, report peak memory use at exit\n"
 	     "\t-v\tverbose information about the MPEG stream\n"
-	     "\t-b\tset input buffer size, default 4096 bytes\n"
+	     "\t-b\tset input buffer size, default 4096 bytes "
+	     "(192512 with -m)\n"
 	     "\t-o\tvideo output mode\n", argv[0]);
 
     drivers = vo_drivers ();
@@ -162,12 +224,14 @@ static void handle_args (int argc, char ** argv)
     char * s;
 
     drivers = vo_drivers ();
-    while ((c = getopt (argc, argv, "hs::t:pco:vb::")) != -1)
+    while ((c = getopt (argc, argv, "hs::t:m::g::pcldfo:vb::")) != -1)
 	switch (c) {
 	case 'o':
 	    for (i = 0; drivers[i].name != NULL; i++)
-		if (strcmp (drivers[i].name, optarg) == 0)
+		if (strcmp (drivers[i].name, optarg) == 0) {
 		    output_open = drivers[i].open;
+		    output_name = drivers[i].name;
+		}
 	    if (output_open == NULL) {
 		fprintf (stderr, "Invalid video driver: %s\n", optarg);
 		print_usage (argv);
@@ -195,6 +259,21 @@ static void handle_args (int argc, char ** argv)
 	    }
 	    break;
 
+	case 'm':
+	case 'g':
+	    if (c == 'm')
+		demux_all = 1;
+	    else
+		gop_parallel = 1;
+	    if (optarg != NULL) {
+		num_threads = strtol (optarg, &s, 0);
+		if (num_threads < 1 || num_threads > 64 || *s) {
+		    fprintf (stderr, "Invalid thread count: %s\n", optarg);
+		    print_usage (argv);
+		}
+	    }
+	    break;
+
 	case 'p':
 	    demux_pva = 1;
 	    break;
@@ -203,8 +282,21 @@ static void handle_args (int argc, char ** argv)
 	    mpeg2_accel (0);
 	    break;
 
+	case 'l':
+	    if (++low_latency > 2)
+		print_usage (argv);
+	    break;
+
+	case 'd':
+	    degrade = 1;
+	    break;
+
+	case 'f':
+	    compact = 1;
+	    break;
+
 	case 'v':
-	    if (++verbose > 4)
+	    if (++verbose > 5)
 		print_usage (argv);
 	    break;
 
@@ -223,9 +315,31 @@ static void handle_args (int argc, char ** argv)
 	    print_usage (argv);
 	}
 
+    if (demux_all && verbose) {
+	fprintf (stderr, "-v can not be used with -m\n");
+	print_usage (argv);
+    }
+    if (gop_parallel && (verbose || low_latency || degrade || demux_all ||
+			 demux_pva || demux_pid || demux_track)) {
+	fprintf (stderr,
+		 "-g can not be used with -v, -l, -d, -m, -s, -t or -p\n");
+	print_usage (argv);
+    }
+    if (!buffer_size)
+	buffer_size = demux_all ? 1024 * 188 : 4096;
+
     /* -o not specified, use a default driver */
-    if (output_open == NULL)
+    if (output_open == NULL) {
 	output_open = drivers[0].open;
+	output_name = drivers[0].name;
+    }
+    /* the programs are drawn at the same time, from several threads */
+    if (demux_all && strcmp (output_name, "pgm") &&
+	strcmp (output_name, "md5") && strncmp (output_name, "null", 4)) {
+	fprintf (stderr, "-m can only be used with the pgm, md5 and null "
+		 "outputs\n");
+	print_usage (argv);
+    }
 
     if (optind < argc) {
 	in_file = fopen (argv[optind], "rb");
@@ -265,21 +379,25 @@ static void * malloc_hook (unsigned size, mpeg2_alloc_t reason)
     return buf;
 }
 
-static void decode_mpeg2 (uint8_t * current, uint8_t * end)
+static void decode_mpeg2 (decoder_t * decoder, uint8_t * current,
+			  uint8_t * end)
 {
+    mpeg2dec_t * mpeg2dec = decoder->mpeg2dec;
+    vo_instance_t * output = decoder->output;
     const mpeg2_info_t * info;
     mpeg2_state_t state;
     vo_setup_result_t setup_result;
 
     mpeg2_buffer (mpeg2dec, current, end);
-    total_offset += end - current;
+    decoder->total_offset += end - current;
 
     info = mpeg2_info (mpeg2dec);
     while (1) {
 	state = mpeg2_parse (mpeg2dec);
 	if (verbose)
 	    dump_state (stderr, state, info,
-			total_offset - mpeg2_getpos (mpeg2dec), verbose);
+			decoder->total_offset - mpeg2_getpos (mpeg2dec),
+			verbose);
 	switch (state) {
 	case STATE_BUFFER:
 	    return;
@@ -343,7 +461,9 @@ static void decode_mpeg2 (uint8_t * current, uint8_t * end)
 		if (output->draw)
 		    output->draw (output, info->display_fbuf->buf,
 				  info->display_fbuf->id);
-		print_fps (0);
+		decoder->frames++;
+		if (!demux_all)
+		    print_fps (0);
 	    }
 	    if (output->discard && info->discard_fbuf)
 		output->discard (output, info->discard_fbuf->buf,
@@ -355,408 +475,1036 @@ static void decode_mpeg2 (uint8_t * current, uint8_t * end)
     }
 }
 
-#define DEMUX_PAYLOAD_START 1
-static int demux (uint8_t * buf, uint8_t * end, int flags)
+static void decode_payload (decoder_t * decoder,
+			    const mpeg2demux_info_t * payload)
 {
-    static int mpeg1_skip_table[16] = {
-	0, 0, 4, 9, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-    };
+    if (payload->tagged)
+	mpeg2_tag_picture (decoder->mpeg2dec, payload->pts, payload->dts);
+    if (payload->buf != payload->end)
+	decode_mpeg2 (decoder, payload->buf, payload->end);
+}
 
-    /*
-     * the demuxer keeps some state between calls:
-     * if "state" = DEMUX_HEADER, then "head_buf" contains the first
-     *     "bytes" bytes from some header.
-     * if "state" == DEMUX_DATA, then we need to copy "bytes" bytes
-     *     of ES data before the next header.
-     * if "state" == DEMUX_SKIP, then we need to skip "bytes" bytes
-     *     of data before the next header.
-     *
-     * NEEDBYTES makes sure we have the requested number of bytes for a
-     * header. If we dont, it copies what we have into head_buf and returns,
-     * so that when we come back with more data we finish decoding this header.
-     *
-     * DONEBYTES updates "buf" to point after the header we just parsed.
-     */
+#if defined(HAVE_PTHREAD) && defined(__ATOMIC_ACQUIRE)
+#define PIPELINE
 
-#define DEMUX_HEADER 0
-#define DEMUX_DATA 1
-#define DEMUX_SKIP 2
-    static int state = DEMUX_SKIP;
-    static int state_bytes = 0;
-    static uint8_t head_buf[264];
-
-    uint8_t * header;
-    int bytes;
-    int len;
-
-#define NEEDBYTES(x)						\
-    do {							\
-	int missing;						\
-								\
-	missing = (x) - bytes;					\
-	if (missing > 0) {					\
-	    if (header == head_buf) {				\
-		if (missing <= end - buf) {			\
-		    memcpy (header + bytes, buf, missing);	\
-		    buf += missing;				\
-		    bytes = (x);				\
-		} else {					\
-		    memcpy (header + bytes, buf, end - buf);	\
-		    state_bytes = bytes + end - buf;		\
-		    return 0;					\
-		}						\
-	    } else {						\
-		memcpy (head_buf, header, bytes);		\
-		state = DEMUX_HEADER;				\
-		state_bytes = bytes;				\
-		return 0;					\
-	    }							\
-	}							\
-    } while (0)
-
-#define DONEBYTES(x)		\
-    do {			\
-	if (header != head_buf)	\
-	    buf = header + (x);	\
-    } while (0)
-
-    if (flags & DEMUX_PAYLOAD_START)
-	goto payload_start;
-    switch (state) {
-    case DEMUX_HEADER:
-	if (state_bytes > 0) {
-	    header = head_buf;
-	    bytes = state_bytes;
-	    goto continue_header;
-	}
-	break;
-    case DEMUX_DATA:
-	if (demux_pid || (state_bytes > end - buf)) {
-	    decode_mpeg2 (buf, end);
-	    state_bytes -= end - buf;
-	    return 0;
-	}
-	decode_mpeg2 (buf, buf + state_bytes);
-	buf += state_bytes;
-	break;
-    case DEMUX_SKIP:
-	if (demux_pid || (state_bytes > end - buf)) {
-	    state_bytes -= end - buf;
-	    return 0;
-	}
-	buf += state_bytes;
-	break;
+/*
+ * A ring with a single producer and a single consumer: each side only
+ * writes its own counter, and the lock is only taken to sleep when the
+ * ring is empty or full, or to wake up a side that did. A counter is
+ * stored with release semantics once the items it covers are written
+ * or done with, and the other side loads it with acquire semantics
+ * before touching them.
+ */
+typedef struct {
+    unsigned int head;		/* items the consumer is done with */
+    unsigned int tail;		/* items the producer queued */
+    int sleeping;
+    unsigned int mask;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+} ring_t;
+
+static void ring_init (ring_t * ring, unsigned int size)
+{
+    ring->head = ring->tail = 0;
+    ring->sleeping = 0;
+    ring->mask = size - 1;
+    pthread_mutex_init (&ring->lock, NULL);
+    pthread_cond_init (&ring->wake, NULL);
+}
+
+static void ring_destroy (ring_t * ring)
+{
+    pthread_cond_destroy (&ring->wake);
+    pthread_mutex_destroy (&ring->lock);
+}
+
+static unsigned int ring_load (unsigned int * counter)
+{
+    return __atomic_load_n (counter, __ATOMIC_ACQUIRE);
+}
+
+/* waits until the counter reaches value */
+static void ring_wait (ring_t * ring, unsigned int * counter,
+		       unsigned int value)
+{
+    if ((int) (ring_load (counter) - value) >= 0)
+	return;
+    pthread_mutex_lock (&ring->lock);
+    __atomic_add_fetch (&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    while ((int) (__atomic_load_n (counter, __ATOMIC_SEQ_CST) - value) < 0)
+	pthread_cond_wait (&ring->wake, &ring->lock);
+    __atomic_sub_fetch (&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock (&ring->lock);
+}
+
+/* only called by the side the counter belongs to */
+static void ring_advance (ring_t * ring, unsigned int * counter)
+{
+    __atomic_store_n (counter, *counter + 1, __ATOMIC_RELEASE);
+    /* either a side going to sleep sees the count, or we see it */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&ring->sleeping, __ATOMIC_SEQ_CST)) {
+	pthread_mutex_lock (&ring->lock);
+	pthread_cond_broadcast (&ring->wake);
+	pthread_mutex_unlock (&ring->lock);
     }
+}
 
-    while (1) {
-	if (demux_pid) {
-	    state = DEMUX_SKIP;
-	    return 0;
-	}
-    payload_start:
-	header = buf;
-	bytes = end - buf;
-    continue_header:
-	NEEDBYTES (4);
-	if (header[0] || header[1] || (header[2] != 1)) {
-	    if (demux_pid) {
-		state = DEMUX_SKIP;
-		return 0;
-	    } else if (header != head_buf) {
-		buf++;
-		goto payload_start;
-	    } else {
-		header[0] = header[1];
-		header[1] = header[2];
-		header[2] = header[3];
-		bytes = 3;
-		goto continue_header;
-	    }
-	}
-	if (demux_pid) {
-	    if ((header[3] >= 0xe0) && (header[3] <= 0xef))
-		goto pes;
-	    fprintf (stderr, "bad stream id %x\n", header[3]);
+#define PIPELINE_BUFFERS 4
+#define PIPELINE_PAYLOADS 256
+#define PIPELINE_FRAMES 64
+#define PIPELINE_FBUFS 8
+#define PIPELINE_COPY 264
+
+typedef struct {
+    uint8_t * buf[3];
+    int decoding;		/* given to the decoder, not discarded yet */
+    unsigned int drawn;		/* output.head once it is drawn */
+} pipeline_fbuf_t;
+
+typedef struct {
+    /* the draw or discard of the target, NULL at the end */
+    void (* call) (vo_instance_t * instance, uint8_t * const * buf,
+		   void * id);
+    uint8_t * buf[3];
+    void * id;
+} pipeline_frame_t;
+
+/*
+ * Pipelined mode: a reader thread reads and demuxes the input, the main
+ * thread decodes, and an output thread draws. Unless the output has
+ * frame buffers of its own, the decoder gets ours through its set_fbuf
+ * hook, and hands them back through the discard hook; a buffer is given
+ * out again once it is discarded and drawn. They are given out in turn
+ * rather than as they free up, so that what a damaged stream leaves
+ * undecoded does not depend on the timing of the threads. The buffers
+ * of an output are waited for the same way before the decoder writes
+ * into them, and every call into the output is made with its lock.
+ */
+static struct {
+    int active;
+    ring_t input;
+    mpeg2demux_info_t payloads[PIPELINE_PAYLOADS];
+    uint8_t copies[PIPELINE_PAYLOADS][PIPELINE_COPY];
+    uint8_t * buffers[PIPELINE_BUFFERS];
+    unsigned int buffer_end[PIPELINE_BUFFERS];	/* input.tail once read */
+    int next_buffer;
+    ring_t output;
+    pipeline_frame_t frames[PIPELINE_FRAMES];
+    vo_instance_t vo;
+    vo_instance_t * target;
+    pthread_mutex_t lock;	/* held while calling the target */
+    int direct;			/* the target draws from the decoder */
+    int own;			/* the fbufs are ours, else the target's */
+    unsigned int size[2];
+    int nb_fbufs;
+    int next_fbuf;
+    pipeline_fbuf_t fbufs[PIPELINE_FBUFS];
+    unsigned int discarded;	/* output.head once the discards are done */
+    pthread_t reader;
+    pthread_t drawer;
+} pipeline;
+
+static uint8_t * pipeline_buffer (void)
+{
+    int i = pipeline.next_buffer;
+
+    /* the buffer read before is done once all its payloads are */
+    pipeline.buffer_end[(i + PIPELINE_BUFFERS - 1) % PIPELINE_BUFFERS] =
+	pipeline.input.tail;
+    ring_wait (&pipeline.input, &pipeline.input.head, pipeline.buffer_end[i]);
+    pipeline.next_buffer = (i + 1) % PIPELINE_BUFFERS;
+    return pipeline.buffers[i];
+}
+
+static void pipeline_payload (const mpeg2demux_info_t * payload)
+{
+    ring_t * input = &pipeline.input;
+    mpeg2demux_info_t * queued;
+    uint8_t * buffer;
+    int i;
+
+    ring_wait (input, &input->head, input->tail - input->mask);
+    i = input->tail & input->mask;
+    queued = pipeline.payloads + i;
+    *queued = *payload;
+    /* the demuxer reuses its own copy of what straddled two buffers */
+    i = (pipeline.next_buffer + PIPELINE_BUFFERS - 1) % PIPELINE_BUFFERS;
+    buffer = pipeline.buffers[i];
+    if (payload->buf != NULL &&
+	(payload->buf < buffer || payload->buf >= buffer + buffer_size)) {
+	if (payload->end - payload->buf > PIPELINE_COPY) {
+	    fprintf (stderr, "payload outside of the read buffer\n");
 	    exit (1);
 	}
-	switch (header[3]) {
-	case 0xb9:	/* program end code */
-	    /* DONEBYTES (4); */
-	    /* break;         */
-	    return 1;
-	case 0xba:	/* pack header */
-	    NEEDBYTES (5);
-	    if ((header[4] & 0xc0) == 0x40) {	/* mpeg2 */
-		NEEDBYTES (14);
-		len = 14 + (header[13] & 7);
-		NEEDBYTES (len);
-		DONEBYTES (len);
-		/* header points to the mpeg2 pack header */
-	    } else if ((header[4] & 0xf0) == 0x20) {	/* mpeg1 */
-		NEEDBYTES (12);
-		DONEBYTES (12);
-		/* header points to the mpeg1 pack header */
-	    } else {
-		fprintf (stderr, "weird pack header\n");
-		DONEBYTES (5);
-	    }
-	    break;
-	default:
-	    if (header[3] == demux_track) {
-	    pes:
-		NEEDBYTES (7);
-		if ((header[6] & 0xc0) == 0x80) {	/* mpeg2 */
-		    NEEDBYTES (9);
-		    len = 9 + header[8];
-		    NEEDBYTES (len);
-		    /* header points to the mpeg2 pes header */
-		    if (header[7] & 0x80) {
-			uint32_t pts, dts;
-
-			pts = (((header[9] >> 1) << 30) |
-			       (header[10] << 22) | ((header[11] >> 1) << 15) |
-			       (header[12] << 7) | (header[13] >> 1));
-			dts = (!(header[7] & 0x40) ? pts :
-			       (uint32_t)(((header[14] >> 1) << 30) |
-				(header[15] << 22) |
-				((header[16] >> 1) << 15) |
-				(header[17] << 7) | (header[18] >> 1)));
-			mpeg2_tag_picture (mpeg2dec, pts, dts);
-		    }
-		} else {	/* mpeg1 */
-		    int len_skip;
-		    uint8_t * ptsbuf;
-
-		    len = 7;
-		    while (header[len - 1] == 0xff) {
-			len++;
-			NEEDBYTES (len);
-			if (len > 23) {
-			    fprintf (stderr, "too much stuffing\n");
-			    break;
-			}
-		    }
-		    if ((header[len - 1] & 0xc0) == 0x40) {
-			len += 2;
-			NEEDBYTES (len);
-		    }
-		    len_skip = len;
-		    len += mpeg1_skip_table[header[len - 1] >> 4];
-		    NEEDBYTES (len);
-		    /* header points to the mpeg1 pes header */
-		    ptsbuf = header + len_skip;
-		    if ((ptsbuf[-1] & 0xe0) == 0x20) {
-			uint32_t pts, dts;
-
-			pts = (((ptsbuf[-1] >> 1) << 30) |
-			       (ptsbuf[0] << 22) | ((ptsbuf[1] >> 1) << 15) |
-			       (ptsbuf[2] << 7) | (ptsbuf[3] >> 1));
-			dts = (((ptsbuf[-1] & 0xf0) != 0x30) ? pts :
-			       (uint32_t)(((ptsbuf[4] >> 1) << 30) |
-				(ptsbuf[5] << 22) | ((ptsbuf[6] >> 1) << 15) |
-				(ptsbuf[7] << 7) | (ptsbuf[18] >> 1)));
-			mpeg2_tag_picture (mpeg2dec, pts, dts);
-		    }
-		}
-		DONEBYTES (len);
-		bytes = 6 + (header[4] << 8) + header[5] - len;
-		if (demux_pid || (bytes > end - buf)) {
-		    decode_mpeg2 (buf, end);
-		    state = DEMUX_DATA;
-		    state_bytes = bytes - (end - buf);
-		    return 0;
-		} else if (bytes > 0) {
-		    decode_mpeg2 (buf, buf + bytes);
-		    buf += bytes;
-		}
-	    } else if (header[3] < 0xb9) {
-		fprintf (stderr,
-			 "looks like a video stream, not system stream\n");
-		DONEBYTES (4);
-	    } else {
-		NEEDBYTES (6);
-		DONEBYTES (6);
-		bytes = (header[4] << 8) + header[5];
-		if (bytes > end - buf) {
-		    state = DEMUX_SKIP;
-		    state_bytes = bytes - (end - buf);
-		    return 0;
-		}
-		buf += bytes;
-	    }
-	}
+	queued->buf = pipeline.copies[input->tail & input->mask];
+	queued->end = queued->buf + (payload->end - payload->buf);
+	memcpy (queued->buf, payload->buf, payload->end - payload->buf);
     }
+    ring_advance (input, &input->tail);
 }
 
-static void ps_loop (void)
+#endif
+
+/* the buffer to read into, and what to do with what was read */
+static uint8_t * input_buffer (uint8_t * buffer)
+{
+#ifdef PIPELINE
+    if (pipeline.active)
+	return pipeline_buffer ();
+#endif
+    return buffer;
+}
+
+static void input_payload (const mpeg2demux_info_t * payload)
+{
+#ifdef PIPELINE
+    if (pipeline.active) {
+	pipeline_payload (payload);
+	return;
+    }
+#endif
+    decode_payload (&main_decoder, payload);
+}
+
+static void demux_loop (mpeg2demux_format_t format, int stream)
 {
     uint8_t * buffer = (uint8_t *) malloc (buffer_size);
+    uint8_t * read;
     uint8_t * end;
+    mpeg2demux_t * demux;
+    const mpeg2demux_info_t * info;
+    mpeg2demux_state_t state;
+
+    demux = mpeg2demux_init (format, stream);
+    if (buffer == NULL || demux == NULL)
+	exit (1);
+    info = mpeg2demux_info (demux);
+    do {
+	read = input_buffer (buffer);
+	end = read + fread (read, 1, buffer_size, in_file);
+	mpeg2demux_buffer (demux, read, end);
+	while ((state = mpeg2demux_parse (demux)) != MPEG2DEMUX_BUFFER) {
+	    if (state == MPEG2DEMUX_END)
+		goto done;	/* hit program_end_code */
+	    else if (state == MPEG2DEMUX_ERROR) {
+		fprintf (stderr, "%s\n", mpeg2demux_error_string (demux));
+		if (info->error == MPEG2DEMUX_ERROR_STREAM_ID)
+		    exit (1);
+	    } else
+		input_payload (info);
+	}
+    } while (end == read + buffer_size && !sigint);
+    done:
+    mpeg2demux_close (demux);
+    free (buffer);
+}
+
+static void es_loop (void)
+{
+    uint8_t * buffer = (uint8_t *) malloc (buffer_size);
+    mpeg2demux_info_t payload;
 
     if (buffer == NULL)
 	exit (1);
+    memset (&payload, 0, sizeof (payload));
     do {
-	end = buffer + fread (buffer, 1, buffer_size, in_file);
-	if (demux (buffer, end, 0))
-	    break;	/* hit program_end_code */
-    } while (end == buffer + buffer_size && !sigint);
+	payload.buf = input_buffer (buffer);
+	payload.end = payload.buf + fread (payload.buf, 1, buffer_size,
+					   in_file);
+	input_payload (&payload);
+    } while (payload.end == payload.buf + buffer_size && !sigint);
     free (buffer);
 }
 
-static int pva_demux (uint8_t * buf, uint8_t * end)
-{
-    static int state = DEMUX_SKIP;
-    static int state_bytes = 0;
-    static uint8_t head_buf[15];
-
-    uint8_t * header;
-    int bytes;
-    int len;
-
-    switch (state) {
-    case DEMUX_HEADER:
-        if (state_bytes > 0) {
-            header = head_buf;
-            bytes = state_bytes;
-            goto continue_header;
-        }
-        break;
-    case DEMUX_DATA:
-        if (state_bytes > end - buf) {
-            decode_mpeg2 (buf, end);
-            state_bytes -= end - buf;
-            return 0;
-        }
-        decode_mpeg2 (buf, buf + state_bytes);
-        buf += state_bytes;
-        break;
-    case DEMUX_SKIP:
-        if (state_bytes > end - buf) {
-            state_bytes -= end - buf;
-            return 0;
-        }
-        buf += state_bytes;
-        break;
-    }
+static void input_loop (void)
+{
+    if (demux_pva)
+	demux_loop (MPEG2DEMUX_PVA, 0);
+    else if (demux_pid)
+	demux_loop (MPEG2DEMUX_TS, demux_pid);
+    else if (demux_track)
+	demux_loop (MPEG2DEMUX_PS, demux_track);
+    else
+	es_loop ();
+}
+
+#ifdef PIPELINE
+
+static void * pipeline_reader (void * arg)
+{
+    mpeg2demux_info_t end;
+
+    input_loop ();
+    memset (&end, 0, sizeof (end));
+    pipeline_payload (&end);
+    return NULL;
+}
+
+static void * pipeline_drawer (void * arg)
+{
+    ring_t * output = &pipeline.output;
+    pipeline_frame_t * frame;
 
     while (1) {
-    payload_start:
-	header = buf;
-	bytes = end - buf;
-    continue_header:
-	NEEDBYTES (2);
-	if (header[0] != 0x41 || header[1] != 0x56) {
-	    if (header != head_buf) {
-		buf++;
-		goto payload_start;
-	    } else {
-		header[0] = header[1];
-		bytes = 1;
-		goto continue_header;
-	    }
+	ring_wait (output, &output->tail, output->head + 1);
+	frame = pipeline.frames + (output->head & output->mask);
+	if (frame->call == NULL)
+	    break;
+	pthread_mutex_lock (&pipeline.lock);
+	frame->call (pipeline.target, frame->buf, frame->id);
+	pthread_mutex_unlock (&pipeline.lock);
+	ring_advance (output, &output->head);
+    }
+    return NULL;
+}
+
+/* the entry following a buffer of the target through the output ring */
+static pipeline_fbuf_t * pipeline_track (uint8_t * const * buf)
+{
+    pipeline_fbuf_t * fbuf;
+    int i;
+
+    for (i = 0; i < pipeline.nb_fbufs; i++)
+	if (pipeline.fbufs[i].buf[0] == buf[0])
+	    return pipeline.fbufs + i;
+    if (pipeline.nb_fbufs == PIPELINE_FBUFS) {
+	/* more buffers than expected, start over once all are drawn */
+	ring_wait (&pipeline.output, &pipeline.output.head,
+		   pipeline.output.tail);
+	pipeline.nb_fbufs = 0;
+    }
+    fbuf = pipeline.fbufs + pipeline.nb_fbufs++;
+    fbuf->buf[0] = buf[0];
+    fbuf->drawn = ring_load (&pipeline.output.head);
+    return fbuf;
+}
+
+static void pipeline_queue (void call (vo_instance_t *, uint8_t * const *,
+				       void *),
+			    uint8_t * const * buf, void * id)
+{
+    ring_t * output = &pipeline.output;
+    pipeline_frame_t * frame;
+    pipeline_fbuf_t * fbuf;
+
+    ring_wait (output, &output->head, output->tail - output->mask);
+    frame = pipeline.frames + (output->tail & output->mask);
+    frame->call = call;
+    if (call != NULL) {
+	frame->buf[0] = buf[0];
+	frame->buf[1] = buf[1];
+	frame->buf[2] = buf[2];
+	frame->id = id;
+	fbuf = pipeline.own ? (pipeline_fbuf_t *) id : pipeline_track (buf);
+	fbuf->drawn = output->tail + 1;
+    }
+    ring_advance (output, &output->tail);
+}
+
+static void pipeline_free_fbufs (void)
+{
+    int i;
+
+    if (pipeline.own)
+	for (i = 0; i < pipeline.nb_fbufs; i++) {
+	    free (pipeline.fbufs[i].buf[0]);
+	    free (pipeline.fbufs[i].buf[1]);
+	    free (pipeline.fbufs[i].buf[2]);
 	}
-	NEEDBYTES (8);
-	if (header[2] != 1) {
-	    DONEBYTES (8);
-	    bytes = (header[6] << 8) + header[7];
-	    if (bytes > end - buf) {
-		state = DEMUX_SKIP;
-		state_bytes = bytes - (end - buf);
-		return 0;
-	    } 
-	    buf += bytes; 
-	} else {
-	    len = 8;
-	    if (header[5] & 0x10) {
-		len = 12 + (header[5] & 3);
-		NEEDBYTES (len);
-		decode_mpeg2 (header + 12, header + len);
-		mpeg2_tag_picture (mpeg2dec,
-				   ((header[8] << 24) | (header[9] << 16) |
-				    (header[10] << 8) | header[11]), 0);
-	    }
-	    DONEBYTES (len);
-	    bytes = (header[6] << 8) + header[7] + 8 - len;
-	    if (bytes > end - buf) {
-		decode_mpeg2 (buf, end);
-		state = DEMUX_DATA;
-		state_bytes = bytes - (end - buf);
-		return 0;
-	    } else if (bytes > 0) {
-		decode_mpeg2 (buf, buf + bytes);
-		buf += bytes;
-	    }
+    pipeline.nb_fbufs = 0;
+}
+
+static void pipeline_setup_fbuf (vo_instance_t * instance,
+				 uint8_t ** buf, void ** id)
+{
+    pthread_mutex_lock (&pipeline.lock);
+    pipeline.target->setup_fbuf (pipeline.target, buf, id);
+    pthread_mutex_unlock (&pipeline.lock);
+}
+
+/* the target picks a buffer among those it was told are discarded */
+static void pipeline_target_fbuf (vo_instance_t * instance,
+				  uint8_t ** buf, void ** id)
+{
+    ring_wait (&pipeline.output, &pipeline.output.head, pipeline.discarded);
+    pthread_mutex_lock (&pipeline.lock);
+    pipeline.target->set_fbuf (pipeline.target, buf, id);
+    pthread_mutex_unlock (&pipeline.lock);
+}
+
+/* the next buffer the decoder does not hold, once it is drawn */
+static void pipeline_set_fbuf (vo_instance_t * instance,
+			       uint8_t ** buf, void ** id)
+{
+    pipeline_fbuf_t * fbuf;
+    int i;
+
+    do {
+	i = pipeline.next_fbuf;
+	pipeline.next_fbuf = (i + 1) % PIPELINE_FBUFS;
+    } while (i < pipeline.nb_fbufs && pipeline.fbufs[i].decoding);
+    fbuf = pipeline.fbufs + i;
+    if (i == pipeline.nb_fbufs) {
+	pipeline.nb_fbufs++;
+	for (i = 0; i < 3; i++) {
+	    fbuf->buf[i] = (uint8_t *) malloc (pipeline.size[!!i]);
+	    if (fbuf->buf[i] == NULL)
+		exit (1);
+	    memset (fbuf->buf[i], 0, pipeline.size[!!i]);
 	}
+	fbuf->drawn = ring_load (&pipeline.output.head);
     }
+    ring_wait (&pipeline.output, &pipeline.output.head, fbuf->drawn);
+    fbuf->decoding = 1;
+    buf[0] = fbuf->buf[0];
+    buf[1] = fbuf->buf[1];
+    buf[2] = fbuf->buf[2];
+    *id = fbuf;
 }
 
-static void pva_loop (void)
+static void pipeline_start_fbuf (vo_instance_t * instance,
+				 uint8_t * const * buf, void * id)
+{
+    pipeline_fbuf_t * fbuf;
+
+    /* ours were waited for when they were given out */
+    if (!pipeline.own) {
+	fbuf = pipeline_track (buf);
+	ring_wait (&pipeline.output, &pipeline.output.head, fbuf->drawn);
+    }
+    if (pipeline.target->start_fbuf) {
+	pthread_mutex_lock (&pipeline.lock);
+	pipeline.target->start_fbuf (pipeline.target, buf, id);
+	pthread_mutex_unlock (&pipeline.lock);
+    }
+}
+
+static void pipeline_draw (vo_instance_t * instance,
+			   uint8_t * const * buf, void * id)
+{
+    if (pipeline.direct)
+	pipeline.target->draw (pipeline.target, buf, id);
+    else
+	pipeline_queue (pipeline.target->draw, buf, id);
+}
+
+static void pipeline_discard (vo_instance_t * instance,
+			      uint8_t * const * buf, void * id)
+{
+    if (pipeline.own)
+	((pipeline_fbuf_t *) id)->decoding = 0;
+    if (pipeline.target->discard) {
+	pipeline_queue (pipeline.target->discard, buf, id);
+	pipeline.discarded = pipeline.output.tail;
+    }
+}
+
+static int pipeline_setup (vo_instance_t * instance, unsigned int width,
+			   unsigned int height, unsigned int chroma_width,
+			   unsigned int chroma_height,
+			   vo_setup_result_t * result)
+{
+    vo_instance_t * target = pipeline.target;
+    int own, i;
+
+    /* the target is not drawing anything while it changes */
+    ring_wait (&pipeline.output, &pipeline.output.head,
+	       pipeline.output.tail);
+    if (target->setup (target, width, height, chroma_width, chroma_height,
+		       result))
+	return 1;
+    /*
+     * A target converting into buffers of the decoder draws them right
+     * away, as the decoder frees them at the next sequence. Otherwise
+     * the buffers are the target's if it has any, else ours.
+     */
+    own = !target->setup_fbuf && !target->set_fbuf;
+    pipeline.direct = own && result->convert != NULL;
+    own &= !pipeline.direct;
+    if (!own || !pipeline.own || pipeline.size[0] != width * height ||
+	pipeline.size[1] != chroma_width * chroma_height)
+	pipeline_free_fbufs ();
+    pipeline.own = own;
+    pipeline.size[0] = width * height;
+    pipeline.size[1] = chroma_width * chroma_height;
+    /* the decoder starts over with new buffers */
+    for (i = 0; i < pipeline.nb_fbufs; i++)
+	pipeline.fbufs[i].decoding = 0;
+    pipeline.next_fbuf = 0;
+
+    if (pipeline.direct) {
+	pipeline.vo.setup_fbuf = NULL;
+	pipeline.vo.set_fbuf = NULL;
+	pipeline.vo.start_fbuf = target->start_fbuf;
+	pipeline.vo.discard = target->discard;
+    } else {
+	pipeline.vo.setup_fbuf = (target->setup_fbuf ?
+				  pipeline_setup_fbuf : NULL);
+	pipeline.vo.set_fbuf = (own ? pipeline_set_fbuf :
+				target->set_fbuf ? pipeline_target_fbuf :
+				NULL);
+	pipeline.vo.start_fbuf = pipeline_start_fbuf;
+	pipeline.vo.discard = pipeline_discard;
+    }
+    return 0;
+}
+
+static void pipeline_close (vo_instance_t * instance)
+{
+    pipeline_queue (NULL, NULL, NULL);
+    pthread_join (pipeline.drawer, NULL);
+    ring_destroy (&pipeline.output);
+    pipeline_free_fbufs ();
+    pthread_mutex_destroy (&pipeline.lock);
+    if (pipeline.target->close)
+	pipeline.target->close (pipeline.target);
+}
+
+/* outputs that draw get a thread of their own */
+static int pipeline_open (decoder_t * decoder)
+{
+    vo_instance_t * output = decoder->output;
+    int i;
+
+    if (verbose || compact || output->draw == NULL)
+	return 0;
+    for (i = 0; i < PIPELINE_BUFFERS; i++) {
+	pipeline.buffers[i] = (uint8_t *) malloc (buffer_size);
+	if (pipeline.buffers[i] == NULL)
+	    exit (1);
+    }
+    ring_init (&pipeline.input, PIPELINE_PAYLOADS);
+    ring_init (&pipeline.output, PIPELINE_FRAMES);
+    pthread_mutex_init (&pipeline.lock, NULL);
+    /* the other hooks are chosen once the target is set up */
+    pipeline.vo.setup = pipeline_setup;
+    pipeline.vo.setup_fbuf = NULL;
+    pipeline.vo.set_fbuf = NULL;
+    pipeline.vo.start_fbuf = NULL;
+    pipeline.vo.draw = pipeline_draw;
+    pipeline.vo.discard = NULL;
+    pipeline.vo.close = pipeline_close;
+    pipeline.target = output;
+    decoder->output = &pipeline.vo;
+    if (pthread_create (&pipeline.drawer, NULL, pipeline_drawer, NULL)) {
+	fprintf (stderr, "could not create output thread\n");
+	exit (1);
+    }
+    pipeline.active = 1;
+    return 1;
+}
+
+static void pipeline_decode (void)
+{
+    ring_t * input = &pipeline.input;
+    mpeg2demux_info_t * payload;
+    int i;
+
+    if (pthread_create (&pipeline.reader, NULL, pipeline_reader, NULL)) {
+	fprintf (stderr, "could not create reader thread\n");
+	exit (1);
+    }
+    while (1) {
+	ring_wait (input, &input->tail, input->head + 1);
+	payload = pipeline.payloads + (input->head & input->mask);
+	if (payload->buf == NULL)
+	    break;
+	decode_payload (&main_decoder, payload);
+	ring_advance (input, &input->head);
+    }
+    pthread_join (pipeline.reader, NULL);
+    ring_destroy (input);
+    for (i = 0; i < PIPELINE_BUFFERS; i++)
+	free (pipeline.buffers[i]);
+}
+
+#endif
+
+static void open_decoder (decoder_t * decoder)
+{
+    decoder->output = output_open ();
+    if (decoder->output == NULL) {
+	fprintf (stderr, "Can not open output\n");
+	exit (1);
+    }
+    decoder->mpeg2dec = mpeg2_init ();
+    if (decoder->mpeg2dec == NULL)
+	exit (1);
+    if (verbose > 4)
+	mpeg2_macroblock_info (decoder->mpeg2dec, 1);
+    if (low_latency)
+	mpeg2_low_latency (decoder->mpeg2dec, low_latency);
+    if (compact) {
+	mpeg2_compact (decoder->mpeg2dec, 1);
+	mpeg2_intra_fbufs (decoder->mpeg2dec, 1);
+    }
+    if (degrade)
+	mpeg2_deadline (decoder->mpeg2dec, picture_late, decoder);
+}
+
+static void print_memory (mpeg2dec_t * mpeg2dec)
+{
+    mpeg2_alloc_stats_t total, by_reason[MPEG2_ALLOC_CONVERTED + 1];
+
+    mpeg2_alloc_stats (mpeg2dec, &total, by_reason);
+    fprintf (stderr, "at most %u bytes in %u buffers: %u decoder, %u chunk, "
+	     "%u yuv, %u convert id, %u converted\n",
+	     total.peak_bytes, total.peak_buffers,
+	     by_reason[MPEG2_ALLOC_MPEG2DEC].peak_bytes,
+	     by_reason[MPEG2_ALLOC_CHUNK].peak_bytes,
+	     by_reason[MPEG2_ALLOC_YUV].peak_bytes,
+	     by_reason[MPEG2_ALLOC_CONVERT_ID].peak_bytes,
+	     by_reason[MPEG2_ALLOC_CONVERTED].peak_bytes);
+}
+
+static void close_decoder (decoder_t * decoder)
+{
+    if (compact) {
+	if (demux_all)
+	    fprintf (stderr, "pid 0x%x: ", decoder->pid);
+	print_memory (gop_parallel ? NULL : decoder->mpeg2dec);
+    }
+    if (degrade) {
+	if (demux_all)
+	    fprintf (stderr, "pid 0x%x: ", decoder->pid);
+	fprintf (stderr, "%u late B pictures degraded\n", decoder->degraded);
+    }
+    mpeg2_close (decoder->mpeg2dec);
+    if (decoder->output->close)
+	decoder->output->close (decoder->output);
+}
+
+static decoder_t * find_program (const mpeg2demux_info_t * info)
+{
+    decoder_t ** new_programs;
+    decoder_t * decoder;
+    char prefix[16];
+    int i;
+
+    for (i = 0; i < num_programs; i++)
+	if (programs[i]->pid == info->stream)
+	    return programs[i];
+
+    new_programs = (decoder_t **) realloc (programs, (num_programs + 1) *
+					   sizeof (decoder_t *));
+    decoder = (decoder_t *) calloc (1, sizeof (decoder_t));
+    if (new_programs == NULL || decoder == NULL)
+	exit (1);
+    programs = new_programs;
+    programs[num_programs++] = decoder;
+    open_decoder (decoder);
+    decoder->pid = info->stream;
+    decoder->program = info->program;
+    /* the programs would write over each other's frames */
+    sprintf (prefix, "0x%x-", decoder->pid);
+    vo_name_frames (decoder->output, prefix);
+    return decoder;
+}
+
+static void queue_payload (decoder_t * decoder, const mpeg2demux_info_t * info)
+{
+    if (decoder->num_payloads == decoder->max_payloads) {
+	decoder->max_payloads = 2 * decoder->max_payloads + 16;
+	decoder->payloads = (mpeg2demux_info_t *)
+	    realloc (decoder->payloads,
+		     decoder->max_payloads * sizeof (mpeg2demux_info_t));
+	if (decoder->payloads == NULL)
+	    exit (1);
+    }
+    decoder->payloads[decoder->num_payloads++] = *info;
+}
+
+static void decode_payloads (decoder_t * decoder)
+{
+    int i;
+
+    for (i = 0; i < decoder->num_payloads; i++)
+	decode_payload (decoder, decoder->payloads + i);
+    decoder->num_payloads = 0;
+}
+
+#ifdef HAVE_PTHREAD
+
+/*
+ * The worker threads share one job counter: each decode round hands
+ * out every program once, so a given mpeg2dec_t is only ever touched
+ * by one thread at a time, and payloads are consumed in stream order.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int count;
+    int next;
+    int finished;
+    int quit;
+    pthread_t * threads;
+} pool;
+
+static void * pool_thread (void * arg)
+{
+    decoder_t * decoder;
+
+    pthread_mutex_lock (&pool.lock);
+    while (1) {
+	while (pool.next == pool.count && !pool.quit)
+	    pthread_cond_wait (&pool.start, &pool.lock);
+	if (pool.quit)
+	    break;
+	decoder = programs[pool.next++];
+	pthread_mutex_unlock (&pool.lock);
+	decode_payloads (decoder);
+	pthread_mutex_lock (&pool.lock);
+	if (++pool.finished == pool.count)
+	    pthread_cond_signal (&pool.done);
+    }
+    pthread_mutex_unlock (&pool.lock);
+    return NULL;
+}
+
+static void pool_start (void)
+{
+    int i;
+
+    pthread_mutex_init (&pool.lock, NULL);
+    pthread_cond_init (&pool.start, NULL);
+    pthread_cond_init (&pool.done, NULL);
+    pool.threads = (pthread_t *) malloc (num_threads * sizeof (pthread_t));
+    if (pool.threads == NULL)
+	exit (1);
+    for (i = 0; i < num_threads; i++)
+	if (pthread_create (pool.threads + i, NULL, pool_thread, NULL)) {
+	    fprintf (stderr, "could not create decoder thread\n");
+	    exit (1);
+	}
+}
+
+static void pool_decode (void)
+{
+    pthread_mutex_lock (&pool.lock);
+    pool.count = num_programs;
+    pool.next = pool.finished = 0;
+    pthread_cond_broadcast (&pool.start);
+    while (pool.finished < pool.count)
+	pthread_cond_wait (&pool.done, &pool.lock);
+    pthread_mutex_unlock (&pool.lock);
+}
+
+static void pool_stop (void)
+{
+    int i;
+
+    pthread_mutex_lock (&pool.lock);
+    pool.quit = 1;
+    pthread_cond_broadcast (&pool.start);
+    pthread_mutex_unlock (&pool.lock);
+    for (i = 0; i < num_threads; i++)
+	pthread_join (pool.threads[i], NULL);
+    free (pool.threads);
+    pthread_cond_destroy (&pool.done);
+    pthread_cond_destroy (&pool.start);
+    pthread_mutex_destroy (&pool.lock);
+}
+
+#endif
+
+static void decode_programs (void)
+{
+    int i, frames;
+
+    frames = 0;
+    for (i = 0; i < num_programs; i++)
+	frames -= programs[i]->frames;
+#ifdef HAVE_PTHREAD
+    if (num_threads > 1)
+	pool_decode ();
+    else
+#endif
+	for (i = 0; i < num_programs; i++)
+	    decode_payloads (programs[i]);
+    for (i = 0; i < num_programs; i++)
+	frames += programs[i]->frames;
+    while (frames--)
+	print_fps (0);
+}
+
+static void multi_loop (void)
 {
     uint8_t * buffer = (uint8_t *) malloc (buffer_size);
     uint8_t * end;
+    mpeg2demux_t * demux;
+    const mpeg2demux_info_t * info;
+    mpeg2demux_state_t state;
+    int i;
 
-    if (buffer == NULL)
+    demux = mpeg2demux_init (MPEG2DEMUX_TS, 0);
+    if (buffer == NULL || demux == NULL)
 	exit (1);
+    info = mpeg2demux_info (demux);
+#ifdef HAVE_PTHREAD
+    if (num_threads > 1)
+	pool_start ();
+#endif
     do {
+	/* payloads stay valid until the next mpeg2demux_buffer () */
 	end = buffer + fread (buffer, 1, buffer_size, in_file);
-	pva_demux (buffer, end);
+	mpeg2demux_buffer (demux, buffer, end);
+	while ((state = mpeg2demux_parse (demux)) != MPEG2DEMUX_BUFFER)
+	    if (state == MPEG2DEMUX_ERROR) {
+		fprintf (stderr, "%s\n", mpeg2demux_error_string (demux));
+		if (info->error == MPEG2DEMUX_ERROR_STREAM_ID)
+		    exit (1);
+	    } else if (state == MPEG2DEMUX_PAYLOAD)
+		queue_payload (find_program (info), info);
+	decode_programs ();
     } while (end == buffer + buffer_size && !sigint);
+#ifdef HAVE_PTHREAD
+    if (num_threads > 1)
+	pool_stop ();
+#endif
+    mpeg2demux_close (demux);
     free (buffer);
+
+    for (i = 0; i < num_programs; i++) {
+	fprintf (stderr, "program %d pid 0x%x: %d frames\n",
+		 programs[i]->program, programs[i]->pid, programs[i]->frames);
+	close_decoder (programs[i]);
+	free (programs[i]->payloads);
+	free (programs[i]);
+    }
+    free (programs);
 }
 
-static void ts_loop (void)
-{
-    uint8_t * buffer = (uint8_t *) malloc (buffer_size);
+/*
+ * -g mode: the whole stream is read in memory and cut into ranges of
+ * gops that separate decoders can work on, each decoder copying out
+ * the frames of its range. The main thread shows the ranges in order,
+ * and decoders only get ahead of it by a bounded number of ranges.
+ */
+typedef struct {
+    unsigned int width;
+    unsigned int height;
+    unsigned int chroma_width;
+    unsigned int chroma_height;
     uint8_t * buf;
-    uint8_t * nextbuf;
-    uint8_t * data;
-    uint8_t * end;
-    int pid;
+} frame_t;
+
+typedef struct {
+    int done;
+    int num_frames;
+    int max_frames;
+    frame_t * frames;
+} range_t;
+
+static struct {
+    int count;
+    mpeg2_range_t * ranges;
+    range_t * jobs;
+#ifdef HAVE_PTHREAD
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int next;
+    int shown;
+#endif
+} batch;
+
+static int store_frame (void * arg, const mpeg2_info_t * info)
+{
+    range_t * job = (range_t *) arg;
+    const mpeg2_sequence_t * sequence = info->sequence;
+    frame_t * frame;
+    unsigned int size, chroma_size;
+
+    if (job->num_frames == job->max_frames) {
+	job->max_frames = 2 * job->max_frames + 16;
+	job->frames = (frame_t *) realloc (job->frames,
+					   job->max_frames * sizeof (frame_t));
+	if (job->frames == NULL)
+	    exit (1);
+    }
+    frame = job->frames + job->num_frames++;
+    frame->width = sequence->width;
+    frame->height = sequence->height;
+    frame->chroma_width = sequence->chroma_width;
+    frame->chroma_height = sequence->chroma_height;
+    size = sequence->width * sequence->height;
+    chroma_size = sequence->chroma_width * sequence->chroma_height;
+    frame->buf = (uint8_t *) malloc (size + 2 * chroma_size);
+    if (frame->buf == NULL)
+	exit (1);
+    memcpy (frame->buf, info->display_fbuf->buf[0], size);
+    memcpy (frame->buf + size, info->display_fbuf->buf[1], chroma_size);
+    memcpy (frame->buf + size + chroma_size, info->display_fbuf->buf[2],
+	    chroma_size);
+    return 0;
+}
 
-    if (buffer == NULL || buffer_size < 188)
+static void decode_range (mpeg2dec_t * mpeg2dec, int i)
+{
+    if (mpeg2_decode_range (mpeg2dec, batch.ranges + i, NULL, NULL,
+			    store_frame, batch.jobs + i)) {
+	fprintf (stderr, "could not decode range %d\n", i);
 	exit (1);
-    buf = buffer;
-    do {
-	end = buf + fread (buf, 1, buffer + buffer_size - buf, in_file);
-	buf = buffer;
-	for (; (nextbuf = buf + 188) <= end; buf = nextbuf) {
-	    if (*buf != 0x47) {
-		fprintf (stderr, "bad sync byte\n");
-		nextbuf = buf + 1;
-		continue;
+    }
+}
+
+static void show_range (range_t * job)
+{
+    static frame_t format;
+    vo_instance_t * output = main_decoder.output;
+    vo_setup_result_t setup_result;
+    frame_t * frame;
+    uint8_t * buf[3];
+    int i;
+
+    for (i = 0; i < job->num_frames; i++) {
+	frame = job->frames + i;
+	if (frame->width != format.width || frame->height != format.height ||
+	    frame->chroma_width != format.chroma_width ||
+	    frame->chroma_height != format.chroma_height) {
+	    format = *frame;
+	    if (output->setup (output, frame->width, frame->height,
+			       frame->chroma_width, frame->chroma_height,
+			       &setup_result)) {
+		fprintf (stderr, "display setup failed\n");
+		exit (1);
 	    }
-	    pid = ((buf[1] << 8) + buf[2]) & 0x1fff;
-	    if (pid != demux_pid)
-		continue;
-	    data = buf + 4;
-	    if (buf[3] & 0x20) {	/* buf contains an adaptation field */
-		data = buf + 5 + buf[4];
-		if (data > nextbuf)
-		    continue;
+	    if (setup_result.convert) {
+		fprintf (stderr, "-g can not be used with this output\n");
+		exit (1);
 	    }
-	    if (buf[3] & 0x10)
-		demux (data, nextbuf,
-		       (buf[1] & 0x40) ? DEMUX_PAYLOAD_START : 0);
 	}
-	if (end != buffer + buffer_size)
-	    break;
-	memcpy (buffer, buf, end - buf);
-	buf = buffer + (end - buf);
-    } while (!sigint);
-    free (buffer);
+	buf[0] = frame->buf;
+	buf[1] = buf[0] + frame->width * frame->height;
+	buf[2] = buf[1] + frame->chroma_width * frame->chroma_height;
+	if (output->draw)
+	    output->draw (output, buf, NULL);
+	free (frame->buf);
+	main_decoder.frames++;
+	print_fps (0);
+    }
+    free (job->frames);
 }
 
-static void es_loop (void)
+#ifdef HAVE_PTHREAD
+
+static void * range_thread (void * arg)
 {
-    uint8_t * buffer = (uint8_t *) malloc (buffer_size);
-    uint8_t * end;
+    mpeg2dec_t * mpeg2dec;
+    int i;
 
-    if (buffer == NULL)
+    mpeg2dec = mpeg2_init ();
+    if (mpeg2dec == NULL)
+	exit (1);
+    if (compact) {
+	mpeg2_compact (mpeg2dec, 1);
+	mpeg2_intra_fbufs (mpeg2dec, 1);
+    }
+    pthread_mutex_lock (&batch.lock);
+    while (batch.next < batch.count) {
+	if (batch.next >= batch.shown + 2 * num_threads) {
+	    pthread_cond_wait (&batch.start, &batch.lock);
+	    continue;
+	}
+	i = batch.next++;
+	pthread_mutex_unlock (&batch.lock);
+	decode_range (mpeg2dec, i);
+	pthread_mutex_lock (&batch.lock);
+	batch.jobs[i].done = 1;
+	pthread_cond_signal (&batch.done);
+    }
+    pthread_mutex_unlock (&batch.lock);
+    mpeg2_close (mpeg2dec);
+    return NULL;
+}
+
+static void decode_ranges (void)
+{
+    pthread_t * threads;
+    int i;
+
+    pthread_mutex_init (&batch.lock, NULL);
+    pthread_cond_init (&batch.start, NULL);
+    pthread_cond_init (&batch.done, NULL);
+    batch.next = batch.shown = 0;
+    threads = (pthread_t *) malloc (num_threads * sizeof (pthread_t));
+    if (threads == NULL)
 	exit (1);
+    for (i = 0; i < num_threads; i++)
+	if (pthread_create (threads + i, NULL, range_thread, NULL)) {
+	    fprintf (stderr, "could not create decoder thread\n");
+	    exit (1);
+	}
+    for (i = 0; i < batch.count; i++) {
+	pthread_mutex_lock (&batch.lock);
+	while (!batch.jobs[i].done)
+	    pthread_cond_wait (&batch.done, &batch.lock);
+	pthread_mutex_unlock (&batch.lock);
+	show_range (batch.jobs + i);
+	pthread_mutex_lock (&batch.lock);
+	batch.shown = i + 1;
+	pthread_cond_broadcast (&batch.start);
+	pthread_mutex_unlock (&batch.lock);
+    }
+    for (i = 0; i < num_threads; i++)
+	pthread_join (threads[i], NULL);
+    free (threads);
+    pthread_cond_destroy (&batch.done);
+    pthread_cond_destroy (&batch.start);
+    pthread_mutex_destroy (&batch.lock);
+}
+
+#else
+
+static void decode_ranges (void)
+{
+    int i;
+
+    for (i = 0; i < batch.count; i++) {
+	decode_range (main_decoder.mpeg2dec, i);
+	show_range (batch.jobs + i);
+    }
+}
+
+#endif
+
+static void gop_loop (void)
+{
+    uint8_t * buffer = NULL;
+    unsigned int size, max_size;
+    int gops;
+
+    size = max_size = 0;
     do {
-	end = buffer + fread (buffer, 1, buffer_size, in_file);
-	decode_mpeg2 (buffer, end);
-    } while (end == buffer + buffer_size && !sigint);
+	if (size == max_size) {
+	    max_size = 2 * max_size + buffer_size;
+	    buffer = (uint8_t *) realloc (buffer, max_size);
+	    if (buffer == NULL)
+		exit (1);
+	}
+	size += fread (buffer + size, 1, max_size - size, in_file);
+    } while (size == max_size && !sigint);
+
+    /* a few gops per range, unless that leaves threads idle */
+    gops = 4;
+    batch.count = mpeg2_find_ranges (buffer, buffer + size, gops, NULL, 0);
+    if (batch.count < num_threads) {
+	gops = 1;
+	batch.count = mpeg2_find_ranges (buffer, buffer + size, gops, NULL, 0);
+    }
+    batch.ranges = (mpeg2_range_t *) malloc (batch.count *
+					     sizeof (mpeg2_range_t));
+    batch.jobs = (range_t *) calloc (batch.count, sizeof (range_t));
+    if (batch.count && (batch.ranges == NULL || batch.jobs == NULL))
+	exit (1);
+    mpeg2_find_ranges (buffer, buffer + size, gops, batch.ranges, batch.count);
+    decode_ranges ();
+
+    free (batch.jobs);
+    free (batch.ranges);
     free (buffer);
 }
 
@@ -772,28 +1520,31 @@ int main (int argc, char ** argv)
 
     handle_args (argc, argv);
 
-    output = output_open ();
-    if (output == NULL) {
-	fprintf (stderr, "Can not open output\n");
-	return 1;
+    if (demux_all) {
+	mpeg2_malloc_hooks (malloc_hook, NULL);
+	multi_loop ();
+	if (compact) {
+	    fprintf (stderr, "all programs: ");
+	    print_memory (NULL);
+	}
+	print_fps (1);
+	fclose (in_file);
+	return 0;
     }
-    mpeg2dec = mpeg2_init ();
-    if (mpeg2dec == NULL)
-	exit (1);
+
+    open_decoder (&main_decoder);
     mpeg2_malloc_hooks (malloc_hook, NULL);
 
-    if (demux_pva)
-	pva_loop ();
-    else if (demux_pid)
-	ts_loop ();
-    else if (demux_track)
-	ps_loop ();
+    if (gop_parallel)
+	gop_loop ();
+#ifdef PIPELINE
+    else if (pipeline_open (&main_decoder))
+	pipeline_decode ();
+#endif
     else
-	es_loop ();
+	input_loop ();
 
-    mpeg2_close (mpeg2dec);
-    if (output->close)
-	output->close (output);
+    close_decoder (&main_decoder);
     print_fps (1);
     fclose (in_file);
     return 0;
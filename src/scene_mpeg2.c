@@ -0,0 +1,303 @@
+/*
+ * scene_mpeg2.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#ifdef HAVE_IO_H
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <inttypes.h>
+
+#include "mpeg2.h"
+#include "mpeg2demux.h"
+
+/*
+ * Scene cuts are found from the macroblock side data of a parse only
+ * decode: no IDCT and no motion compensation is done. I pictures are
+ * compared through the histogram of their dc image (the mean luma of
+ * each macroblock), a P picture that starts a new scene has to code
+ * most of its macroblocks as intra, and a B picture that follows a cut
+ * can not use its forward reference.
+ */
+
+#define BUFFER_SIZE 65536
+#define BINS 32
+static uint8_t buffer[BUFFER_SIZE];
+static FILE * in_file;
+static int demux_track = 0;
+static int demux_pid = 0;
+static int demux_pva = 0;
+static double threshold = 0.5;
+static mpeg2dec_t * mpeg2dec;
+
+static struct {
+    int gop_base;	/* display number of the first picture of the gop */
+    int gop_pictures;
+    int have_histogram;
+    double histogram[BINS];	/* dc image of the last I picture */
+} scene;
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: "
+	     "%s [-h] [-c <threshold>] [-s <track>] [-t <pid>] [-p] <file>\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-c\tscene score above which a cut is reported, "
+	     "default 0.5\n"
+	     "\t-s\tuse program stream demultiplexer, "
+	     "track 0-15 or 0xe0-0xef\n"
+	     "\t-t\tuse transport stream demultiplexer, pid 0x10-0x1ffe\n"
+	     "\t-p\tuse pva demultiplexer\n",
+	     argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+
+    while ((c = getopt (argc, argv, "hc:s:t:p")) != -1)
+	switch (c) {
+	case 'c':
+	    threshold = strtod (optarg, &s);
+	    if (threshold < 0 || threshold > 1 || *s) {
+		fprintf (stderr, "Invalid threshold: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 's':
+	    demux_track = strtol (optarg, &s, 0);
+	    if (demux_track < 0xe0)
+		demux_track += 0xe0;
+	    if (demux_track < 0xe0 || demux_track > 0xef || *s) {
+		fprintf (stderr, "Invalid track number: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 't':
+	    demux_pid = strtol (optarg, &s, 0);
+	    if (demux_pid < 0x10 || demux_pid > 0x1ffe || *s) {
+		fprintf (stderr, "Invalid pid: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 'p':
+	    demux_pva = 1;
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind < argc) {
+	in_file = fopen (argv[optind], "rb");
+	if (!in_file) {
+	    fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		     argv[optind]);
+	    exit (1);
+	}
+    } else
+	in_file = stdin;
+}
+
+static int abs_mv (int x)
+{
+    return (x < 0) ? -x : x;
+}
+
+static void picture_done (const mpeg2_info_t * info)
+{
+    static const char type_char[] = "?IPBD???";
+    const mpeg2_picture_t * picture = info->current_picture;
+    const mpeg2_macroblock_t * mb = info->macroblocks;
+    unsigned int i, count, coded, intra, skipped, no_forward, predicted;
+    unsigned int histogram[BINS];
+    double score, activity, motion, diff;
+    int type;
+
+    count = (info->sequence->width >> 4) * (info->sequence->height >> 4);
+    coded = intra = skipped = no_forward = predicted = 0;
+    motion = 0;
+    memset (histogram, 0, sizeof (histogram));
+    for (i = 0; i < count; i++, mb++) {
+	if (!mb->flags)
+	    continue;
+	coded++;
+	if (mb->flags & MB_FLAG_INTRA) {
+	    intra++;
+	    histogram[mb->dc * BINS / 256]++;
+	} else if (mb->flags & MB_FLAG_MOTION_FORWARD) {
+	    predicted++;
+	    motion += abs_mv (mb->mv[0][0][0]) + abs_mv (mb->mv[0][0][1]);
+	} else if (mb->flags & MB_FLAG_MOTION_BACKWARD) {
+	    predicted++;
+	    motion += abs_mv (mb->mv[1][0][0]) + abs_mv (mb->mv[1][0][1]);
+	}
+	if (mb->flags & MB_FLAG_SKIPPED)
+	    skipped++;
+	if (!(mb->flags & MB_FLAG_MOTION_FORWARD))
+	    no_forward++;
+    }
+    if (!coded)
+	return;
+
+    type = picture->flags & PIC_MASK_CODING_TYPE;
+    score = 0;
+    if (type == PIC_FLAG_CODING_TYPE_I) {
+	/* half the L1 distance between the normalized histograms */
+	diff = 0;
+	for (i = 0; i < BINS; i++) {
+	    double bin = (double) histogram[i] / intra;
+
+	    diff += (bin > scene.histogram[i] ?
+		     bin - scene.histogram[i] : scene.histogram[i] - bin);
+	    scene.histogram[i] = bin;
+	}
+	if (scene.have_histogram)
+	    score = diff / 2;
+	scene.have_histogram = 1;
+    } else if (type == PIC_FLAG_CODING_TYPE_P)
+	score = (double) intra / coded;
+    else if (type == PIC_FLAG_CODING_TYPE_B)
+	score = (double) no_forward / coded;
+
+    /* mean absolute vector component, in pels */
+    activity = predicted ? motion / (4 * predicted) : 0;
+
+    printf ("%d %c %u", scene.gop_base + (int) picture->temporal_reference,
+	    type_char[type], picture->temporal_reference);
+    if (picture->flags & PIC_FLAG_TAGS)
+	printf (" %u", picture->tag);
+    else
+	printf (" -");
+    printf (" %.3f %.2f %.3f %.3f%s\n", score, activity,
+	    (double) intra / coded, (double) skipped / coded,
+	    (score > threshold) ? " cut" : "");
+}
+
+static void parse (uint8_t * start, uint8_t * end, int tagged,
+		   uint32_t tag, uint32_t tag2)
+{
+    const mpeg2_info_t * info;
+    mpeg2_state_t state;
+
+    info = mpeg2_info (mpeg2dec);
+    if (tagged)
+	mpeg2_tag_picture (mpeg2dec, tag, tag2);
+    mpeg2_buffer (mpeg2dec, start, end);
+    while ((state = mpeg2_parse (mpeg2dec)) != STATE_BUFFER)
+	switch (state) {
+	case STATE_GOP:
+	    scene.gop_base += scene.gop_pictures;
+	    scene.gop_pictures = 0;
+	    break;
+	case STATE_SLICE:
+	    if (info->macroblocks != NULL && info->current_picture != NULL)
+		picture_done (info);
+	    scene.gop_pictures++;
+	    break;
+	default:
+	    break;
+	}
+}
+
+static void es_loop (void)
+{
+    uint8_t * end;
+
+    do {
+	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	parse (buffer, end, 0, 0, 0);
+    } while (end == buffer + BUFFER_SIZE);
+}
+
+static void demux_loop (mpeg2demux_format_t format, int stream)
+{
+    uint8_t * end;
+    mpeg2demux_t * demux;
+    const mpeg2demux_info_t * info;
+    mpeg2demux_state_t state;
+
+    demux = mpeg2demux_init (format, stream);
+    if (demux == NULL)
+	exit (1);
+    info = mpeg2demux_info (demux);
+    do {
+	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	mpeg2demux_buffer (demux, buffer, end);
+	while ((state = mpeg2demux_parse (demux)) != MPEG2DEMUX_BUFFER) {
+	    if (state == MPEG2DEMUX_END)
+		goto done;	/* hit program_end_code */
+	    else if (state == MPEG2DEMUX_ERROR) {
+		fprintf (stderr, "%s\n", mpeg2demux_error_string (demux));
+		if (info->error == MPEG2DEMUX_ERROR_STREAM_ID)
+		    exit (1);
+	    } else
+		parse (info->buf, info->end, info->tagged,
+		       info->pts, info->dts);
+	}
+    } while (end == buffer + BUFFER_SIZE);
+    done:
+    mpeg2demux_close (demux);
+}
+
+int main (int argc, char ** argv)
+{
+    static uint8_t end_code[] = {0x00, 0x00, 0x01, 0xb7};
+
+#ifdef HAVE_IO_H
+    setmode (fileno (stdin), O_BINARY);
+#endif
+
+    handle_args (argc, argv);
+
+    mpeg2dec = mpeg2_init ();
+    if (mpeg2dec == NULL)
+	exit (1);
+    mpeg2_macroblock_info (mpeg2dec, 2);
+
+    if (demux_pva)
+	demux_loop (MPEG2DEMUX_PVA, 0);
+    else if (demux_pid)
+	demux_loop (MPEG2DEMUX_TS, demux_pid);
+    else if (demux_track)
+	demux_loop (MPEG2DEMUX_PS, demux_track);
+    else
+	es_loop ();
+    /* the last picture is only complete at the next start code */
+    parse (end_code, end_code + 4, 0, 0, 0);
+
+    mpeg2_close (mpeg2dec);
+    return 0;
+}
@@ -0,0 +1,576 @@
+/*
+ * stress_mpeg2.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <inttypes.h>
+
+#include "mpeg2.h"
+#include "gettimeofday.h"
+
+/*
+ * Every channel is a copy of one of the input streams, played as if it
+ * was received live: its frame k arrives k frame periods after the
+ * channel started, and has to be decoded "latency" seconds later. The
+ * workers always take the channel whose next frame is due first, and
+ * leave alone the channels whose next frame has not arrived yet.
+ *
+ * A channel decodes one picture per step. When the step is urgent, its
+ * picture is cut into slice regions that as many decoders of the
+ * channel work on at the same time, all of them parsing the whole
+ * stream and writing into the same three frame buffers. A step is over
+ * once all of its decoders reached the next picture header.
+ */
+
+#define MAX_WAYS 8
+
+typedef struct channel_s channel_t;
+
+typedef struct {
+    channel_t * channel;
+    mpeg2dec_t * mpeg2dec;
+    int rows;		/* slices in the current picture */
+    int shown;		/* frames displayed so far */
+    int pass;		/* copies of the stream already given */
+    int flushed;
+    int eof;
+    int late;		/* the current picture was degraded */
+} way_t;
+
+typedef struct {
+    char * name;
+    uint8_t * start;
+    uint8_t * end;
+    /* statistics of all its channels */
+    unsigned int frames, missed, split, degraded;
+    double lateness, worst;
+} stream_t;
+
+struct channel_s {
+    stream_t * stream;
+    way_t way[MAX_WAYS];
+    uint8_t * fbuf[3][3];
+    unsigned int fbuf_size[3];
+    double start;	/* when the first frame arrived */
+    double period;
+    double deadline;	/* of the next frame to be displayed */
+    int frames;		/* frames displayed by the finished steps */
+    int jobs;		/* decoders running the current step, 0 if idle */
+    int next_job;
+    int finished;
+    int done;
+};
+
+static int nb_copies = 4;
+static int nb_threads = 4;
+static int nb_ways = 2;
+static int repeat = 1;
+static double latency = 0.1;
+static int degrade = 0;
+static int nb_streams = 0;
+static stream_t * streams;
+static int nb_channels = 0;
+static channel_t * channels;
+static int active;
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: "
+	     "%s [-h] [-n <copies>] [-j <threads>] [-s <regions>] \\\n"
+	     "\t\t[-l <ms>] [-r <count>] [-d] [-c] <file> ...\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-n\tchannels decoding each file, 1-256, default 4\n"
+	     "\t-j\tworker threads, 1-64, default 4\n"
+	     "\t-s\tslice regions urgent pictures are cut in, 1-8, "
+	     "default 2\n"
+	     "\t-l\ttime a frame may take to decode, in ms, default 100\n"
+	     "\t-r\tplay each file that many times in a row, default 1\n"
+	     "\t-d\tdegrade B pictures that miss their deadline\n"
+	     "\t-c\tuse c implementation, disables all accelerations\n",
+	     argv[0]);
+
+    exit (1);
+}
+
+static int get_number (char ** argv, const char * what, int min, int max)
+{
+    char * s;
+    long value;
+
+    value = strtol (optarg, &s, 0);
+    if (value < min || value > max || *s) {
+	fprintf (stderr, "Invalid %s: %s\n", what, optarg);
+	print_usage (argv);
+    }
+    return value;
+}
+
+static void load_stream (stream_t * stream, char * name)
+{
+    FILE * in_file;
+    size_t size, length;
+
+    in_file = fopen (name, "rb");
+    if (!in_file) {
+	fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		 name);
+	exit (1);
+    }
+    size = length = 0;
+    stream->start = NULL;
+    do {
+	if (length == size) {
+	    size = 2 * size + 1024 * 1024;
+	    stream->start = (uint8_t *) realloc (stream->start, size);
+	    if (stream->start == NULL)
+		exit (1);
+	}
+	length += fread (stream->start + length, 1, size - length, in_file);
+    } while (length == size);
+    fclose (in_file);
+    stream->end = stream->start + length;
+    stream->name = name;
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c, i;
+
+    while ((c = getopt (argc, argv, "hn:j:s:l:r:dc")) != -1)
+	switch (c) {
+	case 'n':
+	    nb_copies = get_number (argv, "channel count", 1, 256);
+	    break;
+
+	case 'j':
+	    nb_threads = get_number (argv, "thread count", 1, 64);
+	    break;
+
+	case 's':
+	    nb_ways = get_number (argv, "region count", 1, MAX_WAYS);
+	    break;
+
+	case 'l':
+	    latency = get_number (argv, "latency", 1, 10000) * 0.001;
+	    break;
+
+	case 'r':
+	    repeat = get_number (argv, "repeat count", 1, 1000000);
+	    break;
+
+	case 'd':
+	    degrade = 1;
+	    break;
+
+	case 'c':
+	    mpeg2_accel (0);
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind == argc)
+	print_usage (argv);
+    nb_streams = argc - optind;
+    streams = (stream_t *) calloc (nb_streams, sizeof (stream_t));
+    if (streams == NULL)
+	exit (1);
+    for (i = 0; i < nb_streams; i++)
+	load_stream (streams + i, argv[optind + i]);
+}
+
+#if defined (HAVE_GETTIMEOFDAY) && defined (HAVE_PTHREAD)
+
+static double now (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 0.000001;
+}
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+static void sched_lock (void)
+{
+    pthread_mutex_lock (&lock);
+}
+
+static void sched_unlock (void)
+{
+    pthread_mutex_unlock (&lock);
+}
+
+static void sched_wake (void)
+{
+    pthread_cond_broadcast (&wake);
+}
+
+static void sched_wait (double until)
+{
+    struct timespec ts;
+
+    if (until == 0) {
+	pthread_cond_wait (&wake, &lock);
+	return;
+    }
+    ts.tv_sec = until;
+    ts.tv_nsec = (until - ts.tv_sec) * 1000000000;
+    if (ts.tv_nsec > 999999999)
+	ts.tv_nsec = 999999999;
+    pthread_cond_timedwait (&wake, &lock, &ts);
+}
+
+static int picture_late (void * arg, const mpeg2_picture_t * picture)
+{
+    way_t * way = (way_t *) arg;
+    double deadline;
+
+    /* step_done may be updating it from another worker */
+    sched_lock ();
+    deadline = way->channel->deadline;
+    sched_unlock ();
+    if (now () < deadline)
+	return 0;
+    way->late = 1;
+    return 1;
+}
+
+static void set_fbufs (way_t * way)
+{
+    static const char * plane[3] = {"luma", "chroma", "chroma"};
+    channel_t * channel = way->channel;
+    const mpeg2_sequence_t * sequence = mpeg2_info (way->mpeg2dec)->sequence;
+    unsigned int size[3];
+    int i;
+
+    size[0] = sequence->width * sequence->height;
+    size[1] = size[2] = sequence->chroma_width * sequence->chroma_height;
+    for (i = 0; i < 3; i++)
+	if (size[i] > channel->fbuf_size[i]) {
+	    /* the other decoders of the channel may be using them */
+	    fprintf (stderr, "%s: %s plane grows to %u bytes, "
+		     "can not resize frame buffers\n",
+		     channel->stream->name, plane[i], size[i]);
+	    exit (1);
+	}
+    for (i = 0; i < 3; i++)
+	mpeg2_set_buf (way->mpeg2dec, channel->fbuf[i], NULL);
+    way->rows = (sequence->height + 15) >> 4;
+}
+
+/* decodes the current picture, or its region, up to the next one */
+static void decode_step (way_t * way, int first, int end)
+{
+    static uint8_t end_code[] = {0x00, 0x00, 0x01, 0xb7};
+    const mpeg2_info_t * info = mpeg2_info (way->mpeg2dec);
+    stream_t * stream = way->channel->stream;
+
+    mpeg2_slice_region (way->mpeg2dec, first, end);
+    while (1)
+	switch (mpeg2_parse (way->mpeg2dec)) {
+	case STATE_BUFFER:
+	    if (way->pass < repeat) {
+		mpeg2_buffer (way->mpeg2dec, stream->start, stream->end);
+		way->pass++;
+	    } else if (!way->flushed) {
+		mpeg2_buffer (way->mpeg2dec, end_code, end_code + 4);
+		way->flushed = 1;
+	    } else {
+		way->eof = 1;
+		return;
+	    }
+	    break;
+	case STATE_SEQUENCE:
+	    set_fbufs (way);
+	    break;
+	case STATE_PICTURE:
+	    way->rows = (info->sequence->height + 15) >> 4;
+	    if (info->current_picture->nb_fields == 1)
+		way->rows >>= 1;
+	    return;
+	case STATE_PICTURE_2ND:
+	    return;
+	case STATE_SLICE:
+	case STATE_END:
+	case STATE_INVALID_END:
+	    if (info->display_fbuf)
+		way->shown++;
+	    break;
+	default:
+	    break;
+	}
+}
+
+static void run_job (channel_t * channel, int job)
+{
+    int rows, i;
+
+    if (channel->jobs > 1) {
+	rows = channel->way[job].rows;
+	decode_step (channel->way + job,
+		     job ? 1 + rows * job / channel->jobs : 1,
+		     (job < channel->jobs - 1) ?
+		     1 + rows * (job + 1) / channel->jobs : 0xb0);
+	return;
+    }
+    /* the other decoders only follow the headers */
+    decode_step (channel->way, 1, 0xb0);
+    for (i = 1; i < nb_ways; i++)
+	decode_step (channel->way + i, 1, 1);
+}
+
+static void step_done (channel_t * channel, double time)
+{
+    stream_t * stream = channel->stream;
+    double deadline;
+    int i, late;
+
+    late = 0;
+    for (i = 0; i < nb_ways; i++) {
+	late |= channel->way[i].late;
+	channel->way[i].late = 0;
+    }
+    stream->degraded += late;
+    for (; channel->frames < channel->way[0].shown; channel->frames++) {
+	deadline = (channel->start + latency +
+		    channel->frames * channel->period);
+	stream->frames++;
+	if (time > deadline) {
+	    stream->missed++;
+	    stream->lateness += time - deadline;
+	    if (stream->worst < time - deadline)
+		stream->worst = time - deadline;
+	}
+    }
+    channel->deadline = (channel->start + latency +
+			 channel->frames * channel->period);
+    channel->jobs = 0;
+    if (channel->way[0].eof) {
+	channel->done = 1;
+	active--;
+    }
+}
+
+/* earliest deadline first, among the channels that have work */
+static void * worker (void * arg)
+{
+    channel_t * channel;
+    channel_t * best;
+    double time, arrival, until;
+    int i, job;
+
+    sched_lock ();
+    while (active) {
+	time = now ();
+	best = NULL;
+	until = 0;
+	for (i = 0; i < nb_channels; i++) {
+	    channel = channels + i;
+	    if (channel->done || (channel->jobs &&
+				  channel->next_job == channel->jobs))
+		continue;
+	    if (!channel->jobs) {
+		arrival = channel->start + channel->frames * channel->period;
+		if (arrival > time) {
+		    if (!until || arrival < until)
+			until = arrival;
+		    continue;
+		}
+	    }
+	    if (best == NULL || channel->deadline < best->deadline)
+		best = channel;
+	}
+	if (best == NULL) {
+	    sched_wait (until);
+	    continue;
+	}
+	if (!best->jobs) {
+	    best->jobs = 1;
+	    if (nb_ways > 1 && best->deadline - time < best->period) {
+		best->jobs = nb_ways;
+		best->stream->split++;
+		sched_wake ();
+	    }
+	    best->next_job = best->finished = 0;
+	}
+	job = best->next_job++;
+	sched_unlock ();
+	run_job (best, job);
+	sched_lock ();
+	if (++best->finished == best->jobs) {
+	    step_done (best, now ());
+	    sched_wake ();
+	}
+    }
+    sched_unlock ();
+    return NULL;
+}
+
+static void open_channel (channel_t * channel, stream_t * stream)
+{
+    const mpeg2_sequence_t * sequence;
+    mpeg2_state_t state;
+    way_t * way;
+    int i, j;
+
+    channel->stream = stream;
+    for (i = 0; i < nb_ways; i++) {
+	way = channel->way + i;
+	way->channel = channel;
+	way->mpeg2dec = mpeg2_init ();
+	if (way->mpeg2dec == NULL)
+	    exit (1);
+	if (degrade)
+	    mpeg2_deadline (way->mpeg2dec, picture_late, way);
+	mpeg2_buffer (way->mpeg2dec, stream->start, stream->end);
+	way->pass = 1;
+	do
+	    state = mpeg2_parse (way->mpeg2dec);
+	while (state != STATE_SEQUENCE && state != STATE_BUFFER);
+	if (state == STATE_BUFFER) {
+	    fprintf (stderr, "%s: no sequence header\n", stream->name);
+	    exit (1);
+	}
+	if (!i) {
+	    sequence = mpeg2_info (way->mpeg2dec)->sequence;
+	    channel->fbuf_size[0] = sequence->width * sequence->height;
+	    channel->fbuf_size[1] = channel->fbuf_size[2] =
+		sequence->chroma_width * sequence->chroma_height;
+	    for (j = 0; j < 9; j++) {
+		channel->fbuf[j / 3][j % 3] =
+		    (uint8_t *) malloc (channel->fbuf_size[j % 3]);
+		if (channel->fbuf[j / 3][j % 3] == NULL)
+		    exit (1);
+	    }
+	    /* 25 fps when the frame rate code is invalid */
+	    channel->period = (sequence->frame_period ?
+			       sequence->frame_period : 1080000) / 27000000.0;
+	}
+	set_fbufs (way);
+    }
+}
+
+static void close_channel (channel_t * channel)
+{
+    int i;
+
+    for (i = 0; i < nb_ways; i++)
+	mpeg2_close (channel->way[i].mpeg2dec);
+    for (i = 0; i < 9; i++)
+	free (channel->fbuf[i / 3][i % 3]);
+}
+
+static void print_stats (const char * name, const stream_t * stream)
+{
+    fprintf (stderr, "%s: %u frames, %u late (%.2f%%)", name,
+	     stream->frames, stream->missed,
+	     stream->frames ? 100.0 * stream->missed / stream->frames : 0.0);
+    if (stream->missed)
+	fprintf (stderr, " by %.1f ms on average, %.1f ms at worst",
+		 1000 * stream->lateness / stream->missed,
+		 1000 * stream->worst);
+    fprintf (stderr, ", %u split", stream->split);
+    if (degrade)
+	fprintf (stderr, ", %u degraded", stream->degraded);
+    fprintf (stderr, "\n");
+}
+
+int main (int argc, char ** argv)
+{
+    stream_t total;
+    double start;
+    pthread_t * threads;
+    int i;
+
+    handle_args (argc, argv);
+
+    nb_channels = nb_streams * nb_copies;
+    channels = (channel_t *) calloc (nb_channels, sizeof (channel_t));
+    if (channels == NULL)
+	exit (1);
+    for (i = 0; i < nb_channels; i++)
+	open_channel (channels + i, streams + i / nb_copies);
+
+    /* the channels start one after the other within a frame period */
+    start = now ();
+    for (i = 0; i < nb_channels; i++) {
+	channels[i].start = start + channels[i].period * i / nb_channels;
+	channels[i].deadline = channels[i].start + latency;
+    }
+    active = nb_channels;
+    threads = (pthread_t *) malloc (nb_threads * sizeof (pthread_t));
+    if (threads == NULL)
+	exit (1);
+    for (i = 0; i < nb_threads; i++)
+	if (pthread_create (threads + i, NULL, worker, NULL)) {
+	    fprintf (stderr, "could not create decoder thread\n");
+	    exit (1);
+	}
+    for (i = 0; i < nb_threads; i++)
+	pthread_join (threads[i], NULL);
+    free (threads);
+
+    memset (&total, 0, sizeof (total));
+    for (i = 0; i < nb_streams; i++) {
+	print_stats (streams[i].name, streams + i);
+	total.frames += streams[i].frames;
+	total.missed += streams[i].missed;
+	total.split += streams[i].split;
+	total.degraded += streams[i].degraded;
+	total.lateness += streams[i].lateness;
+	if (total.worst < streams[i].worst)
+	    total.worst = streams[i].worst;
+	free (streams[i].start);
+    }
+    print_stats ("all channels", &total);
+    fprintf (stderr, "%d channels decoded in %.2f seconds on %d threads\n",
+	     nb_channels, now () - start, nb_threads);
+
+    for (i = 0; i < nb_channels; i++)
+	close_channel (channels + i);
+    free (channels);
+    free (streams);
+    return 0;
+}
+
+#else /* !HAVE_GETTIMEOFDAY || !HAVE_PTHREAD */
+
+int main (int argc, char ** argv)
+{
+    fprintf (stderr, "%s needs a clock and threads, "
+	     "not available on this system\n", argv[0]);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * transrate_mpeg2.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#ifdef HAVE_IO_H
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <inttypes.h>
+
+#include "mpeg2.h"
+
+#define BUFFER_SIZE 65536
+static uint8_t buffer[BUFFER_SIZE];
+static FILE * in_file;
+static FILE * out_file;
+static unsigned int bitrate = 0;
+static unsigned long long bytes_in = 0;
+static unsigned long long bytes_out = 0;
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: "
+	     "%s [-h] [-b <rate>] [-o <file>] <file>\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-b\ttarget bit rate in bit/s, k and M suffixes allowed\n"
+	     "\t-o\twrite to file instead of stdout\n",
+	     argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+    double rate;
+
+    while ((c = getopt (argc, argv, "hb:o:")) != -1)
+	switch (c) {
+	case 'b':
+	    rate = strtod (optarg, &s);
+	    if (*s == 'k')
+		rate *= 1000, s++;
+	    else if (*s == 'M')
+		rate *= 1000000, s++;
+	    if (rate < 0 || rate > 4e9 || *s) {
+		fprintf (stderr, "Invalid bit rate: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    bitrate = rate;
+	    break;
+
+	case 'o':
+	    out_file = fopen (optarg, "wb");
+	    if (!out_file) {
+		fprintf (stderr, "%s - could not open file %s\n",
+			 strerror (errno), optarg);
+		exit (1);
+	    }
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind < argc) {
+	in_file = fopen (argv[optind], "rb");
+	if (!in_file) {
+	    fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		     argv[optind]);
+	    exit (1);
+	}
+    } else
+	in_file = stdin;
+}
+
+static int output (void * arg, const uint8_t * data, unsigned int len)
+{
+    if (len && fwrite (data, len, 1, out_file) != 1) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+    bytes_out += len;
+    return 0;
+}
+
+int main (int argc, char ** argv)
+{
+    mpeg2_transrate_t * transrate;
+    uint8_t * end;
+
+#ifdef HAVE_IO_H
+    setmode (fileno (stdin), O_BINARY);
+    setmode (fileno (stdout), O_BINARY);
+#endif
+
+    out_file = stdout;
+    handle_args (argc, argv);
+
+    transrate = mpeg2_transrate_init (bitrate);
+    if (transrate == NULL)
+	exit (1);
+
+    do {
+	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	bytes_in += end - buffer;
+	if (mpeg2_transrate (transrate, buffer, end, output, NULL)) {
+	    fprintf (stderr, "could not allocate transrate buffer\n");
+	    exit (1);
+	}
+    } while (end == buffer + BUFFER_SIZE);
+    if (mpeg2_transrate_flush (transrate, output, NULL)) {
+	fprintf (stderr, "could not allocate transrate buffer\n");
+	exit (1);
+    }
+    mpeg2_transrate_close (transrate);
+
+    if (fclose (out_file)) {
+	fprintf (stderr, "%s - could not write output\n", strerror (errno));
+	exit (1);
+    }
+    fprintf (stderr, "%llu bytes in, %llu bytes out (%.1f%%)\n",
+	     bytes_in, bytes_out,
+	     bytes_in ? 100.0 * bytes_out / bytes_in : 100.0);
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * userdata_mpeg2.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#ifdef HAVE_IO_H
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <inttypes.h>
+
+#include "mpeg2.h"
+#include "mpeg2demux.h"
+
+#define BUFFER_SIZE 65536
+static uint8_t buffer[BUFFER_SIZE];
+static FILE * in_file;
+static int demux_track = 0;
+static int demux_pid = 0;
+static int demux_pva = 0;
+static int captions_only = 0;
+static int frame_number = 0;
+static mpeg2dec_t * mpeg2dec;
+
+static void print_usage (char ** argv)
+{
+    fprintf (stderr, "usage: "
+	     "%s [-h] [-c] [-s <track>] [-t <pid>] [-p] <file>\n"
+	     "\t-h\tdisplay help\n"
+	     "\t-c\tonly print ATSC A/53 and SCTE 20 caption data\n"
+	     "\t-s\tuse program stream demultiplexer, "
+	     "track 0-15 or 0xe0-0xef\n"
+	     "\t-t\tuse transport stream demultiplexer, pid 0x10-0x1ffe\n"
+	     "\t-p\tuse pva demultiplexer\n",
+	     argv[0]);
+
+    exit (1);
+}
+
+static void handle_args (int argc, char ** argv)
+{
+    int c;
+    char * s;
+
+    while ((c = getopt (argc, argv, "hcs:t:p")) != -1)
+	switch (c) {
+	case 'c':
+	    captions_only = 1;
+	    break;
+
+	case 's':
+	    demux_track = strtol (optarg, &s, 0);
+	    if (demux_track < 0xe0)
+		demux_track += 0xe0;
+	    if (demux_track < 0xe0 || demux_track > 0xef || *s) {
+		fprintf (stderr, "Invalid track number: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 't':
+	    demux_pid = strtol (optarg, &s, 0);
+	    if (demux_pid < 0x10 || demux_pid > 0x1ffe || *s) {
+		fprintf (stderr, "Invalid pid: %s\n", optarg);
+		print_usage (argv);
+	    }
+	    break;
+
+	case 'p':
+	    demux_pva = 1;
+	    break;
+
+	default:
+	    print_usage (argv);
+	}
+
+    if (optind < argc) {
+	in_file = fopen (argv[optind], "rb");
+	if (!in_file) {
+	    fprintf (stderr, "%s - could not open file %s\n", strerror (errno),
+		     argv[optind]);
+	    exit (1);
+	}
+    } else
+	in_file = stdin;
+}
+
+static int is_caption (const uint8_t * data, unsigned int len)
+{
+    /* ATSC A/53 cc_data */
+    if (len >= 5 && !memcmp (data, "GA94", 4) && data[4] == 3)
+	return 1;
+    /* SCTE 20 */
+    if (len >= 1 && data[0] == 3)
+	return 1;
+    return 0;
+}
+
+static void print_block (const mpeg2_picture_t * picture,
+			 const uint8_t * data, unsigned int len)
+{
+    static const char type[] = "?IPBD????????????";
+    unsigned int i;
+
+    if (captions_only && !is_caption (data, len))
+	return;
+    printf ("%d %c %u", frame_number,
+	    type[picture->flags & PIC_MASK_CODING_TYPE],
+	    picture->temporal_reference);
+    if (picture->flags & PIC_FLAG_TAGS)
+	printf (" %u %u", picture->tag, picture->tag2);
+    else
+	printf (" - -");
+    printf (" %u ", len);
+    for (i = 0; i < len; i++)
+	printf ("%02x", data[i]);
+    printf ("\n");
+}
+
+static int user_data (void * arg, const mpeg2_picture_t * picture,
+		      const uint8_t * data, unsigned int len)
+{
+    unsigned int i, start;
+
+    /* several user data blocks are separated by their start code prefix */
+    for (i = start = 0; i + 3 <= len; i++)
+	if (!data[i] && !data[i + 1] && data[i + 2] == 1) {
+	    print_block (picture, data + start, i - start);
+	    start = i += 3;
+	}
+    if (len)
+	print_block (picture, data + start, len - start);
+    frame_number++;
+    return 0;
+}
+
+static void extract (uint8_t * start, uint8_t * end, int tagged,
+		     uint32_t tag, uint32_t tag2)
+{
+    mpeg2_batch_buf_t buf;
+
+    buf.start = start;
+    buf.end = end;
+    buf.tagged = tagged;
+    buf.tag = tag;
+    buf.tag2 = tag2;
+    if (mpeg2_extract_user_data (mpeg2dec, &buf, 1, user_data, NULL)) {
+	fprintf (stderr, "could not allocate user data buffer\n");
+	exit (1);
+    }
+}
+
+static void es_loop (void)
+{
+    uint8_t * end;
+
+    do {
+	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	extract (buffer, end, 0, 0, 0);
+    } while (end == buffer + BUFFER_SIZE);
+}
+
+static void demux_loop (mpeg2demux_format_t format, int stream)
+{
+    uint8_t * end;
+    mpeg2demux_t * demux;
+    const mpeg2demux_info_t * info;
+    mpeg2demux_state_t state;
+
+    demux = mpeg2demux_init (format, stream);
+    if (demux == NULL)
+	exit (1);
+    info = mpeg2demux_info (demux);
+    do {
+	end = buffer + fread (buffer, 1, BUFFER_SIZE, in_file);
+	mpeg2demux_buffer (demux, buffer, end);
+	while ((state = mpeg2demux_parse (demux)) != MPEG2DEMUX_BUFFER) {
+	    if (state == MPEG2DEMUX_END)
+		goto done;	/* hit program_end_code */
+	    else if (state == MPEG2DEMUX_ERROR) {
+		fprintf (stderr, "%s\n", mpeg2demux_error_string (demux));
+		if (info->error == MPEG2DEMUX_ERROR_STREAM_ID)
+		    exit (1);
+	    } else
+		extract (info->buf, info->end, info->tagged,
+			 info->pts, info->dts);
+	}
+    } while (end == buffer + BUFFER_SIZE);
+    done:
+    mpeg2demux_close (demux);
+}
+
+int main (int argc, char ** argv)
+{
+    static uint8_t end_code[] = {0x00, 0x00, 0x01, 0xb7};
+
+#ifdef HAVE_IO_H
+    setmode (fileno (stdin), O_BINARY);
+#endif
+
+    handle_args (argc, argv);
+
+    mpeg2dec = mpeg2_init ();
+    if (mpeg2dec == NULL)
+	exit (1);
+
+    if (demux_pva)
+	demux_loop (MPEG2DEMUX_PVA, 0);
+    else if (demux_pid)
+	demux_loop (MPEG2DEMUX_TS, demux_pid);
+    else if (demux_track)
+	demux_loop (MPEG2DEMUX_PS, demux_track);
+    else
+	es_loop ();
+    /* flush the last picture out of the decoder */
+    extract (end_code, end_code + 4, 0, 0, 0);
+
+    mpeg2_close (mpeg2dec);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * transrate_blocks.c
+ * Copyright (C) 2000-2003 Michel Lespinasse <walken@zoy.org>
+ * Copyright (C) 1999-2000 Aaron Holtzman <aholtzma@ess.engr.uvic.ca>
+ *
+ * This file is part of mpeg2dec, a free MPEG-2 video stream decoder.
+ * See http://libmpeg2.sourceforge.net/ for updates.
+ *
+ * mpeg2dec is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpeg2dec is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Writes blocks with the transrater's put_block() and parses them back
+ * with its get_block(), which is what the next decoder of a transrated
+ * stream sees. Every run and level each VLC table can be asked for is
+ * tried alone, then random blocks shaped like the output of
+ * requantize(), whose merged zero runs go up to 63.
+ */
+
+#include "transrate.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int errors = 0;
+
+static void check (mpeg2_transrate_t * tr, const block_t * block,
+		   int table, int intra)
+{
+    uint8_t buf[64 * 6 + 16];
+    block_t parsed;
+    int i;
+
+    tr->out_ptr = buf;
+    tr->pending = 0;
+    tr->pending_bits = 0;
+    put_block (tr, block, table, intra);
+    put_bits (tr, 0, 24);	/* flush, and room for the reader */
+    put_bits (tr, 0, 24);
+    bitstream_start (tr, buf);
+    if (get_block (tr, &parsed, intra ? table : 0))
+	parsed.count = -1;
+    else if (parsed.count == block->count) {
+	for (i = 0; i < block->count; i++)
+	    if (parsed.run[i] != block->run[i] ||
+		parsed.level[i] != block->level[i])
+		break;
+	if (i == block->count)
+	    return;
+    }
+    if (errors++ < 10) {
+	fprintf (stderr, "mpeg%d table %d %s:", 2 - tr->mpeg1, table,
+		 intra ? "intra" : "non intra");
+	for (i = 0; i < block->count; i++)
+	    fprintf (stderr, " (%d,%d)", block->run[i], block->level[i]);
+	if (parsed.count < 0)
+	    fprintf (stderr, " does not parse\n");
+	else {
+	    fprintf (stderr, " parses as");
+	    for (i = 0; i < parsed.count; i++)
+		fprintf (stderr, " (%d,%d)", parsed.run[i], parsed.level[i]);
+	    fprintf (stderr, "\n");
+	}
+    }
+}
+
+int main (void)
+{
+    mpeg2_transrate_t tr;
+    block_t block;
+    int mpeg1, table, intra, max_level, max_run, run, level, i, left;
+    unsigned int seed = 1;
+
+    init_tables ();
+    memset (&tr, 0, sizeof (tr));
+    for (mpeg1 = 0; mpeg1 <= 1; mpeg1++)
+	for (table = 1; table <= 2 - mpeg1; table++)
+	    /* non intra blocks always use table B-14 */
+	    for (intra = table - 1; intra <= 1; intra++) {
+		tr.mpeg1 = mpeg1;
+		max_level = mpeg1 ? 255 : 2047;
+		/* intra blocks start after the DC coefficient */
+		max_run = intra ? 62 : 63;
+
+		block.count = 1;
+		for (run = 0; run <= max_run; run++)
+		    for (level = 1; level <= max_level; level++) {
+			block.run[0] = run;
+			block.level[0] = level;
+			check (&tr, &block, table, intra);
+			block.level[0] = -level;
+			check (&tr, &block, table, intra);
+		    }
+
+		for (i = 0; i < 100000; i++) {
+		    left = max_run + 1;
+		    for (block.count = 0; left > 0; block.count++) {
+			seed = seed * 1103515245 + 12345;
+			run = (seed >> 16) % left;
+			if (run > 2 && (seed & 0x30))
+			    run = (seed >> 20) & 3;	/* mostly short runs */
+			seed = seed * 1103515245 + 12345;
+			level = 1 + (seed >> 16) % ((seed & 0x700) ?
+						    4 : max_level);
+			block.run[block.count] = run;
+			block.level[block.count] = (seed & 0x80) ? -level : level;
+			left -= run + 1;
+		    }
+		    check (&tr, &block, table, intra);
+		}
+	    }
+    if (errors)
+	fprintf (stderr, "%d blocks do not parse back\n", errors);
+    return !!errors;
+}